@@ -7,34 +7,105 @@
 #include <asset_loader.h>
 #include <texture_asset.h>
 #include <mesh_asset.h>
+#include <material_asset.h>
+#include <asset_archive.h>
+#include <mesh_optimizer.h>
+#include <texture_mipmaps.h>
+#include <texture_compression.h>
+#include <thread_pool.h>
+#include "bake_cache.h"
+#include "obj_parser.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
 #include <chrono>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <string>
 
 namespace fs = std::filesystem;
 
 using namespace assets;
 
+//the bake tasks run in parallel, so every message is built first and written whole under the lock
+static std::mutex outputMutex;
 
-bool convertImage(const fs::path& input, const fs::path& output)
+static void printMessage(std::ostream& stream, const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(outputMutex);
+    stream << message << std::endl;
+}
+
+//everything besides the sources that changes the baked output, it is part of the bake cache keys
+struct BakeOptions
+{
+    //0 only merges vertices that are exactly equal
+    float weldEpsilon{0.f};
+    //sorts the triangle clusters to reduce overdraw, at a small vertex cache cost
+    bool optimizeOverdraw{false};
+    //quantized by default, the engine dequantizes in the vertex shader
+    VertexFormat vertexFormat{VertexFormat::PNV_Q16};
+    //levels of detail including the full mesh, each one aims at half the triangles of the previous
+    uint32_t lodCount{4};
+    //filter of the texture mip chains
+    MipFilter mipFilter{MipFilter::Kaiser};
+    //bc7 keeps the alpha and the most color detail of the block formats
+    TextureFormat textureFormat{TextureFormat::BC7};
+    BlockQuality blockQuality{BlockQuality::High};
+    //triangles per sector of the k-d split of every material, 0 keeps each material in a single submesh
+    uint32_t sectorTriangles{0};
+};
+
+bool convertImage(const fs::path& input, const std::vector<char>& data, const fs::path& output, const BakeOptions& options)
 {
     int texWidth, texHeight, texChannels;
 
-    stbi_uc* pixels = stbi_load(input.u8string().c_str(),&texWidth,&texHeight,&texChannels,STBI_rgb_alpha);
+    //the cache already read the file to hash it
+    stbi_uc* pixels = stbi_load_from_memory((const stbi_uc*)data.data(),static_cast<int>(data.size()),&texWidth,&texHeight,&texChannels,STBI_rgb_alpha);
     if (!pixels)
     {
-        std::cout << "Failed to load texture file " << input << std::endl;
+        printMessage(std::cout, "Failed to load texture file " + input.string());
         return false;
     }
-    int imageSize = texWidth * texHeight * 4;
+
+    //the engine samples the textures as srgb, so they are filtered in linear space
+    std::vector<uint8_t> mipPixels;
+    std::vector<TextureMip> mips = generateMipmaps(pixels, texWidth, texHeight, options.mipFilter, true, mipPixels);
+    stbi_image_free(pixels);
+
+    //every level is encoded on its own, the mips then point into the levels
+    //they are stored smallest first, so a streaming load finds the ones it shows first at the start of the blob
+    std::vector<uint8_t> levels;
+    for (size_t level = mips.size(); level-- > 0;)
+    {
+        TextureMip& mip = mips[level];
+        const size_t size = textureLevelSize(options.textureFormat, mip.width, mip.height);
+        const size_t offset = levels.size();
+        levels.resize(offset + size);
+        if (blockSize(options.textureFormat) > 0)
+        {
+            compressBlocks(mipPixels.data() + mip.offset, mip.width, mip.height, options.textureFormat, options.blockQuality, levels.data() + offset);
+        }
+        else
+        {
+            memcpy(levels.data() + offset, mipPixels.data() + mip.offset, size);
+        }
+        mip.offset = static_cast<uint32_t>(offset);
+        mip.size = static_cast<uint32_t>(size);
+    }
+    mipPixels.swap(levels);
 
     TextureInfo info;
-    info.textureSize = imageSize;
+    info.textureSize = mipPixels.size();
     info.pixelsize[0] = texWidth;
     info.pixelsize[1] = texHeight;
-    info.textureFormat = TextureFormat::RGBA8;
+    info.textureFormat = options.textureFormat;
     info.originalFile = input.string();
-    AssetFile newImage = packTexture(&info,pixels);
+    info.mips = mips;
+    AssetFile newImage = packTexture(&info,mipPixels.data());
 
-    stbi_image_free(pixels);
     saveBinaryFile(output.string().c_str(),newImage);
     return true;
 }
@@ -101,14 +172,36 @@ bool extractMeshFromObj(std::vector<tinyobj::shape_t>& shapes, tinyobj::attrib_t
 
 
 
-bool convertMesh(const fs::path& input, const fs::path& output)
+
+//a level that doesn't remove at least this fraction of the previous one is not worth its memory
+constexpr float LOD_MIN_REDUCTION = 0.1f;
+
+const char* vertexFormatName(VertexFormat format)
 {
-    //attrib will contain the vertex arrays of the file
-    tinyobj::attrib_t attrib;
-    //shapes contains the info for each separate objet in the file
-    std::vector<tinyobj::shape_t> shapes;
-    //materials contains the informations about the material of each shape, not used for now
-    std::vector<tinyobj::material_t> materials;
+    switch (format)
+    {
+    case VertexFormat::PNCV_F32: return "PNCV_F32";
+    case VertexFormat::PNV_Q16: return "PNV_Q16";
+    case VertexFormat::PNCV_Q16: return "PNCV_Q16";
+    default: return "Unknown";
+    }
+}
+
+const char* mipFilterName(MipFilter filter)
+{
+    switch (filter)
+    {
+    case MipFilter::None: return "none";
+    case MipFilter::Box: return "box";
+    case MipFilter::Kaiser: return "kaiser";
+    default: return "Unknown";
+    }
+}
+
+bool convertMesh(const fs::path& input, const std::vector<char>& data, const fs::path& output, const BakeOptions& options)
+{
+    //the cache already read the file to hash it, the parser splits it across the pool
+    ObjFile obj;
 
     //error and warning output from the load function
     std::string warn;
@@ -117,81 +210,735 @@ bool convertMesh(const fs::path& input, const fs::path& output)
     auto start  = std::chrono::high_resolution_clock::now();
 
     //load the obj file
-    tinyobj::LoadObj(&attrib,&shapes,&materials,&warn,&err,input.string().c_str(),nullptr);
+    bool parsed = parseObj(data.data(),data.size(),input.parent_path(),obj,warn,err);
 
     auto end = std::chrono::high_resolution_clock::now();
 
     auto diff = end - start;
-    std::cout << "obj took " << std::chrono::duration_cast<std::chrono::milliseconds>(diff).count() << "ms" << std::endl;
+    printMessage(std::cout, "obj took " + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(diff).count()) + "ms");
     //make sur to output the warnings to the console, in case there are issues with the file
     if (!warn.empty())
     {
-        std::cout << "WARN: " << warn << std::endl;
+        printMessage(std::cout, "WARN: " + warn);
     }
     //if error break the mesh loading
-    //happens if file not found or malformed
-    if (!err.empty())
+    //happens if the file is malformed
+    if (!parsed)
     {
-        std::cerr << err << std::endl;
+        printMessage(std::cerr, err);
         return false;
     }
 
+    std::vector<Vertex> corners;
+    std::vector<uint32_t> cornerIndices;
+
+    extractMeshFromObj(obj,cornerIndices,corners);
+
+    //the triangles of each material are grouped, in the order of the materials in the libraries
+    std::vector<uint32_t> triangleOrder(obj.triangleMaterials.size());
+    for (uint32_t t = 0; t < triangleOrder.size(); t++)
+    {
+        triangleOrder[t] = t;
+    }
+    std::stable_sort(triangleOrder.begin(), triangleOrder.end(), [&](uint32_t a, uint32_t b){
+        return obj.triangleMaterials[a] < obj.triangleMaterials[b];
+    });
+
+    //vertices are only welded inside a material, so the material borders are seams the simplification keeps closed
     std::vector<Vertex> vertices;
     std::vector<uint32_t> indices;
+    std::vector<MeshSubmesh> materialRanges;
+    std::vector<std::string> materials;
+    std::vector<uint32_t> vertexMaterials;
+    std::vector<Vertex> materialCorners;
+    std::vector<Vertex> welded;
+    std::vector<uint32_t> weldedIndices;
+    for (size_t begin = 0; begin < triangleOrder.size();)
+    {
+        const int32_t material = obj.triangleMaterials[triangleOrder[begin]];
+        size_t end = begin;
+        materialCorners.clear();
+        for (; end < triangleOrder.size() && obj.triangleMaterials[triangleOrder[end]] == material; end++)
+        {
+            materialCorners.insert(materialCorners.end(), corners.begin() + size_t(triangleOrder[end]) * 3, corners.begin() + size_t(triangleOrder[end]) * 3 + 3);
+        }
+        weldVertices(materialCorners.data(), materialCorners.size(), options.weldEpsilon, welded, weldedIndices);
+
+        MeshSubmesh range{};
+        range.indexOffset = static_cast<uint32_t>(indices.size());
+        range.indexCount = static_cast<uint32_t>(weldedIndices.size());
+        range.material = static_cast<uint32_t>(materials.size());
+        materialRanges.push_back(range);
+        materials.push_back(material >= 0 ? obj.materials[material].name : std::string());
+
+        const uint32_t base = static_cast<uint32_t>(vertices.size());
+        for (uint32_t index : weldedIndices)
+        {
+            indices.push_back(base + index);
+        }
+        vertices.insert(vertices.end(), welded.begin(), welded.end());
+        vertexMaterials.resize(vertices.size(), range.material);
+        begin = end;
+    }
+
+    //big materials are split in sectors, so the renderer can cull the parts out of view, every sector is a submesh
+    //without sectors the split keeps every material whole
+    const size_t sectorTriangles = options.sectorTriangles > 0 ? options.sectorTriangles : SIZE_MAX;
+    std::vector<MeshSubmesh> submeshes;
+    std::vector<std::vector<SectorNode>> sectorTrees(materialRanges.size());
+    std::vector<uint32_t> firstSectors(materialRanges.size());
+    std::vector<uint32_t> sectorSizes;
+    for (size_t m = 0; m < materialRanges.size(); m++)
+    {
+        const MeshSubmesh& range = materialRanges[m];
+        sectorTrees[m] = splitSectors(indices.data() + range.indexOffset, range.indexCount, vertices.data(), sectorTriangles, sectorSizes);
+        firstSectors[m] = static_cast<uint32_t>(submeshes.size());
+        uint32_t offset = range.indexOffset;
+        for (uint32_t size : sectorSizes)
+        {
+            MeshSubmesh submesh = range;
+            submesh.indexOffset = offset;
+            submesh.indexCount = size;
+            submeshes.push_back(submesh);
+            offset += size;
+        }
+    }
+
+    //triangles are reordered for the post transform cache, then the vertices for fetch locality
+    //every submesh is optimized on its own as it is drawn on its own
+    VertexCacheStats before = analyzeVertexCache(indices.data(), indices.size(), vertices.size());
+    for (const MeshSubmesh& submesh : submeshes)
+    {
+        std::vector<uint32_t> clusters = optimizeVertexCache(indices.data() + submesh.indexOffset, submesh.indexCount, vertices.size());
+        if (options.optimizeOverdraw)
+        {
+            optimizeOverdraw(indices.data() + submesh.indexOffset, submesh.indexCount, clusters, vertices.data());
+        }
+    }
+
+    //every level is simplified from the full mesh so the errors are relative to it, then split back in submeshes
+    //the simplification only moves vertices along the material seams, so each triangle keeps the vertices of its own material
+    //and goes to the sector of its centroid
+    std::vector<MeshLod> lods = {{0, static_cast<uint32_t>(indices.size()), 0.f, 0}};
+    const size_t fullIndexCount = indices.size();
+    const size_t submeshCount = submeshes.size();
+    for (uint32_t level = 1; level < options.lodCount; level++)
+    {
+        size_t previousCount = lods.back().indexCount;
+        size_t targetCount = previousCount / 2 / 3 * 3;
+        std::vector<uint32_t> lodIndices;
+        float error = simplifyMesh(indices.data(), fullIndexCount, vertices.data(), vertices.size(), targetCount, FLT_MAX, lodIndices);
+        if (lodIndices.empty() || lodIndices.size() > previousCount * (1.f - LOD_MIN_REDUCTION))
+        {
+            break;
+        }
+
+        std::vector<uint32_t> triangleSubmeshes(lodIndices.size() / 3);
+        std::vector<uint32_t> submeshOffsets(submeshCount + 1, 0);
+        for (size_t i = 0; i < lodIndices.size(); i += 3)
+        {
+            const uint32_t material = vertexMaterials[lodIndices[i]];
+            float centroid[3];
+            for (int k = 0; k < 3; k++)
+            {
+                centroid[k] = (vertices[lodIndices[i]].position[k] + vertices[lodIndices[i + 1]].position[k] + vertices[lodIndices[i + 2]].position[k]) / 3.f;
+            }
+            triangleSubmeshes[i / 3] = firstSectors[material] + findSector(sectorTrees[material], centroid);
+            submeshOffsets[triangleSubmeshes[i / 3] + 1] += 3;
+        }
+        for (size_t s = 0; s < submeshCount; s++)
+        {
+            submeshOffsets[s + 1] += submeshOffsets[s];
+        }
+        std::vector<uint32_t> sorted(lodIndices.size());
+        std::vector<uint32_t> fill(submeshOffsets.begin(), submeshOffsets.end() - 1);
+        for (size_t i = 0; i < lodIndices.size(); i += 3)
+        {
+            std::copy_n(lodIndices.begin() + i, 3, sorted.begin() + fill[triangleSubmeshes[i / 3]]);
+            fill[triangleSubmeshes[i / 3]] += 3;
+        }
+
+        const uint32_t levelOffset = static_cast<uint32_t>(indices.size());
+        for (size_t s = 0; s < submeshCount; s++)
+        {
+            MeshSubmesh submesh = submeshes[s];
+            submesh.indexOffset = levelOffset + submeshOffsets[s];
+            submesh.indexCount = submeshOffsets[s + 1] - submeshOffsets[s];
+            optimizeVertexCache(sorted.data() + submeshOffsets[s], submesh.indexCount, vertices.size());
+            submeshes.push_back(submesh);
+        }
+        lods.push_back({levelOffset, static_cast<uint32_t>(sorted.size()), error, 0});
+        indices.insert(indices.end(), sorted.begin(), sorted.end());
+    }
 
-    extractMeshFromObj(shapes,attrib,indices,vertices);
+    //the full mesh comes first in the index buffer, so the vertices end up in its order
+    vertices.resize(optimizeVertexFetch(vertices.data(), vertices.size(), indices.data(), indices.size()));
+    VertexCacheStats after = analyzeVertexCache(indices.data(), fullIndexCount, vertices.size());
 
 
     MeshInfo info;
-    info.vertexFormat = VertexFormat::PNCV_F32;
-    info.vertexBufferSize = vertices.size() * sizeof(Vertex);
+    info.vertexFormat = options.vertexFormat;
+    info.vertexBufferSize = vertices.size() * vertexFormatSize(info.vertexFormat);
     info.indexBufferSize = indices.size() * sizeof(uint32_t);
     info.indexSize = sizeof(uint32_t);
     info.originalFile = input.string();
     info.bounds = calculateBounds(vertices.data(), vertices.size());
+    //the triangles of a simplified sector can reach past the full detail one, so the bounds cover the submesh in every level
+    std::vector<uint32_t> submeshIndices;
+    for (size_t s = 0; s < submeshCount; s++)
+    {
+        submeshIndices.clear();
+        for (size_t level = s; level < submeshes.size(); level += submeshCount)
+        {
+            submeshIndices.insert(submeshIndices.end(), indices.begin() + submeshes[level].indexOffset, indices.begin() + submeshes[level].indexOffset + submeshes[level].indexCount);
+        }
+        MeshBounds bounds = calculateBounds(vertices.data(), submeshIndices.data(), submeshIndices.size());
+        for (size_t level = s; level < submeshes.size(); level += submeshCount)
+        {
+            submeshes[level].bounds = bounds;
+        }
+    }
+
+    //meshlets are runs of the full detail submeshes, their bounds use the unquantized positions
+    for (size_t s = 0; s < submeshCount; s++)
+    {
+        MeshSubmesh& submesh = submeshes[s];
+        std::vector<Meshlet> meshlets = buildMeshlets(indices.data() + submesh.indexOffset, submesh.indexCount, vertices.data(), vertices.size());
+        for (Meshlet& meshlet : meshlets)
+        {
+            meshlet.indexOffset += submesh.indexOffset;
+        }
+        submesh.firstMeshlet = static_cast<uint32_t>(info.meshlets.size());
+        submesh.meshletCount = static_cast<uint32_t>(meshlets.size());
+        info.meshlets.insert(info.meshlets.end(), meshlets.begin(), meshlets.end());
+    }
+    if (lods.size() > 1)
+    {
+        info.lods = lods;
+    }
+    info.submeshes = submeshes;
+    info.materials = materials;
+
+    //quantized positions are relative to the bounds, so they have to be computed first
+    std::vector<char> vertexData(info.vertexBufferSize);
+    quantizeVertices(vertices.data(), vertices.size(), info.bounds, info.vertexFormat, vertexData.data());
 
     start  = std::chrono::high_resolution_clock::now();
 
-    AssetFile newMesh = packMesh(&info,(char*)vertices.data(),(char*)indices.data());
+    AssetFile newMesh = packMesh(&info,vertexData.data(),(char*)indices.data());
     
     end  = std::chrono::high_resolution_clock::now();
     
     diff = end - start;
 
-    std::cout << "compression took " << std::chrono::duration_cast<std::chrono::milliseconds>(diff).count() << "ms" << std::endl;
+    printMessage(std::cout, "compression took " + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(diff).count()) + "ms");
+
+    size_t assetSize = 16 + newMesh.json.size() + newMesh.binaryBlob.size();
+    std::ostringstream summary;
+    summary << input.filename() << ": " << corners.size() << " -> " << vertices.size() << " vertices, raw "
+        << (corners.size() * sizeof(Vertex) + fullIndexCount * sizeof(uint32_t)) / 1024 << "KB -> "
+        << (info.vertexBufferSize + info.indexBufferSize) / 1024 << "KB, asset " << assetSize / 1024 << "KB, ACMR "
+        << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr
+        << ", " << info.meshlets.size() << " meshlets, " << submeshCount << " submeshes, lods";
+    for (const MeshLod& lod : lods)
+    {
+        summary << " " << lod.indexCount / 3 << " (" << lod.error << ")";
+    }
+    printMessage(std::cout, summary.str());
 
     saveBinaryFile(output.string().c_str(),newMesh);
     return true;
 }
 
+bool convertMaterials(const fs::path& input, const std::vector<char>& data, const fs::path& output)
+{
+    std::vector<ObjMaterial> library;
+    parseMtl(data.data(), data.size(), library);
+
+    std::vector<MaterialInfo> materials(library.size());
+    for (size_t i = 0; i < library.size(); i++)
+    {
+        const ObjMaterial& source = library[i];
+        MaterialInfo& material = materials[i];
+        material.name = source.name;
+        std::copy_n(source.diffuse, 3, material.baseColor);
+        material.baseColor[3] = source.opacity;
+        std::copy_n(source.specular, 3, material.specular);
+        material.shininess = source.shininess;
+        if (!source.alphaTexture.empty())
+        {
+            material.transparency = TransparencyMode::Masked;
+        }
+        else if (source.opacity < 1.f)
+        {
+            material.transparency = TransparencyMode::Transparent;
+        }
+
+        //the textures are baked next to their source, so only the extension changes
+        auto baked_texture = [](const std::string& path){
+            return path.empty() ? path : fs::path(path).replace_extension(".tx").generic_string();
+        };
+        material.diffuseTexture = baked_texture(source.diffuseTexture);
+        material.normalTexture = baked_texture(source.normalTexture);
+        material.alphaTexture = baked_texture(source.alphaTexture);
+    }
+
+    AssetFile file = packMaterials(materials);
+    std::ostringstream summary;
+    summary << input.filename() << ": " << materials.size() << " materials";
+    printMessage(std::cout, summary.str());
+    return saveBinaryFile(output.string().c_str(), file);
+}
+
+//recursive search, skipping the bake cache and other hidden directories
+std::vector<fs::path> findFiles(const fs::path& directory, std::initializer_list<const char*> extensions)
+{
+    std::vector<fs::path> files;
+    for (auto it = fs::recursive_directory_iterator(directory); it != fs::recursive_directory_iterator(); it++)
+    {
+        if (it->is_directory() && it->path().filename().string()[0] == '.')
+        {
+            it.disable_recursion_pending();
+            continue;
+        }
+        if (!it->is_regular_file()) continue;
+
+        for (const char* extension : extensions)
+        {
+            if (it->path().extension() == extension)
+            {
+                files.push_back(it->path());
+                break;
+            }
+        }
+    }
+    return files;
+}
+
+bool benchmarkChunks(const fs::path& input)
+{
+    AssetView file;
+    if (!loadBinaryFile(input.string(), file))
+    {
+        std::cerr << "Failed to load asset " << input << std::endl;
+        return false;
+    }
+
+    uint32_t chunkSize = 0;
+    std::vector<uint32_t> chunks;
+    size_t rawSize = 0;
+    if (memcmp(file.type, "MESH", 4) == 0)
+    {
+        MeshInfo info = readMeshInfo(&file);
+        chunkSize = info.chunkSize;
+        chunks = info.chunks;
+        rawSize = info.vertexBufferSize + info.indexBufferSize;
+    }
+    else
+    {
+        TextureInfo info = readTextureInfo(&file);
+        chunkSize = info.chunkSize;
+        chunks = info.chunks;
+        rawSize = info.textureSize;
+    }
+
+    if (chunks.empty())
+    {
+        std::cerr << input << " is a single block version " << file.version << " asset, rebake it to benchmark chunks" << std::endl;
+        return false;
+    }
+
+    std::cout << input << ": " << rawSize / (1024 * 1024) << "MB in " << chunks.size() << " chunks of " << chunkSize / 1024 << "KB" << std::endl;
+
+    std::vector<char> raw(rawSize);
+    Span<char> destination{raw.data(), raw.size()};
+    const int iterations = 10;
+    const double megabytes = double(rawSize) * iterations / (1024.0 * 1024.0);
+
+    uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (uint32_t threads = 1; ; threads = std::min(threads * 2, maxThreads))
+    {
+        //the calling thread works too, so n threads means n-1 workers
+        ThreadPool pool(threads - 1);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            decompressChunked(file.binaryBlob.data(), file.binaryBlob.size(), chunks, chunkSize, &destination, 1, &pool);
+        }
+        std::chrono::duration<double> decompression = std::chrono::high_resolution_clock::now() - start;
+
+        start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            std::vector<char> blob;
+            compressChunked(raw.data(), raw.size(), chunkSize, blob, &pool);
+        }
+        std::chrono::duration<double> compression = std::chrono::high_resolution_clock::now() - start;
+
+        std::cout << threads << " threads: decompression " << int(megabytes / decompression.count()) << " MB/s, compression " << int(megabytes / compression.count()) << " MB/s" << std::endl;
+
+        if (threads == maxThreads) break;
+    }
+    return true;
+}
+
+bool benchmarkMetadata(const fs::path& input)
+{
+    AssetView file;
+    if (!loadBinaryFile(input.string(), file))
+    {
+        std::cerr << "Failed to load asset " << input << std::endl;
+        return false;
+    }
+
+    const bool isMesh = memcmp(file.type, "MESH", 4) == 0;
+    const size_t headerSize = isMesh ? sizeof(MeshHeader) : sizeof(TextureHeader);
+    if (file.version < BINARY_METADATA_VERSION)
+    {
+        std::cerr << input << " is a version " << file.version << " asset, rebake it to benchmark the binary metadata" << std::endl;
+        return false;
+    }
+
+    //the debug json holds the same metadata as a version 2 asset, so it goes through the old parser
+    AssetView jsonFile = file;
+    jsonFile.version = 2;
+    jsonFile.json = findMetadataSection(file.json, headerSize, "JSON");
+    if (jsonFile.json.empty())
+    {
+        std::cerr << input << " has no debug json section" << std::endl;
+        return false;
+    }
+
+    const int iterations = 100000;
+    auto run = [&](const AssetView& view){
+        size_t checksum = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            if (isMesh)
+            {
+                checksum += readMeshInfo(&view).chunks.size();
+            }
+            else
+            {
+                checksum += readTextureInfo(&view).chunks.size();
+            }
+        }
+        std::chrono::duration<double, std::nano> duration = std::chrono::high_resolution_clock::now() - start;
+        //the checksum keeps the reads from being optimized away
+        return checksum > 0 ? duration.count() / iterations : 0.0;
+    };
+
+    double binary = run(file);
+    double json = run(jsonFile);
+
+    std::cout << input << ": " << file.json.size() << " bytes of metadata, " << jsonFile.json.size() << " bytes of json" << std::endl;
+    std::cout << "binary " << int(binary) << " ns, json " << int(json) << " ns per read" << std::endl;
+    return true;
+}
+
+bool benchmarkObj(const fs::path& input)
+{
+    std::vector<Vertex> reference;
+    std::vector<uint32_t> referenceIndices;
+    double referenceSeconds;
+    {
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+        std::string warn;
+        std::string err;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        if (!tinyobj::LoadObj(&attrib,&shapes,&materials,&warn,&err,input.string().c_str(),input.parent_path().string().c_str()))
+        {
+            std::cerr << err << std::endl;
+            return false;
+        }
+        extractMeshFromObj(shapes,attrib,referenceIndices,reference);
+        referenceSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    std::error_code error;
+    const double megabytes = double(fs::file_size(input, error)) / (1024.0 * 1024.0);
+    std::cout << input << ": " << int(megabytes) << "MB, " << reference.size() / 3 << " triangles" << std::endl;
+    std::cout << "tinyobjloader: " << int(referenceSeconds * 1000) << " ms, " << int(megabytes / referenceSeconds) << " MB/s" << std::endl;
+
+    uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (uint32_t threads = 1; ; threads = std::min(threads * 2, maxThreads))
+    {
+        //the calling thread works too, so n threads means n-1 workers
+        ThreadPool pool(threads - 1);
+
+        ObjFile obj;
+        std::string warn;
+        std::string err;
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        if (!loadObj(input, obj, warn, err, &pool))
+        {
+            std::cerr << err << std::endl;
+            return false;
+        }
+        extractMeshFromObj(obj, indices, vertices, &pool);
+        const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        //the float parsers may round the last digit differently, anything more is a real difference
+        float maxDifference = 0.f;
+        const bool sameCount = vertices.size() == reference.size();
+        for (size_t i = 0; sameCount && i < vertices.size(); i++)
+        {
+            const float* a = vertices[i].position;
+            const float* b = reference[i].position;
+            for (size_t c = 0; c < sizeof(Vertex) / sizeof(float); c++)
+            {
+                maxDifference = std::max(maxDifference, std::abs(a[c] - b[c]));
+            }
+        }
+
+        std::cout << threads << " threads: " << int(seconds * 1000) << " ms, " << int(megabytes / seconds) << " MB/s, " << referenceSeconds / seconds << "x, ";
+        if (sameCount)
+        {
+            std::cout << "max difference " << maxDifference << std::endl;
+        }
+        else
+        {
+            std::cout << vertices.size() << " vertices instead of " << reference.size() << std::endl;
+        }
+
+        if (threads == maxThreads) break;
+    }
+    return true;
+}
+
+bool packArchive(const fs::path& directory, const fs::path& output)
+{
+    std::vector<std::string> paths;
+    std::vector<AssetView> assets;
+
+    //material libraries too, the engine loads them with the meshes of the level
+    for (const fs::path& file : findFiles(directory, {".tx", ".mesh", ".mat"}))
+    {
+        AssetView asset;
+        if (!loadBinaryFile(file.string(), asset))
+        {
+            std::cerr << "Failed to load asset " << file << std::endl;
+            return false;
+        }
+        //paths are stored relative to the directory with forward slashes, so lookups are portable
+        paths.push_back(fs::relative(file, directory).generic_string());
+        assets.push_back(std::move(asset));
+    }
+
+    if (!saveArchive(output.string(), paths, assets))
+    {
+        std::cerr << "Failed to write archive " << output << std::endl;
+        return false;
+    }
+    std::cout << "packed " << assets.size() << " assets in " << output << std::endl;
+    return true;
+}
+
 int main(int argc, char const *argv[])
 {
+    if (argc < 2)
+    {
+        std::cerr << "usage: baker <asset directory> [--cache <directory>] [--weld-epsilon <distance>] [--overdraw] [--vertex-format PNCV_F32|PNV_Q16|PNCV_Q16] [--lods <count>] [--sectors <triangles>] [--mip-filter none|box|kaiser] [--texture-format RGBA8|BC1|BC3|BC4|BC5|BC7] [--texture-quality fast|high] | baker --benchmark <baked asset> | baker --benchmark-metadata <baked asset> | baker --benchmark-obj <obj file> | baker --pack <baked directory> <archive>" << std::endl;
+        return 1;
+    }
+
+    if (std::string(argv[1]) == "--pack")
+    {
+        return argc > 3 && packArchive(argv[2], argv[3]) ? 0 : 1;
+    }
+
+    if (std::string(argv[1]) == "--benchmark")
+    {
+        return argc > 2 && benchmarkChunks(argv[2]) ? 0 : 1;
+    }
+
+    if (std::string(argv[1]) == "--benchmark-metadata")
+    {
+        return argc > 2 && benchmarkMetadata(argv[2]) ? 0 : 1;
+    }
+
+    if (std::string(argv[1]) == "--benchmark-obj")
+    {
+        return argc > 2 && benchmarkObj(argv[2]) ? 0 : 1;
+    }
+
     fs::path directory{argv[1]};
     std::cout << "loading asset directory at " << directory << std::endl;
 
-    for (auto &p : fs::directory_iterator(directory))
+    fs::path cacheDirectory = directory / ".bakecache";
+    BakeOptions options;
+    for (int i = 2; i < argc; i++)
     {
-        std::cout << "File: " << p;
-        if (p.path().extension() == ".png") 
+        std::string argument = argv[i];
+        if (argument == "--cache" && i + 1 < argc)
         {
-            std::cout << "found a texture" << std::endl;
-            auto path = p.path();
-            path.replace_extension(".tx");
-            convertImage(p.path(), path);
+            cacheDirectory = argv[++i];
+        }
+        else if (argument == "--weld-epsilon" && i + 1 < argc)
+        {
+            options.weldEpsilon = std::stof(argv[++i]);
+        }
+        else if (argument == "--lods" && i + 1 < argc)
+        {
+            options.lodCount = std::max(1, std::stoi(argv[++i]));
+        }
+        else if (argument == "--mip-filter" && i + 1 < argc)
+        {
+            std::string filter = argv[++i];
+            if (filter == "none") options.mipFilter = MipFilter::None;
+            else if (filter == "box") options.mipFilter = MipFilter::Box;
+            else if (filter == "kaiser") options.mipFilter = MipFilter::Kaiser;
+            else
+            {
+                std::cerr << "unknown mip filter " << filter << std::endl;
+                return 1;
+            }
+        }
+        else if (argument == "--texture-format" && i + 1 < argc)
+        {
+            std::string format = argv[++i];
+            options.textureFormat = parseTextureFormat(format);
+            if (options.textureFormat == TextureFormat::Unknown)
+            {
+                std::cerr << "unknown texture format " << format << std::endl;
+                return 1;
+            }
         }
+        else if (argument == "--texture-quality" && i + 1 < argc)
+        {
+            std::string quality = argv[++i];
+            if (quality == "fast") options.blockQuality = BlockQuality::Fast;
+            else if (quality == "high") options.blockQuality = BlockQuality::High;
+            else
+            {
+                std::cerr << "unknown texture quality " << quality << std::endl;
+                return 1;
+            }
+        }
+        else if (argument == "--sectors" && i + 1 < argc)
+        {
+            options.sectorTriangles = static_cast<uint32_t>(std::max(0, std::stoi(argv[++i])));
+        }
+        else if (argument == "--overdraw")
+        {
+            options.optimizeOverdraw = true;
+        }
+        else if (argument == "--vertex-format" && i + 1 < argc)
+        {
+            std::string format = argv[++i];
+            if (format == "PNCV_F32") options.vertexFormat = VertexFormat::PNCV_F32;
+            else if (format == "PNV_Q16") options.vertexFormat = VertexFormat::PNV_Q16;
+            else if (format == "PNCV_Q16") options.vertexFormat = VertexFormat::PNCV_Q16;
+            else
+            {
+                std::cerr << "unknown vertex format " << format << std::endl;
+                return 1;
+            }
+        }
+        else
+        {
+            std::cerr << "unknown option " << argument << std::endl;
+            return 1;
+        }
+    }
+
+    BakeCache cache(cacheDirectory);
 
-        if (p.path().extension() == ".obj") 
+    //the biggest files go first, so a huge one doesn't end up alone at the end of the bake
+    std::vector<fs::path> sources = findFiles(directory, {".png", ".obj", ".mtl"});
+    std::vector<uintmax_t> sizes(sources.size());
+    std::vector<size_t> order(sources.size());
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        std::error_code error;
+        sizes[i] = fs::file_size(sources[i], error);
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b){ return sizes[a] > sizes[b]; });
+
+    //the options describe everything that changes the output besides the source bytes
+    const std::string textureOptions = std::string(textureFormatName(options.textureFormat)) + (options.blockQuality == BlockQuality::High ? " high" : " fast")
+        + " LZ4 chunk " + std::to_string(DEFAULT_CHUNK_SIZE) + " mips " + mipFilterName(options.mipFilter);
+    const std::string meshOptions = std::string(vertexFormatName(options.vertexFormat)) + " LZ4 chunk " + std::to_string(DEFAULT_CHUNK_SIZE) + " weld " + std::to_string(options.weldEpsilon)
+        + (options.optimizeOverdraw ? " overdraw" : "") + " lods " + std::to_string(options.lodCount) + " sectors " + std::to_string(options.sectorTriangles);
+    const std::string materialOptions = "materials textures .tx";
+
+    std::atomic<uint32_t> results[4] = {};
+    std::atomic<uint64_t> bakedBytes{0};
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    //one task per source, each one reads, decodes, compresses and writes its own file
+    //so while some tasks wait on the disk the others keep the cores busy
+    //the chunk compression inside a task runs on the same pool
+    ThreadPool::get().parallel_for(order.size(), [&](size_t i){
+        const fs::path& source = sources[order[i]];
+        fs::path path = source;
+        BakeCache::Result result;
+        if (source.extension() == ".png")
+        {
+            path.replace_extension(".tx");
+            result = cache.bake(source, path, textureOptions, [&](const std::vector<char>& data, const fs::path& output){
+                return convertImage(source, data, output, options);
+            });
+        }
+        else if (source.extension() == ".mtl")
+        {
+            path.replace_extension(".mat");
+            result = cache.bake(source, path, materialOptions, [&](const std::vector<char>& data, const fs::path& output){
+                return convertMaterials(source, data, output);
+            });
+        }
+        else
         {
-            std::cout << "found a mesh" << std::endl;
-            auto path = p.path();
             path.replace_extension(".mesh");
-            convertMesh(p.path(), path);
+            //the libraries give the materials and the order of the submeshes, so they are part of the key
+            result = cache.bake(source, path, meshOptions, [&](const std::vector<char>& data, const fs::path& output){
+                return convertMesh(source, data, output, options);
+            }, [&](const std::vector<char>& data){
+                std::vector<fs::path> libraries;
+                for (const std::string& library : findObjLibraries(data.data(), data.size()))
+                {
+                    libraries.push_back(source.parent_path() / library);
+                }
+                return libraries;
+            });
+        }
 
+        results[static_cast<int>(result)]++;
+        if (result == BakeCache::Result::Baked)
+        {
+            bakedBytes += sizes[order[i]];
         }
-        
-        
-    }
-    
 
-    return 0;
+        std::lock_guard<std::mutex> lock(outputMutex);
+        switch (result)
+        {
+        case BakeCache::Result::UpToDate: std::cout << path << " is up to date" << std::endl; break;
+        case BakeCache::Result::Linked: std::cout << path << " linked from the cache" << std::endl; break;
+        case BakeCache::Result::Baked: std::cout << path << " baked" << std::endl; break;
+        case BakeCache::Result::Failed: std::cerr << "Failed to bake " << path << std::endl; break;
+        }
+    });
+
+    std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+    double megabytes = bakedBytes.load() / (1024.0 * 1024.0);
+
+    std::cout << sources.size() << " sources in " << duration.count() << "s on " << ThreadPool::get().workerCount() + 1 << " threads: "
+        << results[static_cast<int>(BakeCache::Result::Baked)] << " baked, "
+        << results[static_cast<int>(BakeCache::Result::Linked)] << " linked, "
+        << results[static_cast<int>(BakeCache::Result::UpToDate)] << " up to date, "
+        << results[static_cast<int>(BakeCache::Result::Failed)] << " failed" << std::endl;
+    std::cout << "baked " << megabytes << "MB of sources at " << megabytes / duration.count() << " MB/s, "
+        << sources.size() / duration.count() << " sources/s" << std::endl;
+
+    return results[static_cast<int>(BakeCache::Result::Failed)] == 0 ? 0 : 1;
 }
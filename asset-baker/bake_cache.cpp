@@ -0,0 +1,90 @@
+#include "bake_cache.h"
+#include <cstdio>
+#include <fstream>
+#include <xxhash.h>
+
+namespace fs = std::filesystem;
+
+BakeCache::BakeCache(const fs::path& directory)
+    : _directory(directory)
+{
+    std::error_code error;
+    fs::create_directories(_directory, error);
+}
+
+uint64_t BakeCache::computeKey(const std::vector<char>& input, const std::string& options)
+{
+    //the version and the options seed the hash of the content
+    std::string settings = std::to_string(BAKER_VERSION) + ";" + options;
+    uint64_t seed = XXH64(settings.data(), settings.size(), 0);
+    return XXH64(input.data(), input.size(), seed);
+}
+
+static bool read_file(const fs::path& path, std::vector<char>& data)
+{
+    std::ifstream infile(path, std::ios::binary | std::ios::ate);
+    if (!infile.is_open()) return false;
+
+    data.resize(static_cast<size_t>(infile.tellg()));
+    infile.seekg(0);
+    infile.read(data.data(), data.size());
+    return !infile.fail();
+}
+
+BakeCache::Result BakeCache::bake(const fs::path& input, const fs::path& output, const std::string& options, const BakeFunction& function,
+    const DependencyFunction& dependencies)
+{
+    std::vector<char> data;
+    if (!read_file(input, data)) return Result::Failed;
+
+    uint64_t key = computeKey(data, options);
+    if (dependencies)
+    {
+        //a missing dependency is hashed as such, so adding it later bakes the source again
+        for (const fs::path& dependency : dependencies(data))
+        {
+            std::vector<char> dependencyData;
+            const char found = read_file(dependency, dependencyData) ? 1 : 0;
+            key = XXH64(&found, 1, key);
+            key = XXH64(dependencyData.data(), dependencyData.size(), key);
+        }
+    }
+
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    fs::path entry = _directory / (name + output.extension().string());
+
+    std::error_code error;
+    bool baked = false;
+    if (fs::exists(entry, error))
+    {
+        if (fs::exists(output, error) && fs::equivalent(entry, output, error)) return Result::UpToDate;
+    }
+    else
+    {
+        //written under a temporary name first, so an interrupted bake never leaves a broken entry
+        fs::path temp = entry;
+        temp += ".tmp" + std::to_string(_tempCounter.fetch_add(1));
+        if (!function(data, temp))
+        {
+            fs::remove(temp, error);
+            return Result::Failed;
+        }
+        fs::rename(temp, entry, error);
+        if (error) return Result::Failed;
+        baked = true;
+    }
+
+    //the output is never written in place, that would also modify the entry it is linked to
+    fs::remove(output, error);
+    error.clear();
+    fs::create_hard_link(entry, output, error);
+    if (error)
+    {
+        //hard links fail across file systems
+        error.clear();
+        fs::copy_file(entry, output, fs::copy_options::overwrite_existing, error);
+        if (error) return Result::Failed;
+    }
+    return baked ? Result::Baked : Result::Linked;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+//bump it whenever the baked output changes for the same input, so old cache entries are not reused
+constexpr uint32_t BAKER_VERSION = 12;
+
+//content addressed store of baked assets, the key of an entry is a hash of the source bytes, the baker version and the options
+//outputs are hard links to the entries, so identical sources are baked once and stored once
+class BakeCache
+{
+public:
+    enum class Result
+    {
+        UpToDate,
+        Linked,
+        Baked,
+        Failed
+    };
+
+    //receives the bytes of the source file and the path it has to write the baked asset to
+    using BakeFunction = std::function<bool(const std::vector<char>& input, const std::filesystem::path& output)>;
+
+    //receives the bytes of the source file and returns the other files the bake reads, like the libraries of an obj
+    using DependencyFunction = std::function<std::vector<std::filesystem::path>(const std::vector<char>& input)>;
+
+    explicit BakeCache(const std::filesystem::path& directory);
+
+    //only calls function when there is no entry for this source and these options yet
+    //the bytes of the dependencies are part of the key too, so editing one of them bakes the source again
+    Result bake(const std::filesystem::path& input, const std::filesystem::path& output, const std::string& options, const BakeFunction& function,
+        const DependencyFunction& dependencies = nullptr);
+
+    static uint64_t computeKey(const std::vector<char>& input, const std::string& options);
+
+    const std::filesystem::path& directory() const { return _directory; }
+
+private:
+    std::filesystem::path _directory;
+    std::atomic<uint32_t> _tempCounter{0};
+};
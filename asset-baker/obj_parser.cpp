@@ -0,0 +1,641 @@
+#include "obj_parser.h"
+#include <asset_loader.h>
+#include <thread_pool.h>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+//pieces smaller than this are not worth a job of their own
+constexpr size_t OBJ_MIN_PIECE_SIZE = 512 * 1024;
+//more pieces than workers, so a piece full of faces doesn't keep one thread busy while the others wait
+constexpr size_t OBJ_PIECES_PER_WORKER = 4;
+
+//what a piece of the file holds, indices are already 0 based
+struct ObjPiece
+{
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<float> texcoords;
+    //corners of the faces as written, faceSizes holds the corner count of every face
+    std::vector<ObjCorner> faceCorners;
+    std::vector<uint32_t> faceSizes;
+    //negative indices are relative to the attributes before them, so they are stored relative to the piece
+    //and listed here as corner * 3 + attribute, to be offset once the attributes of the previous pieces are counted
+    std::vector<uint32_t> relativeIndices;
+    //usemtl lines, as the face they apply from and the name
+    std::vector<std::pair<uint32_t, std::string>> materialChanges;
+    std::vector<std::string> libraries;
+    std::string error;
+
+    //triangulated faces of the piece
+    std::vector<ObjCorner> corners;
+    std::vector<int32_t> triangleMaterials;
+};
+
+static int32_t& corner_attribute(ObjCorner& corner, uint32_t attribute)
+{
+    switch (attribute)
+    {
+    case 0: return corner.position;
+    case 1: return corner.texcoord;
+    default: return corner.normal;
+    }
+}
+
+static inline bool is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char* skip_blanks(const char* p, const char* end)
+{
+    while (p < end && is_blank(*p)) p++;
+    return p;
+}
+
+static inline const char* skip_token(const char* p, const char* end)
+{
+    while (p < end && !is_blank(*p)) p++;
+    return p;
+}
+
+//rest of the line without the blanks around it
+static std::string line_rest(const char* p, const char* end)
+{
+    p = skip_blanks(p, end);
+    while (end > p && is_blank(end[-1])) end--;
+    return std::string(p, end);
+}
+
+static inline bool starts_with(const char* p, const char* end, const char* keyword, size_t length)
+{
+    return size_t(end - p) > length && memcmp(p, keyword, length) == 0 && is_blank(p[length]);
+}
+
+//a value that can't be parsed reads as 0, like tinyobj does
+static inline const char* parse_float(const char* p, const char* end, float& value)
+{
+    p = skip_blanks(p, end);
+    if (p < end && *p == '+') p++;
+    std::from_chars_result result = std::from_chars(p, end, value);
+    if (result.ec != std::errc())
+    {
+        value = 0.f;
+        return skip_token(p, end);
+    }
+    return result.ptr;
+}
+
+static inline void parse_floats(const char* p, const char* end, size_t count, std::vector<float>& values)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        float value;
+        p = parse_float(p, end, value);
+        values.push_back(value);
+    }
+}
+
+//one index of a corner, false when it is 0 or not a number
+static inline bool parse_index(const char*& p, const char* end, int32_t& index)
+{
+    if (p < end && *p == '+') p++;
+    std::from_chars_result result = std::from_chars(p, end, index);
+    p = result.ptr;
+    return result.ec == std::errc() && index != 0;
+}
+
+//a face is a list of v, v/vt, v//vn or v/vt/vn corners
+static bool parse_face(const char* p, const char* end, ObjPiece& piece)
+{
+    const int32_t counts[3] = {
+        static_cast<int32_t>(piece.positions.size() / 3),
+        static_cast<int32_t>(piece.texcoords.size() / 2),
+        static_cast<int32_t>(piece.normals.size() / 3)};
+
+    uint32_t size = 0;
+    while (true)
+    {
+        p = skip_blanks(p, end);
+        if (p == end) break;
+
+        int32_t indices[3] = {0, 0, 0};
+        bool present[3] = {true, false, false};
+        if (!parse_index(p, end, indices[0])) return false;
+        if (p < end && *p == '/')
+        {
+            p++;
+            if (p < end && *p != '/')
+            {
+                if (!parse_index(p, end, indices[1])) return false;
+                present[1] = true;
+            }
+            if (p < end && *p == '/')
+            {
+                p++;
+                if (!parse_index(p, end, indices[2])) return false;
+                present[2] = true;
+            }
+        }
+        if (p < end && !is_blank(*p)) return false;
+
+        ObjCorner corner{-1, -1, -1};
+        for (uint32_t attribute = 0; attribute < 3; attribute++)
+        {
+            if (!present[attribute]) continue;
+            if (indices[attribute] > 0)
+            {
+                corner_attribute(corner, attribute) = indices[attribute] - 1;
+            }
+            else
+            {
+                corner_attribute(corner, attribute) = counts[attribute] + indices[attribute];
+                piece.relativeIndices.push_back(static_cast<uint32_t>(piece.faceCorners.size() * 3 + attribute));
+            }
+        }
+        piece.faceCorners.push_back(corner);
+        size++;
+    }
+    piece.faceSizes.push_back(size);
+    return true;
+}
+
+//names of an mtllib line, a line can list several libraries
+static void parse_libraries(const char* p, const char* end, std::vector<std::string>& libraries)
+{
+    for (const char* name = skip_blanks(p, end); name < end; name = skip_blanks(name, end))
+    {
+        const char* nameEnd = skip_token(name, end);
+        libraries.emplace_back(name, nameEnd);
+        name = nameEnd;
+    }
+}
+
+static void parse_piece(const char* p, const char* end, ObjPiece& piece)
+{
+    while (p < end)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!lineEnd) lineEnd = end;
+
+        const char* line = skip_blanks(p, lineEnd);
+        if (line + 1 < lineEnd)
+        {
+            if (line[0] == 'v' && is_blank(line[1]))
+            {
+                parse_floats(line + 2, lineEnd, 3, piece.positions);
+            }
+            else if (starts_with(line, lineEnd, "vn", 2))
+            {
+                parse_floats(line + 2, lineEnd, 3, piece.normals);
+            }
+            else if (starts_with(line, lineEnd, "vt", 2))
+            {
+                parse_floats(line + 2, lineEnd, 2, piece.texcoords);
+            }
+            else if (line[0] == 'f' && is_blank(line[1]))
+            {
+                if (!parse_face(line + 2, lineEnd, piece))
+                {
+                    piece.error = "failed to parse face: " + line_rest(line, lineEnd);
+                    return;
+                }
+            }
+            else if (starts_with(line, lineEnd, "usemtl", 6))
+            {
+                piece.materialChanges.push_back({static_cast<uint32_t>(piece.faceSizes.size()), line_rest(line + 6, lineEnd)});
+            }
+            else if (starts_with(line, lineEnd, "mtllib", 6))
+            {
+                parse_libraries(line + 6, lineEnd, piece.libraries);
+            }
+        }
+        p = lineEnd + 1;
+    }
+}
+
+//ray crossing test from tinyobj
+static bool point_in_triangle(const float* x, const float* y, float testX, float testY)
+{
+    bool inside = false;
+    for (int i = 0, j = 2; i < 3; j = i++)
+    {
+        if (((y[i] > testY) != (y[j] > testY)) && (testX < (x[j] - x[i]) * (testY - y[i]) / (y[j] - y[i]) + x[i]))
+        {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+//ear clipping in the plane the polygon is the most facing, it is the algorithm of tinyobj so the triangles come out the same
+static void triangulate_face(const ObjCorner* face, uint32_t size, const std::vector<float>& positions, std::vector<ObjCorner>& triangles)
+{
+    if (size < 3)
+    {
+        return;
+    }
+    if (size == 3)
+    {
+        triangles.insert(triangles.end(), face, face + 3);
+        return;
+    }
+
+    const auto valid = [&](const ObjCorner& corner, size_t component){
+        return size_t(corner.position) * 3 + component < positions.size();
+    };
+    const auto coordinate = [&](const ObjCorner& corner, size_t component){
+        return positions[size_t(corner.position) * 3 + component];
+    };
+
+    //the first corner that isn't flat gives the axes of the projection
+    size_t axes[2] = {1, 2};
+    for (uint32_t k = 0; k < size; k++)
+    {
+        const ObjCorner& a = face[k];
+        const ObjCorner& b = face[(k + 1) % size];
+        const ObjCorner& c = face[(k + 2) % size];
+        if (!valid(a, 2) || !valid(b, 2) || !valid(c, 2))
+        {
+            continue;
+        }
+        const float e0[3] = {coordinate(b, 0) - coordinate(a, 0), coordinate(b, 1) - coordinate(a, 1), coordinate(b, 2) - coordinate(a, 2)};
+        const float e1[3] = {coordinate(c, 0) - coordinate(b, 0), coordinate(c, 1) - coordinate(b, 1), coordinate(c, 2) - coordinate(b, 2)};
+        const float cx = std::fabs(e0[1] * e1[2] - e0[2] * e1[1]);
+        const float cy = std::fabs(e0[2] * e1[0] - e0[0] * e1[2]);
+        const float cz = std::fabs(e0[0] * e1[1] - e0[1] * e1[0]);
+        const float epsilon = std::numeric_limits<float>::epsilon();
+        if (cx > epsilon || cy > epsilon || cz > epsilon)
+        {
+            if (!(cx > cy && cx > cz))
+            {
+                axes[0] = 0;
+                if (cz > cx && cz > cy) axes[1] = 1;
+            }
+            break;
+        }
+    }
+
+    //signed area tells the winding, an ear has to turn the same way
+    float area = 0.f;
+    for (uint32_t k = 0; k < size; k++)
+    {
+        const ObjCorner& a = face[k];
+        const ObjCorner& b = face[(k + 1) % size];
+        if (!valid(a, axes[0]) || !valid(a, axes[1]) || !valid(b, axes[0]) || !valid(b, axes[1]))
+        {
+            continue;
+        }
+        area += (coordinate(a, axes[0]) * coordinate(b, axes[1]) - coordinate(a, axes[1]) * coordinate(b, axes[0])) * 0.5f;
+    }
+
+    std::vector<ObjCorner> remaining(face, face + size);
+    size_t guess = 0;
+    size_t remainingIterations = remaining.size();
+    size_t previousRemaining = remaining.size();
+    while (remaining.size() > 3 && remainingIterations > 0)
+    {
+        const size_t count = remaining.size();
+        if (guess >= count)
+        {
+            guess -= count;
+        }
+        //every vertex can be tried once without clipping one, after that the polygon is degenerate
+        if (previousRemaining != count)
+        {
+            previousRemaining = count;
+            remainingIterations = count;
+        }
+        else
+        {
+            remainingIterations--;
+        }
+
+        ObjCorner ear[3];
+        float x[3];
+        float y[3];
+        for (size_t k = 0; k < 3; k++)
+        {
+            ear[k] = remaining[(guess + k) % count];
+            const bool inRange = valid(ear[k], axes[0]) && valid(ear[k], axes[1]);
+            x[k] = inRange ? coordinate(ear[k], axes[0]) : 0.f;
+            y[k] = inRange ? coordinate(ear[k], axes[1]) : 0.f;
+        }
+        const float cross = (x[1] - x[0]) * (y[2] - y[1]) - (y[1] - y[0]) * (x[2] - x[1]);
+        if (cross * area < 0.f)
+        {
+            guess++;
+            continue;
+        }
+
+        bool overlap = false;
+        for (size_t other = 3; other < count && !overlap; other++)
+        {
+            const ObjCorner& corner = remaining[(guess + other) % count];
+            if (!valid(corner, axes[0]) || !valid(corner, axes[1]))
+            {
+                continue;
+            }
+            overlap = point_in_triangle(x, y, coordinate(corner, axes[0]), coordinate(corner, axes[1]));
+        }
+        if (overlap)
+        {
+            guess++;
+            continue;
+        }
+
+        triangles.insert(triangles.end(), ear, ear + 3);
+        remaining.erase(remaining.begin() + (guess + 1) % count);
+    }
+
+    if (remaining.size() == 3)
+    {
+        triangles.insert(triangles.end(), remaining.begin(), remaining.end());
+    }
+}
+
+//splits the text in pieces that end on a line boundary
+static std::vector<std::pair<size_t, size_t>> split_lines(const char* data, size_t size, size_t pieceCount)
+{
+    std::vector<std::pair<size_t, size_t>> pieces;
+    size_t begin = 0;
+    for (size_t i = 1; i <= pieceCount && begin < size; i++)
+    {
+        size_t end = size;
+        if (i < pieceCount)
+        {
+            const size_t target = std::max(begin, size * i / pieceCount);
+            const char* newline = static_cast<const char*>(memchr(data + target, '\n', size - target));
+            end = newline ? size_t(newline - data) + 1 : size;
+        }
+        pieces.push_back({begin, end});
+        begin = end;
+    }
+    return pieces;
+}
+
+//appends one array of every piece to the merged one, each piece copies its part
+template<typename T>
+static void merge_arrays(std::vector<ObjPiece>& pieces, std::vector<T> ObjPiece::* member, std::vector<T>& merged, std::vector<size_t>& offsets, assets::ThreadPool& workers)
+{
+    offsets.assign(pieces.size() + 1, 0);
+    for (size_t i = 0; i < pieces.size(); i++)
+    {
+        offsets[i + 1] = offsets[i] + (pieces[i].*member).size();
+    }
+    merged.resize(offsets.back());
+    workers.parallel_for(pieces.size(), [&](size_t i){
+        std::vector<T>& values = pieces[i].*member;
+        std::copy(values.begin(), values.end(), merged.begin() + offsets[i]);
+        std::vector<T>().swap(values);
+    });
+}
+
+static void load_libraries(const std::vector<ObjPiece>& pieces, const fs::path& baseDirectory, ObjFile& file, std::string& warnings)
+{
+    std::vector<std::string> loaded;
+    for (const ObjPiece& piece : pieces)
+    {
+        for (const std::string& library : piece.libraries)
+        {
+            if (std::find(loaded.begin(), loaded.end(), library) != loaded.end()) continue;
+            loaded.push_back(library);
+
+            std::shared_ptr<assets::MappedFile> mapping = assets::MappedFile::open((baseDirectory / library).string());
+            if (!mapping)
+            {
+                warnings += "material library " + library + " not found\n";
+                continue;
+            }
+            parseMtl(mapping->data(), mapping->size(), file.materials);
+        }
+    }
+}
+
+bool parseObj(const char* data, size_t size, const fs::path& baseDirectory, ObjFile& outFile, std::string& outWarnings, std::string& outError, assets::ThreadPool* pool)
+{
+    assets::ThreadPool& workers = pool ? *pool : assets::ThreadPool::get();
+    outFile = ObjFile{};
+
+    const size_t maxPieces = std::max<size_t>(1, (workers.workerCount() + 1) * OBJ_PIECES_PER_WORKER);
+    const size_t pieceCount = std::max<size_t>(1, std::min(maxPieces, size / OBJ_MIN_PIECE_SIZE));
+    std::vector<std::pair<size_t, size_t>> ranges = split_lines(data, size, pieceCount);
+
+    std::vector<ObjPiece> pieces(ranges.size());
+    workers.parallel_for(pieces.size(), [&](size_t i){
+        parse_piece(data + ranges[i].first, data + ranges[i].second, pieces[i]);
+    });
+    for (const ObjPiece& piece : pieces)
+    {
+        if (!piece.error.empty())
+        {
+            outError = piece.error;
+            return false;
+        }
+    }
+
+    std::vector<size_t> positionOffsets;
+    std::vector<size_t> texcoordOffsets;
+    std::vector<size_t> normalOffsets;
+    merge_arrays(pieces, &ObjPiece::positions, outFile.positions, positionOffsets, workers);
+    merge_arrays(pieces, &ObjPiece::texcoords, outFile.texcoords, texcoordOffsets, workers);
+    merge_arrays(pieces, &ObjPiece::normals, outFile.normals, normalOffsets, workers);
+
+    load_libraries(pieces, baseDirectory, outFile, outWarnings);
+    std::unordered_map<std::string, int32_t> materialIndices;
+    for (size_t i = 0; i < outFile.materials.size(); i++)
+    {
+        materialIndices.emplace(outFile.materials[i].name, static_cast<int32_t>(i));
+    }
+
+    //the material a piece starts with is the last one set by the pieces before it
+    std::vector<int32_t> startMaterials(pieces.size());
+    std::unordered_set<std::string> missingMaterials;
+    int32_t material = -1;
+    for (size_t i = 0; i < pieces.size(); i++)
+    {
+        startMaterials[i] = material;
+        for (const auto& [face, name] : pieces[i].materialChanges)
+        {
+            auto found = materialIndices.find(name);
+            material = found != materialIndices.end() ? found->second : -1;
+            if (found == materialIndices.end() && missingMaterials.insert(name).second)
+            {
+                outWarnings += "material " + name + " not found\n";
+            }
+        }
+    }
+
+    //the positions of every piece are needed to clip the polygons, so they are triangulated after the merge
+    workers.parallel_for(pieces.size(), [&](size_t i){
+        ObjPiece& piece = pieces[i];
+        const size_t bases[3] = {positionOffsets[i] / 3, texcoordOffsets[i] / 2, normalOffsets[i] / 3};
+        for (uint32_t slot : piece.relativeIndices)
+        {
+            corner_attribute(piece.faceCorners[slot / 3], slot % 3) += static_cast<int32_t>(bases[slot % 3]);
+        }
+
+        int32_t faceMaterial = startMaterials[i];
+        size_t nextChange = 0;
+        size_t corner = 0;
+        piece.corners.reserve(piece.faceCorners.size());
+        for (uint32_t face = 0; face < piece.faceSizes.size(); face++)
+        {
+            while (nextChange < piece.materialChanges.size() && piece.materialChanges[nextChange].first == face)
+            {
+                auto found = materialIndices.find(piece.materialChanges[nextChange].second);
+                faceMaterial = found != materialIndices.end() ? found->second : -1;
+                nextChange++;
+            }
+            const size_t first = piece.corners.size();
+            triangulate_face(piece.faceCorners.data() + corner, piece.faceSizes[face], outFile.positions, piece.corners);
+            piece.triangleMaterials.insert(piece.triangleMaterials.end(), (piece.corners.size() - first) / 3, faceMaterial);
+            corner += piece.faceSizes[face];
+        }
+        std::vector<ObjCorner>().swap(piece.faceCorners);
+    });
+
+    std::vector<size_t> cornerOffsets;
+    std::vector<size_t> triangleOffsets;
+    merge_arrays(pieces, &ObjPiece::corners, outFile.corners, cornerOffsets, workers);
+    merge_arrays(pieces, &ObjPiece::triangleMaterials, outFile.triangleMaterials, triangleOffsets, workers);
+    return true;
+}
+
+bool loadObj(const fs::path& path, ObjFile& outFile, std::string& outWarnings, std::string& outError, assets::ThreadPool* pool)
+{
+    std::shared_ptr<assets::MappedFile> mapping = assets::MappedFile::open(path.string());
+    if (!mapping)
+    {
+        outError = "failed to open " + path.string();
+        return false;
+    }
+    return parseObj(mapping->data(), mapping->size(), path.parent_path(), outFile, outWarnings, outError, pool);
+}
+
+std::vector<std::string> findObjLibraries(const char* data, size_t size)
+{
+    std::vector<std::string> libraries;
+    const char* end = data + size;
+    for (const char* p = data; p < end;)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!lineEnd) lineEnd = end;
+
+        const char* line = skip_blanks(p, lineEnd);
+        if (starts_with(line, lineEnd, "mtllib", 6))
+        {
+            parse_libraries(line + 6, lineEnd, libraries);
+        }
+        p = lineEnd + 1;
+    }
+
+    //the parser loads a library once, whatever the number of lines naming it
+    std::vector<std::string> unique;
+    for (std::string& library : libraries)
+    {
+        if (std::find(unique.begin(), unique.end(), library) == unique.end())
+        {
+            unique.push_back(std::move(library));
+        }
+    }
+    return unique;
+}
+
+void parseMtl(const char* data, size_t size, std::vector<ObjMaterial>& materials)
+{
+    const char* p = data;
+    const char* end = data + size;
+    while (p < end)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!lineEnd) lineEnd = end;
+        const char* line = skip_blanks(p, lineEnd);
+        p = lineEnd + 1;
+
+        if (starts_with(line, lineEnd, "newmtl", 6))
+        {
+            materials.emplace_back();
+            materials.back().name = line_rest(line + 6, lineEnd);
+            continue;
+        }
+        //anything before the first newmtl has nothing to apply to
+        if (materials.empty()) continue;
+
+        ObjMaterial& material = materials.back();
+        const auto color = [&](float* values){
+            const char* value = line + 3;
+            for (int i = 0; i < 3; i++) value = parse_float(value, lineEnd, values[i]);
+        };
+        //texture options come before the path, so the path is the last token of the line
+        const auto texture = [&](std::string& path){
+            std::string rest = line_rest(line, lineEnd);
+            size_t separator = rest.find_last_of(" \t");
+            path = separator == std::string::npos ? std::string() : rest.substr(separator + 1);
+        };
+
+        if (starts_with(line, lineEnd, "Ka", 2)) color(material.ambient);
+        else if (starts_with(line, lineEnd, "Kd", 2)) color(material.diffuse);
+        else if (starts_with(line, lineEnd, "Ks", 2)) color(material.specular);
+        else if (starts_with(line, lineEnd, "Ns", 2)) parse_float(line + 2, lineEnd, material.shininess);
+        else if (starts_with(line, lineEnd, "d", 1)) parse_float(line + 1, lineEnd, material.opacity);
+        else if (starts_with(line, lineEnd, "Tr", 2))
+        {
+            float transparency;
+            parse_float(line + 2, lineEnd, transparency);
+            material.opacity = 1.f - transparency;
+        }
+        else if (starts_with(line, lineEnd, "map_Kd", 6)) texture(material.diffuseTexture);
+        else if (starts_with(line, lineEnd, "map_Bump", 8) || starts_with(line, lineEnd, "map_bump", 8) || starts_with(line, lineEnd, "bump", 4) || starts_with(line, lineEnd, "norm", 4))
+        {
+            texture(material.normalTexture);
+        }
+        else if (starts_with(line, lineEnd, "map_d", 5)) texture(material.alphaTexture);
+    }
+}
+
+void extractMeshFromObj(const ObjFile& file, std::vector<uint32_t>& indices, std::vector<assets::Vertex>& vertices, assets::ThreadPool* pool)
+{
+    assets::ThreadPool& workers = pool ? *pool : assets::ThreadPool::get();
+
+    const size_t first = vertices.size();
+    const size_t count = file.corners.size();
+    vertices.resize(first + count);
+    indices.resize(first + count);
+
+    constexpr size_t BLOCK = 64 * 1024;
+    workers.parallel_for((count + BLOCK - 1) / BLOCK, [&](size_t block){
+        const size_t end = std::min(count, (block + 1) * BLOCK);
+        for (size_t i = block * BLOCK; i < end; i++)
+        {
+            const ObjCorner& corner = file.corners[i];
+            assets::Vertex& vertex = vertices[first + i];
+            vertex = {};
+
+            if (corner.position >= 0 && size_t(corner.position) * 3 + 2 < file.positions.size())
+            {
+                std::copy_n(file.positions.data() + size_t(corner.position) * 3, 3, vertex.position);
+            }
+            if (corner.normal >= 0 && size_t(corner.normal) * 3 + 2 < file.normals.size())
+            {
+                std::copy_n(file.normals.data() + size_t(corner.normal) * 3, 3, vertex.normal);
+            }
+            if (corner.texcoord >= 0 && size_t(corner.texcoord) * 2 + 1 < file.texcoords.size())
+            {
+                vertex.uv[0] = file.texcoords[size_t(corner.texcoord) * 2 + 0];
+                vertex.uv[1] = file.texcoords[size_t(corner.texcoord) * 2 + 1];
+            }
+            //the color shows the normal, and v goes down in vulkan
+            std::copy_n(vertex.normal, 3, vertex.color);
+            vertex.uv[1] = 1 - vertex.uv[1];
+
+            indices[first + i] = static_cast<uint32_t>(first + i);
+        }
+    });
+}
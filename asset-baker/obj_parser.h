@@ -0,0 +1,61 @@
+#pragma once
+
+#include <mesh_asset.h>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace assets { class ThreadPool; }
+
+//material of a .mtl library, only the values the engine can make use of
+struct ObjMaterial
+{
+    std::string name;
+    float ambient[3]{0.f, 0.f, 0.f};
+    float diffuse[3]{1.f, 1.f, 1.f};
+    float specular[3]{0.f, 0.f, 0.f};
+    float shininess{0.f};
+    float opacity{1.f};
+    //texture paths as written in the library, relative to it
+    std::string diffuseTexture;
+    std::string normalTexture;
+    std::string alphaTexture;
+};
+
+//attribute indices of a face corner, -1 when the face doesn't have the attribute
+struct ObjCorner
+{
+    int32_t position;
+    int32_t texcoord;
+    int32_t normal;
+};
+
+//obj file with its faces triangulated the same way tinyobj::LoadObj does
+struct ObjFile
+{
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<float> texcoords;
+    //three per triangle, the triangles are in the order of the faces in the file
+    std::vector<ObjCorner> corners;
+    //index in materials of every triangle, -1 before the first usemtl or for names no library defines
+    std::vector<int32_t> triangleMaterials;
+    std::vector<ObjMaterial> materials;
+};
+
+//parses an obj already in memory, the text is split at line boundaries and the pieces are parsed on the pool
+//the mtllib libraries are looked up relative to baseDirectory, a missing one is only a warning
+bool parseObj(const char* data, size_t size, const std::filesystem::path& baseDirectory, ObjFile& outFile, std::string& outWarnings, std::string& outError, assets::ThreadPool* pool = nullptr);
+
+//maps the file and parses it
+bool loadObj(const std::filesystem::path& path, ObjFile& outFile, std::string& outWarnings, std::string& outError, assets::ThreadPool* pool = nullptr);
+
+//mtllib libraries of an obj in the order parseObj loads them, without parsing the rest of the file
+std::vector<std::string> findObjLibraries(const char* data, size_t size);
+
+//appends the materials of a library
+void parseMtl(const char* data, size_t size, std::vector<ObjMaterial>& materials);
+
+//one vertex per triangle corner, the attributes a face doesn't have are 0
+void extractMeshFromObj(const ObjFile& file, std::vector<uint32_t>& indices, std::vector<assets::Vertex>& vertices, assets::ThreadPool* pool = nullptr);
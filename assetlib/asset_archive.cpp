@@ -0,0 +1,173 @@
+#include "asset_archive.h"
+#include <fstream>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <xxhash.h>
+
+//type, version, json length and blob length of every stored asset
+constexpr uint64_t ASSET_HEADER_SIZE = 4 + 3 * sizeof(uint32_t);
+
+static uint64_t align_up(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+uint64_t assets::hashAssetPath(std::string_view path)
+{
+    return XXH64(path.data(), path.size(), 0);
+}
+
+bool assets::saveArchive(const std::string& path, const std::vector<std::string>& assetPaths, const std::vector<AssetView>& assets)
+{
+    if (assetPaths.size() != assets.size()) return false;
+
+    const uint32_t count = static_cast<uint32_t>(assets.size());
+
+    //sort by hash so a lookup is a binary search, ties are sorted by path to keep the output stable
+    std::vector<uint32_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::vector<uint64_t> hashes(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        hashes[i] = hashAssetPath(assetPaths[i]);
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b){
+        if (hashes[a] != hashes[b]) return hashes[a] < hashes[b];
+        return assetPaths[a] < assetPaths[b];
+    });
+
+    std::vector<ArchiveEntry> entries(count);
+    std::string names;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t source = order[i];
+        //the same path twice would make one of them unreachable
+        if (i > 0 && assetPaths[source] == assetPaths[order[i - 1]]) return false;
+
+        entries[i].pathHash = hashes[source];
+        entries[i].size = ASSET_HEADER_SIZE + assets[source].json.size() + assets[source].binaryBlob.size();
+        entries[i].nameOffset = static_cast<uint32_t>(names.size());
+        entries[i].nameLength = static_cast<uint32_t>(assetPaths[source].size());
+        names += assetPaths[source];
+    }
+
+    ArchiveHeader header;
+    memcpy(header.type, "PACK", 4);
+    header.version = 1;
+    header.entryCount = count;
+    header.alignment = ARCHIVE_ALIGNMENT;
+    header.namesSize = names.size();
+
+    //records are laid out in table order, which keeps related paths close on disk
+    uint64_t offset = align_up(sizeof(ArchiveHeader) + count * sizeof(ArchiveEntry) + names.size(), ARCHIVE_ALIGNMENT);
+    for (auto& entry : entries)
+    {
+        entry.offset = offset;
+        offset = align_up(offset + entry.size, ARCHIVE_ALIGNMENT);
+    }
+
+    std::ofstream outfile;
+    outfile.open(path, std::ios::binary | std::ios::out);
+    if (!outfile.is_open()) return false;
+
+    outfile.write((const char*)&header, sizeof(ArchiveHeader));
+    outfile.write((const char*)entries.data(), entries.size() * sizeof(ArchiveEntry));
+    outfile.write(names.data(), names.size());
+
+    const std::vector<char> padding(ARCHIVE_ALIGNMENT, 0);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const AssetView& asset = assets[order[i]];
+
+        uint64_t position = static_cast<uint64_t>(outfile.tellp());
+        outfile.write(padding.data(), entries[i].offset - position);
+
+        uint32_t jsonlength = static_cast<uint32_t>(asset.json.size());
+        uint32_t bloblength = static_cast<uint32_t>(asset.binaryBlob.size());
+        outfile.write(asset.type, 4);
+        outfile.write((const char*)&asset.version, sizeof(uint32_t));
+        outfile.write((const char*)&jsonlength, sizeof(uint32_t));
+        outfile.write((const char*)&bloblength, sizeof(uint32_t));
+        outfile.write(asset.json.data(), jsonlength);
+        outfile.write(asset.binaryBlob.data(), bloblength);
+    }
+
+    outfile.close();
+    return !outfile.fail();
+}
+
+bool assets::AssetArchive::open(const std::string& path)
+{
+    //entries are read in any order, so no sequential read ahead
+    std::shared_ptr<MappedFile> mapping = MappedFile::open(path, false);
+    if (!mapping || mapping->size() < sizeof(ArchiveHeader)) return false;
+
+    ArchiveHeader header;
+    memcpy(&header, mapping->data(), sizeof(ArchiveHeader));
+    if (memcmp(header.type, "PACK", 4) != 0 || header.version != 1) return false;
+
+    uint64_t tableEnd = sizeof(ArchiveHeader) + uint64_t(header.entryCount) * sizeof(ArchiveEntry) + header.namesSize;
+    if (tableEnd > mapping->size()) return false;
+
+    _entries.ptr = reinterpret_cast<const ArchiveEntry*>(mapping->data() + sizeof(ArchiveHeader));
+    _entries.count = header.entryCount;
+    _names = mapping->data() + sizeof(ArchiveHeader) + header.entryCount * sizeof(ArchiveEntry);
+
+    for (const ArchiveEntry& entry : _entries)
+    {
+        if (entry.offset + entry.size > mapping->size() || uint64_t(entry.nameOffset) + entry.nameLength > header.namesSize)
+        {
+            _entries = {};
+            return false;
+        }
+    }
+
+    _mapping = std::move(mapping);
+    _path = path;
+    return true;
+}
+
+const assets::ArchiveEntry* assets::AssetArchive::find(std::string_view path) const
+{
+    uint64_t hash = hashAssetPath(path);
+    const ArchiveEntry* it = std::lower_bound(_entries.begin(), _entries.end(), hash, [](const ArchiveEntry& entry, uint64_t value){
+        return entry.pathHash < value;
+    });
+
+    //compare the paths too, in case two of them share a hash
+    for (; it != _entries.end() && it->pathHash == hash; it++)
+    {
+        if (name(*it) == path) return it;
+    }
+    return nullptr;
+}
+
+std::string_view assets::AssetArchive::name(const ArchiveEntry& entry) const
+{
+    return std::string_view(_names + entry.nameOffset, entry.nameLength);
+}
+
+bool assets::AssetArchive::view(std::string_view path, AssetView& outputView) const
+{
+    const ArchiveEntry* entry = find(path);
+    if (!entry) return false;
+
+    _mapping->prefetch(entry->offset, entry->size);
+    if (!parseBinaryFile(_mapping->data() + entry->offset, entry->size, outputView)) return false;
+
+    outputView.mapping = _mapping;
+    return true;
+}
+
+bool assets::AssetArchive::read(std::string_view path, AssetFile& outputFile) const
+{
+    AssetView view;
+    if (!this->view(path, view)) return false;
+
+    memcpy(outputFile.type, view.type, 4);
+    outputFile.version = view.version;
+    outputFile.json.assign(view.json.begin(), view.json.end());
+    outputFile.binaryBlob.assign(view.binaryBlob.begin(), view.binaryBlob.end());
+    return true;
+}
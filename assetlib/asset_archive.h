@@ -0,0 +1,68 @@
+#pragma once
+
+#include "asset_loader.h"
+
+namespace assets
+{
+    //an archive is a header, a table of contents sorted by path hash, a string table with the paths
+    //and then every asset file stored as is, each one aligned on ARCHIVE_ALIGNMENT
+    constexpr uint32_t ARCHIVE_ALIGNMENT = 4096;
+
+    struct ArchiveHeader
+    {
+        char type[4];
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t alignment;
+        //size of the string table that follows the table of contents
+        uint64_t namesSize;
+    };
+
+    struct ArchiveEntry
+    {
+        uint64_t pathHash;
+        //position and size of the asset file in the archive
+        uint64_t offset;
+        uint64_t size;
+        //position of the path in the string table
+        uint32_t nameOffset;
+        uint32_t nameLength;
+    };
+
+    static_assert(sizeof(ArchiveHeader) == 24 && sizeof(ArchiveEntry) == 32, "archive structs are written as is");
+
+    uint64_t hashAssetPath(std::string_view path);
+
+    //write all the asset files in a single archive, paths are the keys used to find them back
+    bool saveArchive(const std::string& path, const std::vector<std::string>& assetPaths, const std::vector<AssetView>& assets);
+
+    class AssetArchive
+    {
+    public:
+        //maps the archive and validates its table of contents, the entries themselves are not touched
+        bool open(const std::string& path);
+
+        //returns nullptr if there is no asset with this path
+        const ArchiveEntry* find(std::string_view path) const;
+
+        //zero copy view of a single asset, it keeps the archive mapping alive
+        bool view(std::string_view path, AssetView& outputView) const;
+
+        //copy of a single asset, same result as loadBinaryFile on the original file
+        bool read(std::string_view path, AssetFile& outputFile) const;
+
+        std::string_view name(const ArchiveEntry& entry) const;
+
+        Span<const ArchiveEntry> entries() const { return _entries; }
+
+        //entry offsets are relative to the start of this file
+        const std::string& path() const { return _path; }
+
+    private:
+        std::string _path;
+        std::shared_ptr<MappedFile> _mapping;
+        Span<const ArchiveEntry> _entries;
+        const char* _names = nullptr;
+    };
+
+} // namespace assets
@@ -0,0 +1,399 @@
+#include "asset_io.h"
+#include "asset_archive.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <filesystem>
+#include <unordered_map>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+namespace
+{
+    //file handle shared by all the pieces read from it, closed after the last one completes
+    struct OpenFile
+    {
+#ifdef _WIN32
+        HANDLE handle = INVALID_HANDLE_VALUE;
+        ~OpenFile() { if (handle != INVALID_HANDLE_VALUE) CloseHandle(handle); }
+        bool valid() const { return handle != INVALID_HANDLE_VALUE; }
+#else
+        int fd = -1;
+        ~OpenFile() { if (fd >= 0) close(fd); }
+        bool valid() const { return fd >= 0; }
+#endif
+    };
+
+    std::shared_ptr<OpenFile> open_file(const std::string& path)
+    {
+        auto file = std::make_shared<OpenFile>();
+#ifdef _WIN32
+        file->handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+#else
+        file->fd = ::open(path.c_str(), O_RDONLY);
+#endif
+        return file;
+    }
+}
+
+struct assets::AssetIO::Piece
+{
+    std::shared_ptr<OpenFile> file;
+    uint64_t offset;
+    uint32_t size;
+    char* destination;
+    IOHandle batch;
+#ifdef __linux__
+    iovec buffer;
+#endif
+};
+
+#ifdef __linux__
+//raw io_uring rings, liburing is not needed for the few operations used here
+struct assets::AssetIO::Ring
+{
+    int fd = -1;
+    void* sqMap = MAP_FAILED;
+    size_t sqMapSize = 0;
+    void* cqMap = MAP_FAILED;
+    size_t cqMapSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    io_uring_cqe* cqes;
+
+    ~Ring()
+    {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqMap != MAP_FAILED && cqMap != sqMap) munmap(cqMap, cqMapSize);
+        if (sqMap != MAP_FAILED) munmap(sqMap, sqMapSize);
+        if (fd >= 0) close(fd);
+    }
+
+    static std::unique_ptr<Ring> create(uint32_t entries)
+    {
+        io_uring_params params{};
+        int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        //older kernels, seccomp filters and containers commonly refuse io_uring
+        if (fd < 0) return nullptr;
+
+        auto ring = std::make_unique<Ring>();
+        ring->fd = fd;
+
+        ring->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        ring->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMap)
+        {
+            ring->sqMapSize = ring->cqMapSize = std::max(ring->sqMapSize, ring->cqMapSize);
+        }
+
+        ring->sqMap = mmap(nullptr, ring->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (ring->sqMap == MAP_FAILED) return nullptr;
+
+        ring->cqMap = singleMap ? ring->sqMap : mmap(nullptr, ring->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->cqMap == MAP_FAILED) return nullptr;
+
+        ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        ring->sqes = static_cast<io_uring_sqe*>(mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (ring->sqes == MAP_FAILED) return nullptr;
+
+        char* sq = static_cast<char*>(ring->sqMap);
+        ring->sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        ring->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        ring->sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        ring->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        char* cq = static_cast<char*>(ring->cqMap);
+        ring->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        ring->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        ring->cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        ring->cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return ring;
+    }
+};
+#else
+struct assets::AssetIO::Ring
+{
+};
+#endif
+
+bool assets::IOBatch::wait()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _finished.wait(lock, [this](){ return _pending.load() == 0; });
+    return _failed.load() == 0;
+}
+
+void assets::IOBatch::complete(bool success)
+{
+    if (!success) _failed.fetch_add(1);
+    if (_pending.fetch_sub(1) == 1)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _finished.notify_all();
+    }
+}
+
+//reads the whole piece, looping on short reads
+static bool read_blocking(const OpenFile& file, uint64_t offset, uint32_t size, char* destination)
+{
+    while (size > 0)
+    {
+#ifdef _WIN32
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD read = 0;
+        if (!ReadFile(file.handle, destination, size, &read, &overlapped) || read == 0) return false;
+#else
+        ssize_t read = pread(file.fd, destination, size, static_cast<off_t>(offset));
+        if (read < 0 && errno == EINTR) continue;
+        if (read <= 0) return false;
+#endif
+        offset += read;
+        destination += read;
+        size -= static_cast<uint32_t>(read);
+    }
+    return true;
+}
+
+assets::AssetIO::AssetIO(uint32_t queueDepth)
+    : _queueDepth(std::max(1u, queueDepth))
+{
+#ifdef __linux__
+    _ring = Ring::create(_queueDepth);
+#endif
+    if (_ring)
+    {
+        _ringThread = std::thread([this](){ ring_loop(); });
+    }
+    else
+    {
+        //blocking reads only keep as many requests in flight as there are threads
+        _blockingPool = std::make_unique<ThreadPool>(std::min(_queueDepth, std::max(4u, ThreadPool::default_worker_count())));
+    }
+}
+
+assets::AssetIO::~AssetIO()
+{
+    //reads already queued are finished first, their destinations are still owned by the callers
+    if (_ringThread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _condition.notify_all();
+        _ringThread.join();
+    }
+    _blockingPool.reset();
+}
+
+assets::IOHandle assets::AssetIO::submit(const std::vector<ReadRequest>& requests)
+{
+    IOHandle batch = std::make_shared<IOBatch>();
+
+    std::vector<std::unique_ptr<Piece>> pieces;
+    std::unordered_map<std::string, std::shared_ptr<OpenFile>> files;
+    uint32_t failed = 0;
+    for (const ReadRequest& request : requests)
+    {
+        std::shared_ptr<OpenFile>& file = files[request.path];
+        if (!file) file = open_file(request.path);
+        if (!file->valid())
+        {
+            failed++;
+            continue;
+        }
+
+        for (uint64_t done = 0; done < request.size; done += IO_BLOCK_SIZE)
+        {
+            auto piece = std::make_unique<Piece>();
+            piece->file = file;
+            piece->offset = request.offset + done;
+            piece->size = static_cast<uint32_t>(std::min<uint64_t>(IO_BLOCK_SIZE, request.size - done));
+            piece->destination = request.destination + done;
+            piece->batch = batch;
+            pieces.push_back(std::move(piece));
+        }
+    }
+
+    //a missing file counts as one failed read
+    batch->_pending = static_cast<uint32_t>(pieces.size()) + failed;
+    for (uint32_t i = 0; i < failed; i++)
+    {
+        batch->complete(false);
+    }
+
+    queue_pieces(pieces);
+    return batch;
+}
+
+void assets::AssetIO::queue_pieces(std::vector<std::unique_ptr<Piece>>& pieces)
+{
+    if (pieces.empty()) return;
+
+    if (_ring)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (auto& piece : pieces)
+            {
+                _queue.push_back(std::move(piece));
+            }
+        }
+        _condition.notify_one();
+        return;
+    }
+
+    for (auto& piece : pieces)
+    {
+        std::shared_ptr<Piece> job = std::move(piece);
+        _blockingPool->push([job](){
+            job->batch->complete(read_blocking(*job->file, job->offset, job->size, job->destination));
+        });
+    }
+}
+
+void assets::AssetIO::ring_loop()
+{
+#ifdef __linux__
+    Ring& ring = *_ring;
+    uint32_t inFlight = 0;
+    uint32_t unsubmitted = 0;
+
+    while (true)
+    {
+        std::vector<Piece*> ready;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            //with reads in flight the thread sleeps in io_uring_enter instead
+            _condition.wait(lock, [&](){ return _stop || !_queue.empty() || inFlight > 0; });
+            if (_stop && _queue.empty() && inFlight == 0) return;
+
+            while (!_queue.empty() && inFlight + ready.size() < _queueDepth)
+            {
+                ready.push_back(_queue.front().release());
+                _queue.pop_front();
+            }
+        }
+
+        unsigned tail = *ring.sqTail;
+        for (Piece* piece : ready)
+        {
+            unsigned index = tail & ring.sqMask;
+            io_uring_sqe* sqe = &ring.sqes[index];
+            memset(sqe, 0, sizeof(io_uring_sqe));
+
+            piece->buffer.iov_base = piece->destination;
+            piece->buffer.iov_len = piece->size;
+
+            //readv instead of read, it is available since the first io_uring kernels
+            sqe->opcode = IORING_OP_READV;
+            sqe->fd = piece->file->fd;
+            sqe->off = piece->offset;
+            sqe->addr = reinterpret_cast<uint64_t>(&piece->buffer);
+            sqe->len = 1;
+            sqe->user_data = reinterpret_cast<uint64_t>(piece);
+
+            ring.sqArray[index] = index;
+            tail++;
+        }
+        __atomic_store_n(ring.sqTail, tail, __ATOMIC_RELEASE);
+        inFlight += static_cast<uint32_t>(ready.size());
+        unsubmitted += static_cast<uint32_t>(ready.size());
+
+        int submitted = static_cast<int>(syscall(__NR_io_uring_enter, ring.fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+        if (submitted > 0)
+        {
+            unsubmitted -= static_cast<uint32_t>(submitted);
+        }
+
+        std::vector<std::unique_ptr<Piece>> retries;
+        unsigned head = *ring.cqHead;
+        unsigned completed = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        for (; head != completed; head++)
+        {
+            const io_uring_cqe& cqe = ring.cqes[head & ring.cqMask];
+            std::unique_ptr<Piece> piece(reinterpret_cast<Piece*>(cqe.user_data));
+            int result = cqe.res;
+            inFlight--;
+
+            if (result == -EINTR || result == -EAGAIN)
+            {
+                retries.push_back(std::move(piece));
+            }
+            else if (result > 0 && static_cast<uint32_t>(result) < piece->size)
+            {
+                //short read, queue the rest again
+                piece->offset += result;
+                piece->destination += result;
+                piece->size -= static_cast<uint32_t>(result);
+                retries.push_back(std::move(piece));
+            }
+            else
+            {
+                piece->batch->complete(result > 0 && static_cast<uint32_t>(result) == piece->size);
+            }
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+
+        if (!retries.empty())
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (auto it = retries.rbegin(); it != retries.rend(); it++)
+            {
+                _queue.push_front(std::move(*it));
+            }
+        }
+    }
+#endif
+}
+
+assets::IOHandle assets::AssetIO::readFiles(const std::vector<std::string>& paths, std::vector<std::vector<char>>& outputs)
+{
+    outputs.resize(paths.size());
+
+    std::vector<ReadRequest> requests(paths.size());
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        std::error_code error;
+        uintmax_t size = std::filesystem::file_size(paths[i], error);
+        //a missing file is left empty, the open in submit reports it as failed
+        outputs[i].resize(error ? 0 : static_cast<size_t>(size));
+
+        requests[i] = {paths[i], 0, outputs[i].size(), outputs[i].data()};
+    }
+    return submit(requests);
+}
+
+bool assets::archiveReadRequest(const AssetArchive& archive, std::string_view path, char* destination, ReadRequest& outputRequest)
+{
+    const ArchiveEntry* entry = archive.find(path);
+    if (!entry) return false;
+
+    outputRequest = {archive.path(), entry->offset, entry->size, destination};
+    return true;
+}
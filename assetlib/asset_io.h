@@ -0,0 +1,92 @@
+#pragma once
+
+#include "asset_loader.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace assets
+{
+    class AssetArchive;
+
+    //reads are split in blocks of this size, so a single big file still keeps several reads in flight
+    constexpr uint32_t IO_BLOCK_SIZE = 1024 * 1024;
+
+    constexpr uint32_t DEFAULT_QUEUE_DEPTH = 64;
+
+    struct ReadRequest
+    {
+        std::string path;
+        uint64_t offset;
+        uint64_t size;
+        //must stay valid until the batch is done
+        char* destination;
+    };
+
+    //completion state of a batch of reads, can be polled or waited on from any thread
+    class IOBatch
+    {
+    public:
+        bool done() const { return _pending.load() == 0; }
+
+        //blocks until every read of the batch is finished, returns false if any of them failed
+        bool wait();
+
+        uint32_t failedCount() const { return _failed.load(); }
+
+    private:
+        friend class AssetIO;
+        void complete(bool success);
+
+        std::atomic<uint32_t> _pending{0};
+        std::atomic<uint32_t> _failed{0};
+        std::mutex _mutex;
+        std::condition_variable _finished;
+    };
+
+    using IOHandle = std::shared_ptr<IOBatch>;
+
+    //asynchronous file reads, backed by io_uring on linux when the kernel allows it
+    //and by a pool of threads doing blocking reads everywhere else
+    class AssetIO
+    {
+    public:
+        explicit AssetIO(uint32_t queueDepth = DEFAULT_QUEUE_DEPTH);
+        ~AssetIO();
+
+        AssetIO(const AssetIO&) = delete;
+        AssetIO& operator=(const AssetIO&) = delete;
+
+        IOHandle submit(const std::vector<ReadRequest>& requests);
+
+        //reads whole files, outputs are resized to the file sizes before the reads are queued
+        //parseBinaryFile can build views over them once the batch is done
+        IOHandle readFiles(const std::vector<std::string>& paths, std::vector<std::vector<char>>& outputs);
+
+        bool usesIoUring() const { return _ring != nullptr; }
+
+    private:
+        struct Piece;
+        struct Ring;
+
+        void ring_loop();
+        void queue_pieces(std::vector<std::unique_ptr<Piece>>& pieces);
+
+        uint32_t _queueDepth;
+        //null when io_uring is not available, then the reads go to the blocking workers
+        std::unique_ptr<Ring> _ring;
+        std::thread _ringThread;
+        std::unique_ptr<ThreadPool> _blockingPool;
+
+        std::deque<std::unique_ptr<Piece>> _queue;
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        bool _stop{false};
+    };
+
+    //request reading a whole asset file out of an archive, returns false if the archive doesn't contain it
+    bool archiveReadRequest(const AssetArchive& archive, std::string_view path, char* destination, ReadRequest& outputRequest);
+
+} // namespace assets
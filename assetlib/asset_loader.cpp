@@ -1,5 +1,24 @@
 #include "asset_loader.h"
+#include "thread_pool.h"
 #include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <lz4.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//type, version, json length and blob length
+constexpr size_t HEADER_SIZE = 4 + 3 * sizeof(uint32_t);
 
 bool assets::saveBinaryFile(const std::string& path, const assets::AssetFile& file)
 {
@@ -60,6 +79,109 @@ bool assets::loadBinaryFile(const std::string& path, assets::AssetFile& outputFi
     return true;
 }
 
+std::shared_ptr<assets::MappedFile> assets::MappedFile::open(const std::string& path, bool sequential)
+{
+    std::shared_ptr<MappedFile> file(new MappedFile());
+#ifdef _WIN32
+    DWORD flags = sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS;
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) return nullptr;
+    file->_file = handle;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) return nullptr;
+    file->_size = static_cast<size_t>(size.QuadPart);
+
+    file->_mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (file->_mapping == nullptr) return nullptr;
+
+    file->_data = static_cast<const char*>(MapViewOfFile(file->_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (file->_data == nullptr) return nullptr;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    //the mapping stays valid after the descriptor is closed
+    close(fd);
+    if (data == MAP_FAILED) return nullptr;
+
+    //assets are read front to back once, let the kernel read ahead aggressively
+    if (sequential)
+    {
+        madvise(data, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    }
+
+    file->_data = static_cast<const char*>(data);
+    file->_size = static_cast<size_t>(st.st_size);
+#endif
+    return file;
+}
+
+assets::MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+    if (_data) UnmapViewOfFile(_data);
+    if (_mapping) CloseHandle(_mapping);
+    if (_file) CloseHandle(_file);
+#else
+    if (_data) munmap(const_cast<char*>(_data), _size);
+#endif
+}
+
+void assets::MappedFile::prefetch(size_t offset, size_t size) const
+{
+#ifndef _WIN32
+    //madvise needs a page aligned address
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t begin = offset & ~(pageSize - 1);
+    if (begin >= _size) return;
+    size_t end = std::min(offset + size, _size);
+    madvise(const_cast<char*>(_data) + begin, end - begin, MADV_WILLNEED);
+#endif
+}
+
+bool assets::parseBinaryFile(const char* data, size_t size, assets::AssetView& outputView)
+{
+    if (data == nullptr || size < HEADER_SIZE) return false;
+
+    memcpy(outputView.type, data, 4);
+    memcpy(&outputView.version, data + 4, sizeof(uint32_t));
+
+    uint32_t jsonlen = 0;
+    memcpy(&jsonlen, data + 8, sizeof(uint32_t));
+
+    uint32_t bloblen = 0;
+    memcpy(&bloblen, data + 12, sizeof(uint32_t));
+
+    //a truncated file would make the view point past the end of the mapping
+    if (static_cast<uint64_t>(HEADER_SIZE) + jsonlen + bloblen > size) return false;
+
+    outputView.json = std::string_view(data + HEADER_SIZE, jsonlen);
+    outputView.binaryBlob.ptr = data + HEADER_SIZE + jsonlen;
+    outputView.binaryBlob.count = bloblen;
+
+    return true;
+}
+
+bool assets::loadBinaryFile(const std::string& path, assets::AssetView& outputView, bool sequential)
+{
+    std::shared_ptr<MappedFile> mapping = MappedFile::open(path, sequential);
+    if (!mapping) return false;
+
+    if (!parseBinaryFile(mapping->data(), mapping->size(), outputView)) return false;
+
+    outputView.mapping = std::move(mapping);
+    return true;
+}
+
 assets::CompressionMode assets::parse_compression(const std::string& format)
 {
 	if (format == "LZ4")
@@ -69,4 +191,140 @@ assets::CompressionMode assets::parse_compression(const std::string& format)
 	else {
 		return assets::CompressionMode::None;
 	}
-}
\ No newline at end of file
+}
+
+void assets::appendMetadataSection(std::string& metadata, const char* tag, const void* data, size_t size)
+{
+    MetadataSection section;
+    memcpy(section.tag, tag, 4);
+    section.size = static_cast<uint32_t>(size);
+
+    metadata.append((const char*)&section, sizeof(MetadataSection));
+    metadata.append((const char*)data, size);
+    //keep the next section aligned
+    metadata.append((4 - size % 4) % 4, '\0');
+}
+
+std::string_view assets::findMetadataSection(std::string_view metadata, size_t headerSize, const char* tag)
+{
+    size_t offset = headerSize;
+    while (offset + sizeof(MetadataSection) <= metadata.size())
+    {
+        MetadataSection section;
+        memcpy(&section, metadata.data() + offset, sizeof(MetadataSection));
+        offset += sizeof(MetadataSection);
+
+        if (offset + section.size > metadata.size()) break;
+        if (memcmp(section.tag, tag, 4) == 0)
+        {
+            return metadata.substr(offset, section.size);
+        }
+        offset += section.size + (4 - section.size % 4) % 4;
+    }
+    return {};
+}
+
+std::vector<uint32_t> assets::compressChunked(const char* source, size_t sourceSize, uint32_t chunkSize, std::vector<char>& blob, ThreadPool* pool)
+{
+    size_t chunkCount = (sourceSize + chunkSize - 1) / chunkSize;
+    int chunkBound = LZ4_compressBound(static_cast<int>(chunkSize));
+
+    //every chunk gets its own worst case staging area so they can be compressed at the same time
+    std::vector<char> staging(chunkCount * chunkBound);
+    std::vector<uint32_t> chunks(chunkCount);
+
+    ThreadPool& workers = pool ? *pool : ThreadPool::get();
+    workers.parallel_for(chunkCount, [&](size_t i){
+        size_t offset = i * chunkSize;
+        int size = static_cast<int>(std::min<size_t>(chunkSize, sourceSize - offset));
+        chunks[i] = LZ4_compress_default(source + offset, staging.data() + i * chunkBound, size, chunkBound);
+    });
+
+    size_t blobOffset = blob.size();
+    size_t compressedSize = 0;
+    for (uint32_t chunk : chunks)
+    {
+        compressedSize += chunk;
+    }
+    blob.resize(blobOffset + compressedSize);
+
+    for (size_t i = 0; i < chunkCount; i++)
+    {
+        memcpy(blob.data() + blobOffset, staging.data() + i * chunkBound, chunks[i]);
+        blobOffset += chunks[i];
+    }
+    return chunks;
+}
+
+bool assets::decompressChunked(const char* blob, size_t blobSize, const std::vector<uint32_t>& chunks, uint32_t chunkSize, const Span<char>* destinations, size_t destinationCount, ThreadPool* pool)
+{
+    size_t totalSize = 0;
+    for (size_t d = 0; d < destinationCount; d++)
+    {
+        totalSize += destinations[d].size();
+    }
+
+    //the chunks have to cover the destinations exactly, a corrupt table would otherwise leave garbage behind or write past the end
+    if (chunkSize == 0 || chunks.size() != (totalSize + chunkSize - 1) / chunkSize)
+    {
+        return false;
+    }
+
+    //prefix sum of the compressed sizes gives where each chunk starts in the blob
+    std::vector<size_t> chunkOffsets(chunks.size());
+    size_t offset = 0;
+    for (size_t i = 0; i < chunks.size(); i++)
+    {
+        chunkOffsets[i] = offset;
+        offset += chunks[i];
+    }
+    if (offset > blobSize)
+    {
+        return false;
+    }
+
+    std::atomic<bool> valid{true};
+    ThreadPool& workers = pool ? *pool : ThreadPool::get();
+    workers.parallel_for(chunks.size(), [&](size_t i){
+        size_t begin = i * chunkSize;
+        size_t size = std::min<size_t>(chunkSize, totalSize - begin);
+        const char* source = blob + chunkOffsets[i];
+
+        //find the destination the chunk starts in
+        size_t d = 0;
+        size_t destinationBegin = 0;
+        while (destinationBegin + destinations[d].size() <= begin)
+        {
+            destinationBegin += destinations[d].size();
+            d++;
+        }
+
+        size_t local = begin - destinationBegin;
+        if (local + size <= destinations[d].size())
+        {
+            if (LZ4_decompress_safe(source, destinations[d].data() + local, static_cast<int>(chunks[i]), static_cast<int>(size)) != static_cast<int>(size))
+            {
+                valid = false;
+            }
+            return;
+        }
+
+        //only a chunk straddling two destinations goes through a temporary buffer
+        std::vector<char> temp(size);
+        if (LZ4_decompress_safe(source, temp.data(), static_cast<int>(chunks[i]), static_cast<int>(size)) != static_cast<int>(size))
+        {
+            valid = false;
+            return;
+        }
+        size_t copied = 0;
+        while (copied < size)
+        {
+            size_t count = std::min(size - copied, destinations[d].size() - local);
+            memcpy(destinations[d].data() + local, temp.data() + copied, count);
+            copied += count;
+            local = 0;
+            d++;
+        }
+    });
+    return valid;
+}
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 namespace assets
 {
@@ -8,20 +12,122 @@ namespace assets
     {
         char type[4];
         uint32_t version;
+        //metadata, json text up to version 2 and binary from version 3
         std::string json;
         std::vector<char> binaryBlob;
     };
 
+    //non owning view over contiguous memory, std::span is only available from c++20
+    template<typename T>
+    struct Span
+    {
+        T* ptr = nullptr;
+        size_t count = 0;
+
+        T* data() const { return ptr; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        T* begin() const { return ptr; }
+        T* end() const { return ptr + count; }
+        T& operator[](size_t i) const { return ptr[i]; }
+    };
+
+    //read only memory mapping of a whole file, unmapped when the last owner releases it
+    class MappedFile
+    {
+    public:
+        //returns nullptr if the file can't be opened or mapped
+        //sequential files get aggressive read ahead, others are expected to be read in random places
+        static std::shared_ptr<MappedFile> open(const std::string& path, bool sequential = true);
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile();
+
+        const char* data() const { return _data; }
+        size_t size() const { return _size; }
+
+        //hint that a range is about to be read, so the kernel can start loading it
+        void prefetch(size_t offset, size_t size) const;
+
+    private:
+        MappedFile() = default;
+
+        const char* _data = nullptr;
+        size_t _size = 0;
+#ifdef _WIN32
+        void* _file = nullptr;
+        void* _mapping = nullptr;
+#endif
+    };
+
+    //zero copy equivalent of AssetFile, json and blob point directly into the mapped file
+    struct AssetView
+    {
+        char type[4];
+        uint32_t version;
+        std::string_view json;
+        Span<const char> binaryBlob;
+        //keeps the memory of json and binaryBlob alive as long as the view exists
+        std::shared_ptr<MappedFile> mapping;
+    };
+
     enum class CompressionMode : uint32_t
     {
         None,
         LZ4
     };
 
+    //version 2 assets split their payload in chunks of this many bytes, each one compressed independently
+    constexpr uint32_t DEFAULT_CHUNK_SIZE = 256 * 1024;
+
+    //version 3 assets replace the json metadata by a fixed layout struct followed by tagged sections
+    constexpr uint32_t BINARY_METADATA_VERSION = 3;
+
+    struct MetadataSection
+    {
+        char tag[4];
+        //size of the payload that follows, sections start on 4 bytes boundaries
+        uint32_t size;
+    };
+
+    class ThreadPool;
+
     bool saveBinaryFile(const std::string& path, const AssetFile& file);
 
     bool loadBinaryFile(const std::string& path, AssetFile& outputFile);
 
+    //maps the file instead of reading it, the header is validated against the file size
+    //files that are only read in parts should not be sequential, so the kernel doesn't read ahead the whole of them
+    bool loadBinaryFile(const std::string& path, AssetView& outputView, bool sequential = true);
+
+    //builds a view over an asset already in memory, does not take ownership of data
+    bool parseBinaryFile(const char* data, size_t size, AssetView& outputView);
+
     CompressionMode parse_compression(const std::string& format);
-    
+
+    void appendMetadataSection(std::string& metadata, const char* tag, const void* data, size_t size);
+
+    //sections start after the fixed struct of headerSize bytes, returns an empty view if the tag is missing
+    std::string_view findMetadataSection(std::string_view metadata, size_t headerSize, const char* tag);
+
+    template<typename T>
+    std::vector<T> readMetadataArray(std::string_view metadata, size_t headerSize, const char* tag)
+    {
+        std::string_view section = findMetadataSection(metadata, headerSize, tag);
+        std::vector<T> values(section.size() / sizeof(T));
+        if (!values.empty())
+        {
+            memcpy(values.data(), section.data(), values.size() * sizeof(T));
+        }
+        return values;
+    }
+
+    //compress source into lz4 chunks appended to blob, returns the compressed size of every chunk
+    std::vector<uint32_t> compressChunked(const char* source, size_t sourceSize, uint32_t chunkSize, std::vector<char>& blob, ThreadPool* pool = nullptr);
+
+    //decompress all the chunks in parallel, the destinations are filled as if they were one contiguous buffer
+    //false when the chunks don't fit in the blobSize bytes of the blob or don't decompress to exactly the destinations
+    bool decompressChunked(const char* blob, size_t blobSize, const std::vector<uint32_t>& chunks, uint32_t chunkSize, const Span<char>* destinations, size_t destinationCount, ThreadPool* pool = nullptr);
+
 } // namespace assets
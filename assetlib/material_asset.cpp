@@ -0,0 +1,122 @@
+#include <material_asset.h>
+#include <json.hpp>
+#include <algorithm>
+
+//strings are stored once each, null terminated, so a record only needs their offset
+static uint32_t add_string(std::string& strings, const std::string& value)
+{
+    size_t position = 0;
+    while (position < strings.size())
+    {
+        size_t end = strings.find('\0', position);
+        if (strings.compare(position, end - position, value) == 0)
+        {
+            return static_cast<uint32_t>(position);
+        }
+        position = end + 1;
+    }
+    strings.append(value);
+    strings.push_back('\0');
+    return static_cast<uint32_t>(position);
+}
+
+static std::string read_string(std::string_view strings, uint32_t offset)
+{
+    if (offset >= strings.size())
+    {
+        return {};
+    }
+    std::string_view value = strings.substr(offset);
+    return std::string(value.substr(0, value.find('\0')));
+}
+
+std::vector<assets::MaterialInfo> parse_materials(uint32_t version, std::string_view metadata)
+{
+    std::vector<assets::MaterialInfo> materials;
+    if (version < assets::BINARY_METADATA_VERSION || metadata.size() < sizeof(assets::MaterialHeader))
+    {
+        return materials;
+    }
+
+    std::vector<assets::MaterialRecord> records = assets::readMetadataArray<assets::MaterialRecord>(metadata, sizeof(assets::MaterialHeader), "MATS");
+    std::string_view strings = assets::findMetadataSection(metadata, sizeof(assets::MaterialHeader), "STRS");
+    materials.resize(records.size());
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const assets::MaterialRecord& record = records[i];
+        assets::MaterialInfo& material = materials[i];
+        material.name = read_string(strings, record.name);
+        material.diffuseTexture = read_string(strings, record.diffuseTexture);
+        material.normalTexture = read_string(strings, record.normalTexture);
+        material.alphaTexture = read_string(strings, record.alphaTexture);
+        std::copy(record.baseColor, record.baseColor + 4, material.baseColor);
+        std::copy(record.specular, record.specular + 3, material.specular);
+        material.shininess = record.shininess;
+        material.transparency = record.transparency;
+    }
+    return materials;
+}
+
+std::vector<assets::MaterialInfo> assets::readMaterials(AssetFile* file)
+{
+    return parse_materials(file->version, file->json);
+}
+
+std::vector<assets::MaterialInfo> assets::readMaterials(const AssetView* view)
+{
+    return parse_materials(view->version, view->json);
+}
+
+assets::AssetFile assets::packMaterials(const std::vector<MaterialInfo>& materials)
+{
+    AssetFile file;
+    file.type[0] = 'M';
+    file.type[1] = 'A';
+    file.type[2] = 'T';
+    file.type[3] = 'L';
+    file.version = BINARY_METADATA_VERSION;
+
+    nlohmann::json libraryMetadata;
+    //offset 0 is the empty string, for the textures a material doesn't have
+    std::string strings(1, '\0');
+    std::vector<MaterialRecord> records(materials.size());
+    for (size_t i = 0; i < materials.size(); i++)
+    {
+        const MaterialInfo& material = materials[i];
+        MaterialRecord& record = records[i];
+        record = MaterialRecord{};
+        record.name = add_string(strings, material.name);
+        record.diffuseTexture = add_string(strings, material.diffuseTexture);
+        record.normalTexture = add_string(strings, material.normalTexture);
+        record.alphaTexture = add_string(strings, material.alphaTexture);
+        std::copy(material.baseColor, material.baseColor + 4, record.baseColor);
+        std::copy(material.specular, material.specular + 3, record.specular);
+        record.shininess = material.shininess;
+        record.transparency = material.transparency;
+
+        nlohmann::json materialMetadata;
+        materialMetadata["name"] = material.name;
+        materialMetadata["baseColor"] = std::vector<float>(material.baseColor, material.baseColor + 4);
+        materialMetadata["transparency"] = static_cast<uint32_t>(material.transparency);
+        materialMetadata["diffuseTexture"] = material.diffuseTexture;
+        libraryMetadata["materials"].push_back(materialMetadata);
+    }
+
+    MaterialHeader header{};
+    header.materialCount = static_cast<uint32_t>(materials.size());
+
+    file.json.assign((const char*)&header, sizeof(MaterialHeader));
+    appendMetadataSection(file.json, "MATS", records.data(), records.size() * sizeof(MaterialRecord));
+    appendMetadataSection(file.json, "STRS", strings.data(), strings.size());
+
+    //the json is not read, it is only kept so the metadata stays easy to inspect
+    std::string debugJson = libraryMetadata.dump();
+    appendMetadataSection(file.json, "JSON", debugJson.data(), debugJson.size());
+    return file;
+}
+
+const assets::MaterialInfo* assets::findMaterial(const std::vector<MaterialInfo>& materials, const std::string& name)
+{
+    auto it = std::find_if(materials.begin(), materials.end(), [&](const MaterialInfo& material){ return material.name == name; });
+    return it == materials.end() ? nullptr : &*it;
+}
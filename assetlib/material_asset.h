@@ -0,0 +1,63 @@
+#pragma once
+
+#include "asset_loader.h"
+
+namespace assets
+{
+    enum class TransparencyMode : uint32_t
+    {
+        Opaque = 0,
+        //cut out by the alpha texture
+        Masked,
+        //blended with the opacity of the base color
+        Transparent
+    };
+
+    //material of a library, the submeshes of the meshes refer to it by name
+    struct MaterialInfo
+    {
+        std::string name;
+        //rgb and opacity
+        float baseColor[4]{1.f, 1.f, 1.f, 1.f};
+        float specular[3]{0.f, 0.f, 0.f};
+        float shininess{0.f};
+        TransparencyMode transparency{TransparencyMode::Opaque};
+        //baked textures relative to the library, empty when the material has none
+        std::string diffuseTexture;
+        std::string normalTexture;
+        std::string alphaTexture;
+    };
+
+    //fixed part of every material, the strings are offsets in the STRS section
+    struct MaterialRecord
+    {
+        uint32_t name;
+        uint32_t diffuseTexture;
+        uint32_t normalTexture;
+        uint32_t alphaTexture;
+        float baseColor[4];
+        float specular[3];
+        float shininess;
+        TransparencyMode transparency;
+        uint32_t padding[3];
+    };
+
+    static_assert(sizeof(MaterialRecord) == 64, "materials are written as is");
+
+    struct MaterialHeader
+    {
+        uint32_t materialCount;
+        uint32_t reserved;
+    };
+
+    std::vector<MaterialInfo> readMaterials(AssetFile* file);
+
+    std::vector<MaterialInfo> readMaterials(const AssetView* view);
+
+    //a library has no blob, everything is in the metadata
+    AssetFile packMaterials(const std::vector<MaterialInfo>& materials);
+
+    //returns nullptr when the library doesn't define the name
+    const MaterialInfo* findMaterial(const std::vector<MaterialInfo>& materials, const std::string& name);
+
+} // namespace assets
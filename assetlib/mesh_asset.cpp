@@ -1,6 +1,8 @@
 #include <mesh_asset.h>
 #include <json.hpp>
 #include <lz4.h>
+#include <algorithm>
+#include <cmath>
 
 assets::VertexFormat parse_vertex_format(const std::string &format)
 {
@@ -8,21 +10,29 @@ assets::VertexFormat parse_vertex_format(const std::string &format)
     {
         return assets::VertexFormat::PNCV_F32;
     }
+    else if (format == "PNV_Q16")
+    {
+        return assets::VertexFormat::PNV_Q16;
+    }
+    else if (format == "PNCV_Q16")
+    {
+        return assets::VertexFormat::PNCV_Q16;
+    }
     else
     {
         return assets::VertexFormat::Unknown;
     }
 }
 
-assets::MeshInfo assets::readMeshInfo(AssetFile *file)
+assets::MeshInfo parse_mesh_json(std::string_view json)
 {
-    MeshInfo info;
-    nlohmann::json meshMetaData = nlohmann::json::parse(file->json);
+    assets::MeshInfo info;
+    nlohmann::json meshMetaData = nlohmann::json::parse(json.begin(), json.end());
     std::string formatString = meshMetaData["format"];
     info.vertexFormat = parse_vertex_format(formatString);
 
     std::string compressionString = meshMetaData["compression"];
-    info.compressionMode = parse_compression(compressionString);
+    info.compressionMode = assets::parse_compression(compressionString);
     info.vertexBufferSize = meshMetaData["vertexBufferSize"];
     info.indexBufferSize = meshMetaData["indexBufferSize"];
     info.indexSize = (uint8_t)meshMetaData["indexSize"];
@@ -40,23 +50,182 @@ assets::MeshInfo assets::readMeshInfo(AssetFile *file)
     info.bounds.extents[0] = boundsData[4];
     info.bounds.extents[1] = boundsData[5];
     info.bounds.extents[2] = boundsData[6];
+
+    if (meshMetaData.contains("chunks"))
+    {
+        info.chunkSize = meshMetaData["chunkSize"];
+        info.chunks = meshMetaData["chunks"].get<std::vector<uint32_t>>();
+    }
     return info;
 }
 
-void assets::unpackMesh(MeshInfo *info, const char *sourcebuffer, size_t sourceSize, char *vertexBuffer, char *indexBuffer)
+assets::MeshInfo parse_mesh_binary(std::string_view metadata)
+{
+    //a header cut short leaves every size and format at 0, which validateMeshInfo rejects
+    assets::MeshInfo info{};
+    if (metadata.size() < sizeof(assets::MeshHeader))
+    {
+        return info;
+    }
+    assets::MeshHeader header;
+    memcpy(&header, metadata.data(), sizeof(assets::MeshHeader));
+
+    info.vertexBufferSize = header.vertexBufferSize;
+    info.indexBufferSize = header.indexBufferSize;
+    info.bounds = header.bounds;
+    info.vertexFormat = header.vertexFormat;
+    info.indexSize = static_cast<char>(header.indexSize);
+    info.compressionMode = header.compressionMode;
+    info.chunkSize = header.chunkSize;
+    info.chunks = assets::readMetadataArray<uint32_t>(metadata, sizeof(assets::MeshHeader), "CHNK");
+
+    info.meshlets = assets::readMetadataArray<assets::Meshlet>(metadata, sizeof(assets::MeshHeader), "MLET");
+    info.lods = assets::readMetadataArray<assets::MeshLod>(metadata, sizeof(assets::MeshHeader), "LODS");
+    info.submeshes = assets::readMetadataArray<assets::MeshSubmesh>(metadata, sizeof(assets::MeshHeader), "SUBM");
+    std::string_view originalFile = assets::findMetadataSection(metadata, sizeof(assets::MeshHeader), "FILE");
+    info.originalFile.assign(originalFile.begin(), originalFile.end());
+
+    //material names are null terminated one after the other
+    std::string_view materials = assets::findMetadataSection(metadata, sizeof(assets::MeshHeader), "MATN");
+    while (!materials.empty())
+    {
+        size_t end = std::min(materials.find('\0'), materials.size());
+        info.materials.emplace_back(materials.substr(0, end));
+        materials.remove_prefix(std::min(end + 1, materials.size()));
+    }
+    return info;
+}
+
+assets::MeshInfo parse_mesh_info(uint32_t version, std::string_view metadata)
+{
+    if (version >= assets::BINARY_METADATA_VERSION)
+    {
+        return parse_mesh_binary(metadata);
+    }
+    return parse_mesh_json(metadata);
+}
+
+assets::MeshInfo assets::readMeshInfo(AssetFile *file)
+{
+    return parse_mesh_info(file->version, file->json);
+}
+
+assets::MeshInfo assets::readMeshInfo(const AssetView *view)
+{
+    return parse_mesh_info(view->version, view->json);
+}
+
+bool assets::validateMeshInfo(const MeshInfo *info, size_t blobSize)
+{
+    const size_t vertexSize = vertexFormatSize(info->vertexFormat);
+    const size_t indexSize = static_cast<size_t>(info->indexSize);
+    if (vertexSize == 0 || (indexSize != sizeof(uint16_t) && indexSize != sizeof(uint32_t))
+        || info->vertexBufferSize % vertexSize != 0 || info->indexBufferSize % indexSize != 0)
+    {
+        return false;
+    }
+
+    //the chunks are checked against the buffers when they are decompressed, a raw blob has to hold them whole
+    const uint64_t fullSize = info->vertexBufferSize + info->indexBufferSize;
+    uint64_t compressedSize = 0;
+    for (uint32_t chunk : info->chunks)
+    {
+        compressedSize += chunk;
+    }
+    if (compressedSize > blobSize || (info->chunks.empty() && info->compressionMode != CompressionMode::LZ4 && fullSize > blobSize))
+    {
+        return false;
+    }
+
+    const uint64_t indexCount = info->indexBufferSize / indexSize;
+    //the culling shader copies the triangles of the meshlets from the index buffer without any check
+    for (const Meshlet& meshlet : info->meshlets)
+    {
+        if (uint64_t(meshlet.indexOffset) + uint64_t(meshlet.triangleCount) * 3 > indexCount || meshlet.vertexCount > info->vertexBufferSize / vertexSize)
+        {
+            return false;
+        }
+    }
+    for (const MeshLod& lod : info->lods)
+    {
+        if (uint64_t(lod.indexOffset) + lod.indexCount > indexCount)
+        {
+            return false;
+        }
+    }
+
+    //every level has the same number of submeshes, each one inside its level and its meshlets inside the meshlet table
+    const size_t levelCount = std::max<size_t>(info->lods.size(), 1);
+    if (info->submeshes.size() % levelCount != 0)
+    {
+        return false;
+    }
+    const size_t perLod = submeshesPerLod(*info);
+    for (size_t i = 0; i < info->submeshes.size(); i++)
+    {
+        const MeshSubmesh& submesh = info->submeshes[i];
+        const uint64_t levelBegin = info->lods.empty() ? 0 : info->lods[i / perLod].indexOffset;
+        const uint64_t levelEnd = info->lods.empty() ? indexCount : levelBegin + info->lods[i / perLod].indexCount;
+        if (submesh.indexOffset < levelBegin || uint64_t(submesh.indexOffset) + submesh.indexCount > levelEnd
+            || uint64_t(submesh.firstMeshlet) + submesh.meshletCount > info->meshlets.size())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool assets::unpackMesh(MeshInfo *info, const char *sourcebuffer, size_t sourceSize, char *destination)
 {
+    size_t fullSize = info->vertexBufferSize + info->indexBufferSize;
+    if (!info->chunks.empty())
+    {
+        Span<char> region{destination, fullSize};
+        return decompressChunked(sourcebuffer, sourceSize, info->chunks, info->chunkSize, &region, 1);
+    }
+    else if (info->compressionMode == CompressionMode::LZ4)
+    {
+        return LZ4_decompress_safe(sourcebuffer, destination, static_cast<int>(sourceSize), static_cast<int>(fullSize)) == static_cast<int>(fullSize);
+    }
+    else
+    {
+        if (sourceSize < fullSize) return false;
+        memcpy(destination, sourcebuffer, fullSize);
+        return true;
+    }
+}
+
+bool assets::unpackMesh(MeshInfo *info, const char *sourcebuffer, size_t sourceSize, char *vertexBuffer, char *indexBuffer)
+{
+    // the blob holds the vertices followed by the indices
+    // so contiguous destinations can be decompressed in place
+    if (info->indexBufferSize == 0 || vertexBuffer + info->vertexBufferSize == indexBuffer)
+    {
+        return unpackMesh(info, sourcebuffer, sourceSize, vertexBuffer);
+    }
+
+    // chunks are decompressed straight into the right destination, except the one on the boundary
+    if (!info->chunks.empty())
+    {
+        Span<char> regions[2] = {{vertexBuffer, info->vertexBufferSize}, {indexBuffer, info->indexBufferSize}};
+        return decompressChunked(sourcebuffer, sourceSize, info->chunks, info->chunkSize, regions, 2);
+    }
+
     // decompressing into temporal vector
-    // should try to do streaming decompression directly in the buffers
     std::vector<char> decompressedBuffer;
     decompressedBuffer.resize(info->vertexBufferSize + info->indexBufferSize);
 
-    LZ4_decompress_safe(sourcebuffer, decompressedBuffer.data(), static_cast<int>(sourceSize), static_cast<int>(decompressedBuffer.size()));
+    if (!unpackMesh(info, sourcebuffer, sourceSize, decompressedBuffer.data()))
+    {
+        return false;
+    }
 
     // copy vertex buffer
     memcpy(vertexBuffer, decompressedBuffer.data(), info->vertexBufferSize);
 
     // copy index buffer
     memcpy(indexBuffer, decompressedBuffer.data() + info->vertexBufferSize, info->indexBufferSize);
+    return true;
 }
 
 assets::AssetFile assets::packMesh(MeshInfo *info, char *vertexBuffer, char *indexBuffer)
@@ -66,6 +235,14 @@ assets::AssetFile assets::packMesh(MeshInfo *info, char *vertexBuffer, char *ind
     {
         meshMetadata["format"] = "PNCV_F32";
     }
+    else if (info->vertexFormat == VertexFormat::PNV_Q16)
+    {
+        meshMetadata["format"] = "PNV_Q16";
+    }
+    else if (info->vertexFormat == VertexFormat::PNCV_Q16)
+    {
+        meshMetadata["format"] = "PNCV_Q16";
+    }
     meshMetadata["vertexBufferSize"] = info->vertexBufferSize;
     meshMetadata["indexBufferSize"] = info->indexBufferSize;
     meshMetadata["indexSize"] = info->indexSize;
@@ -87,7 +264,7 @@ assets::AssetFile assets::packMesh(MeshInfo *info, char *vertexBuffer, char *ind
     file.type[1] = 'E';
     file.type[2] = 'S';
     file.type[3] = 'H';
-    file.version = 1;
+    file.version = BINARY_METADATA_VERSION;
 
     size_t fullSize = info->vertexBufferSize + info->indexBufferSize;
 
@@ -100,38 +277,76 @@ assets::AssetFile assets::packMesh(MeshInfo *info, char *vertexBuffer, char *ind
     // copy index buffer
     memcpy(mergedBuffer.data() + info->vertexBufferSize, indexBuffer, info->indexBufferSize);
 
-    // compress buffer into blob
-    // set buffer size to maximum worst case compression size
-    int compressStaging = LZ4_compressBound(static_cast<int>(fullSize));
-    file.binaryBlob.resize(compressStaging);
-
-    // set size to actual compressed data
-    int compressedSize = LZ4_compress_default(mergedBuffer.data(), file.binaryBlob.data(), static_cast<int>(mergedBuffer.size()), static_cast<int>(compressStaging));
-    file.binaryBlob.resize(compressedSize);
+    // compress buffer into blob, chunk by chunk so it can be decompressed in parallel
+    info->chunkSize = DEFAULT_CHUNK_SIZE;
+    info->chunks = compressChunked(mergedBuffer.data(), fullSize, info->chunkSize, file.binaryBlob);
 
     meshMetadata["compression"] = "LZ4";
+    meshMetadata["chunkSize"] = info->chunkSize;
+    meshMetadata["chunks"] = info->chunks;
+    meshMetadata["meshletCount"] = info->meshlets.size();
+    meshMetadata["lodCount"] = info->lods.size();
+    meshMetadata["submeshCount"] = info->submeshes.size();
+    meshMetadata["materials"] = info->materials;
+
+    MeshHeader header{};
+    header.vertexBufferSize = info->vertexBufferSize;
+    header.indexBufferSize = info->indexBufferSize;
+    header.bounds = info->bounds;
+    header.vertexFormat = info->vertexFormat;
+    header.indexSize = static_cast<uint32_t>(info->indexSize);
+    header.compressionMode = CompressionMode::LZ4;
+    header.chunkSize = info->chunkSize;
+
+    file.json.assign((const char*)&header, sizeof(MeshHeader));
+    appendMetadataSection(file.json, "CHNK", info->chunks.data(), info->chunks.size() * sizeof(uint32_t));
+    appendMetadataSection(file.json, "FILE", info->originalFile.data(), info->originalFile.size());
+    if (!info->meshlets.empty())
+    {
+        appendMetadataSection(file.json, "MLET", info->meshlets.data(), info->meshlets.size() * sizeof(Meshlet));
+    }
+    if (!info->lods.empty())
+    {
+        appendMetadataSection(file.json, "LODS", info->lods.data(), info->lods.size() * sizeof(MeshLod));
+    }
+    if (!info->submeshes.empty())
+    {
+        std::string materials;
+        for (const std::string& material : info->materials)
+        {
+            materials.append(material);
+            materials.push_back('\0');
+        }
+        appendMetadataSection(file.json, "SUBM", info->submeshes.data(), info->submeshes.size() * sizeof(MeshSubmesh));
+        appendMetadataSection(file.json, "MATN", materials.data(), materials.size());
+    }
 
-    file.json = meshMetadata.dump();
+    // the json is not read anymore, it is only kept so the metadata stays easy to inspect
+    std::string debugJson = meshMetadata.dump();
+    appendMetadataSection(file.json, "JSON", debugJson.data(), debugJson.size());
 
     return file;
 }
 
-assets::MeshBounds assets::calculateBounds(Vertex *vertices, size_t count)
+//position(i) returns the position of the i-th vertex of the set
+template<typename F>
+static assets::MeshBounds calculate_bounds(size_t count, F position)
 {
-    MeshBounds bounds;
+    assets::MeshBounds bounds;
 
     float min[3] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
-    float max[3] = {std::numeric_limits<float>::min(), std::numeric_limits<float>::min(), std::numeric_limits<float>::min()};
+    float max[3] = {std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
 
     for (size_t i = 0; i < count; i++)
     {
-        min[0] = std::min(min[0], vertices[i].position[0]);
-        min[1] = std::min(min[1], vertices[i].position[1]);
-        min[2] = std::min(min[2], vertices[i].position[2]);
-
-        max[0] = std::max(max[0], vertices[i].position[0]);
-        max[1] = std::max(max[1], vertices[i].position[1]);
-        max[2] = std::max(max[2], vertices[i].position[2]);
+        const float* p = position(i);
+        min[0] = std::min(min[0], p[0]);
+        min[1] = std::min(min[1], p[1]);
+        min[2] = std::min(min[2], p[2]);
+
+        max[0] = std::max(max[0], p[0]);
+        max[1] = std::max(max[1], p[1]);
+        max[2] = std::max(max[2], p[2]);
     }
 
     bounds.extents[0] = (max[0] - min[0]) / 2.0f;
@@ -144,12 +359,13 @@ assets::MeshBounds assets::calculateBounds(Vertex *vertices, size_t count)
 
     // go through the vertices again to calculate the exact bounding sphere radius
     float r2 = 0;
-    for (int i = 0; i < count; i++)
+    for (size_t i = 0; i < count; i++)
     {
+        const float* p = position(i);
         float offset[3];
-        offset[0] = vertices[i].position[0] - bounds.origin[0];
-        offset[1] = vertices[i].position[1] - bounds.origin[1];
-        offset[2] = vertices[i].position[2] - bounds.origin[2];
+        offset[0] = p[0] - bounds.origin[0];
+        offset[1] = p[1] - bounds.origin[1];
+        offset[2] = p[2] - bounds.origin[2];
 
         // pithagoras
         float distance = offset[0] * offset[0] + offset[1] * offset[1] + offset[2] * offset[2];
@@ -159,4 +375,237 @@ assets::MeshBounds assets::calculateBounds(Vertex *vertices, size_t count)
     bounds.radius = std::sqrt(r2);
 
     return bounds;
-}
\ No newline at end of file
+}
+
+assets::MeshBounds assets::calculateBounds(Vertex *vertices, size_t count)
+{
+    return calculate_bounds(count, [&](size_t i){ return vertices[i].position; });
+}
+
+assets::MeshBounds assets::calculateBounds(const Vertex* vertices, const uint32_t* indices, size_t indexCount)
+{
+    //shared vertices are visited once per triangle, which doesn't change the result
+    return calculate_bounds(indexCount, [&](size_t i){ return vertices[indices[i]].position; });
+}
+
+size_t assets::submeshesPerLod(const MeshInfo& info)
+{
+    return info.submeshes.size() / std::max<size_t>(info.lods.size(), 1);
+}
+
+size_t assets::vertexFormatSize(VertexFormat format)
+{
+    switch (format)
+    {
+    case VertexFormat::PNCV_F32: return sizeof(Vertex);
+    case VertexFormat::PNV_Q16: return sizeof(Vertex_PNV_Q16);
+    case VertexFormat::PNCV_Q16: return sizeof(Vertex_PNCV_Q16);
+    default: return 0;
+    }
+}
+
+static uint16_t float_to_half(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(float));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (exponent <= 0)
+    {
+        //too small even for a denormal
+        if (exponent < -10) return static_cast<uint16_t>(sign);
+        mantissa |= 0x800000;
+        uint32_t shift = static_cast<uint32_t>(14 - exponent);
+        uint32_t half = mantissa >> shift;
+        //round to nearest
+        if ((mantissa >> (shift - 1)) & 1) half++;
+        return static_cast<uint16_t>(sign | half);
+    }
+    if (exponent >= 31)
+    {
+        //inf and nan both end up as inf, uvs never need them
+        return static_cast<uint16_t>(sign | 0x7c00);
+    }
+
+    uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    //round to nearest, a carry into the exponent is still correct
+    if (mantissa & 0x1000) half++;
+    return static_cast<uint16_t>(half);
+}
+
+static float half_to_float(uint16_t value)
+{
+    uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+
+    uint32_t bits;
+    if (exponent == 0)
+    {
+        //denormals are exact as floats
+        float result = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -result : result;
+    }
+    else if (exponent == 31)
+    {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else
+    {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float result;
+    memcpy(&result, &bits, sizeof(float));
+    return result;
+}
+
+static uint16_t quantize_unorm16(float value)
+{
+    value = std::min(std::max(value, 0.f), 1.f);
+    return static_cast<uint16_t>(value * 65535.f + 0.5f);
+}
+
+static int8_t quantize_snorm8(float value)
+{
+    value = std::min(std::max(value, -1.f), 1.f);
+    return static_cast<int8_t>(std::lround(value * 127.f));
+}
+
+//octahedral mapping, the unit sphere is projected on an octahedron which is then unfolded on a square
+static void encode_octahedral(const float* normal, int8_t* encoded)
+{
+    float length = std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]);
+    float x = length > 0 ? normal[0] / length : 0.f;
+    float y = length > 0 ? normal[1] / length : 0.f;
+    if (normal[2] < 0)
+    {
+        float foldedX = (1.f - std::abs(y)) * (x >= 0 ? 1.f : -1.f);
+        float foldedY = (1.f - std::abs(x)) * (y >= 0 ? 1.f : -1.f);
+        x = foldedX;
+        y = foldedY;
+    }
+    encoded[0] = quantize_snorm8(x);
+    encoded[1] = quantize_snorm8(y);
+}
+
+static void decode_octahedral(const int8_t* encoded, float* normal)
+{
+    float x = std::max(encoded[0] / 127.f, -1.f);
+    float y = std::max(encoded[1] / 127.f, -1.f);
+    float z = 1.f - std::abs(x) - std::abs(y);
+    float t = std::max(-z, 0.f);
+    x += x >= 0 ? -t : t;
+    y += y >= 0 ? -t : t;
+
+    float length = std::sqrt(x * x + y * y + z * z);
+    normal[0] = x / length;
+    normal[1] = y / length;
+    normal[2] = z / length;
+}
+
+template<typename T>
+static void quantize_common(const assets::Vertex& vertex, const float* boxMin, const float* boxScale, T& quantized)
+{
+    for (int k = 0; k < 3; k++)
+    {
+        quantized.position[k] = quantize_unorm16((vertex.position[k] - boxMin[k]) * boxScale[k]);
+    }
+    quantized.position[3] = 0;
+    encode_octahedral(vertex.normal, quantized.normal);
+    quantized.padding = 0;
+    quantized.uv[0] = float_to_half(vertex.uv[0]);
+    quantized.uv[1] = float_to_half(vertex.uv[1]);
+}
+
+template<typename T>
+static void dequantize_common(const T& quantized, const float* boxMin, const float* boxSize, assets::Vertex& vertex)
+{
+    for (int k = 0; k < 3; k++)
+    {
+        vertex.position[k] = boxMin[k] + quantized.position[k] / 65535.f * boxSize[k];
+    }
+    decode_octahedral(quantized.normal, vertex.normal);
+    vertex.uv[0] = half_to_float(quantized.uv[0]);
+    vertex.uv[1] = half_to_float(quantized.uv[1]);
+}
+
+void assets::quantizeVertices(const Vertex* vertices, size_t count, const MeshBounds& bounds, VertexFormat format, char* destination)
+{
+    if (format == VertexFormat::PNCV_F32)
+    {
+        memcpy(destination, vertices, count * sizeof(Vertex));
+        return;
+    }
+
+    float boxMin[3];
+    float boxScale[3];
+    for (int k = 0; k < 3; k++)
+    {
+        boxMin[k] = bounds.origin[k] - bounds.extents[k];
+        boxScale[k] = bounds.extents[k] > 0 ? 1.f / (2.f * bounds.extents[k]) : 0.f;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (format == VertexFormat::PNV_Q16)
+        {
+            Vertex_PNV_Q16 quantized;
+            quantize_common(vertices[i], boxMin, boxScale, quantized);
+            memcpy(destination + i * sizeof(Vertex_PNV_Q16), &quantized, sizeof(Vertex_PNV_Q16));
+        }
+        else if (format == VertexFormat::PNCV_Q16)
+        {
+            Vertex_PNCV_Q16 quantized;
+            quantize_common(vertices[i], boxMin, boxScale, quantized);
+            for (int k = 0; k < 3; k++)
+            {
+                quantized.color[k] = quantize_snorm8(vertices[i].color[k]);
+            }
+            quantized.color[3] = 127;
+            memcpy(destination + i * sizeof(Vertex_PNCV_Q16), &quantized, sizeof(Vertex_PNCV_Q16));
+        }
+    }
+}
+
+void assets::dequantizeVertices(const char* source, size_t count, const MeshBounds& bounds, VertexFormat format, Vertex* destination)
+{
+    if (format == VertexFormat::PNCV_F32)
+    {
+        memcpy(destination, source, count * sizeof(Vertex));
+        return;
+    }
+
+    float boxMin[3];
+    float boxSize[3];
+    for (int k = 0; k < 3; k++)
+    {
+        boxMin[k] = bounds.origin[k] - bounds.extents[k];
+        boxSize[k] = 2.f * bounds.extents[k];
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        Vertex& vertex = destination[i];
+        if (format == VertexFormat::PNV_Q16)
+        {
+            Vertex_PNV_Q16 quantized;
+            memcpy(&quantized, source + i * sizeof(Vertex_PNV_Q16), sizeof(Vertex_PNV_Q16));
+            dequantize_common(quantized, boxMin, boxSize, vertex);
+            memcpy(vertex.color, vertex.normal, sizeof(vertex.color));
+        }
+        else if (format == VertexFormat::PNCV_Q16)
+        {
+            Vertex_PNCV_Q16 quantized;
+            memcpy(&quantized, source + i * sizeof(Vertex_PNCV_Q16), sizeof(Vertex_PNCV_Q16));
+            dequantize_common(quantized, boxMin, boxSize, vertex);
+            for (int k = 0; k < 3; k++)
+            {
+                vertex.color[k] = std::max(quantized.color[k] / 127.f, -1.f);
+            }
+        }
+    }
+}
@@ -17,9 +17,34 @@ namespace assets
 	enum class VertexFormat : uint32_t
 	{
 		Unknown = 0,
-		PNCV_F32
+		PNCV_F32,
+		//quantized positions, normals and uvs, the color is the normal like in every baked mesh
+		PNV_Q16,
+		//same with an snorm8 color, the baked colors are normals so they need the negative half
+		PNCV_Q16
 	};
 
+    //positions are 16 bit unorm inside the mesh bounds box, w is padding
+    //normals are octahedral encoded snorm8 and uvs half floats, so uvs outside [0,1] still work
+    struct Vertex_PNV_Q16
+    {
+        uint16_t position[4];
+        int8_t normal[2];
+        uint16_t padding;
+        uint16_t uv[2];
+    };
+
+    struct Vertex_PNCV_Q16
+    {
+        uint16_t position[4];
+        int8_t normal[2];
+        uint16_t padding;
+        uint16_t uv[2];
+        int8_t color[4];
+    };
+
+    static_assert(sizeof(Vertex_PNV_Q16) == 16 && sizeof(Vertex_PNCV_Q16) == 20, "vertex formats are read as is by the gpu");
+
     struct MeshBounds
     {
         float origin[3];
@@ -28,6 +53,56 @@ namespace assets
     };
     
 
+    //group of triangles that are contiguous in the index buffer, culled as a whole at runtime
+    //the layout matches the std430 struct of the culling shader
+    struct Meshlet
+    {
+        //bounding sphere of the meshlet vertices
+        float center[3];
+        float radius;
+        //the meshlet faces away from any camera position inside the cone of apex, axis and cutoff
+        //cutoff is the sine of the cone half angle, 1 when the normals are too spread to ever be culled
+        float coneApex[3];
+        float coneCutoff;
+        float coneAxis[3];
+        uint32_t triangleCount;
+        //position of the first index of the meshlet in the mesh index buffer
+        uint32_t indexOffset;
+        uint32_t vertexCount;
+        uint32_t padding[2];
+    };
+
+    static_assert(sizeof(Meshlet) == 64, "meshlets are written as is");
+
+    //index range of one level of detail, every level uses the same vertex buffer
+    struct MeshLod
+    {
+        uint32_t indexOffset;
+        uint32_t indexCount;
+        //largest distance the simplification moved the surface, in model units, 0 for the full mesh
+        float error;
+        uint32_t padding;
+    };
+
+    static_assert(sizeof(MeshLod) == 16, "lods are written as is");
+
+    //index range of the triangles of one material in one level of detail, drawn and culled on its own
+    //big materials can be split in several submeshes, one per spatial sector
+    struct MeshSubmesh
+    {
+        uint32_t indexOffset;
+        uint32_t indexCount;
+        //index in MeshInfo::materials
+        uint32_t material;
+        //meshlets of the range, only the full detail level has some
+        uint32_t firstMeshlet;
+        uint32_t meshletCount;
+        //bounds of the submesh in every level, the same in all of them
+        MeshBounds bounds;
+    };
+
+    static_assert(sizeof(MeshSubmesh) == 48, "submeshes are written as is");
+
     struct MeshInfo
     {
         uint64_t vertexBufferSize;
@@ -37,15 +112,69 @@ namespace assets
         char indexSize;
         CompressionMode compressionMode;
         std::string originalFile;
+        //compressed size of every chunk of the blob, empty for version 1 single block assets
+        uint32_t chunkSize{0};
+        std::vector<uint32_t> chunks;
+        //empty when the mesh was baked without meshlets, they only cover the first level of detail
+        std::vector<Meshlet> meshlets;
+        //from the most to the least detailed, empty when the whole index buffer is the only level
+        std::vector<MeshLod> lods;
+        //the submeshes of every level one after the other, each level has the same ones in the same order
+        //empty for meshes baked before submeshes, they draw every level whole
+        std::vector<MeshSubmesh> submeshes;
+        //names of the materials in the .mtl libraries of the source, empty for the faces without one
+        std::vector<std::string> materials;
+    };
+
+    //fixed part of the version 3 metadata, read with a single memcpy
+    struct MeshHeader
+    {
+        uint64_t vertexBufferSize;
+        uint64_t indexBufferSize;
+        MeshBounds bounds;
+        VertexFormat vertexFormat;
+        uint32_t indexSize;
+        CompressionMode compressionMode;
+        uint32_t chunkSize;
+        uint32_t reserved;
     };
+
+    static_assert(sizeof(MeshHeader) == 64, "mesh header is written as is");
     
-    //parse the texture metadata from an asset file
+    //parse the mesh metadata from an asset file, json for version 1 and 2 and binary from version 3
     MeshInfo readMeshInfo(AssetFile* file);
 
-    void unpackMesh(MeshInfo* info, const char* sourcebuffer, size_t sourceSize, char* vertexBuffer, char* indexBuffer);
+    MeshInfo readMeshInfo(const AssetView* view);
+
+    //checks the buffer sizes against the formats and the blob, that every meshlet and level of detail stays inside the index buffer
+    //and every submesh inside its level and the meshlet table
+    //the metadata comes straight from the file, nothing should index the buffers with it before this passed
+    bool validateMeshInfo(const MeshInfo* info, size_t blobSize);
+
+    //decompress straight into destination, which must hold vertexBufferSize bytes of vertices followed by indexBufferSize bytes of indices
+    //false when the blob is truncated or corrupt, the destination is then left partially written
+    bool unpackMesh(MeshInfo* info, const char* sourcebuffer, size_t sourceSize, char* destination);
+
+    //same as above for separate destinations, only goes through a temporary buffer when they are not contiguous
+    bool unpackMesh(MeshInfo* info, const char* sourcebuffer, size_t sourceSize, char* vertexBuffer, char* indexBuffer);
 
     AssetFile packMesh(MeshInfo* info, char* vertexBuffer, char* indexBuffer);
 
     MeshBounds calculateBounds(Vertex* vertices, size_t count);
 
+    //bounds of the vertices the indices use
+    MeshBounds calculateBounds(const Vertex* vertices, const uint32_t* indices, size_t indexCount);
+
+    //number of submeshes of each level of detail
+    size_t submeshesPerLod(const MeshInfo& info);
+
+    //size of one vertex in bytes, 0 for unknown formats
+    size_t vertexFormatSize(VertexFormat format);
+
+    //destination must hold count vertices of the format, positions are quantized inside bounds
+    void quantizeVertices(const Vertex* vertices, size_t count, const MeshBounds& bounds, VertexFormat format, char* destination);
+
+    //back to full floats, for the cpu side users of quantized meshes
+    void dequantizeVertices(const char* source, size_t count, const MeshBounds& bounds, VertexFormat format, Vertex* destination);
+
 } // namespace assets
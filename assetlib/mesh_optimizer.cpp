@@ -0,0 +1,1028 @@
+#include "mesh_optimizer.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <xxhash.h>
+
+constexpr size_t VERTEX_FLOATS = sizeof(assets::Vertex) / sizeof(float);
+constexpr uint32_t EMPTY_SLOT = ~0u;
+//snapped coordinates beyond it share the key of the limit, well inside the range of int64_t
+constexpr double SNAP_LIMIT = 4.0e18;
+
+static_assert(sizeof(assets::Vertex) == VERTEX_FLOATS * sizeof(float), "vertices are compared as arrays of floats");
+
+struct VertexKey
+{
+    int64_t values[VERTEX_FLOATS];
+};
+
+//without snapping the key is the bits of the attributes, with -0 turned into +0 so the two zeros weld
+//snapped attributes are counted in epsilons, 64 bits so big coordinates over a small epsilon don't overflow
+static VertexKey quantize_vertex(const assets::Vertex& vertex, bool snap, double inverseEpsilon)
+{
+    const float* values = reinterpret_cast<const float*>(&vertex);
+    VertexKey key;
+    for (size_t i = 0; i < VERTEX_FLOATS; i++)
+    {
+        if (!snap)
+        {
+            const float value = values[i] == 0.f ? 0.f : values[i];
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            key.values[i] = bits;
+            continue;
+        }
+        const double scaled = double(values[i]) * inverseEpsilon;
+        key.values[i] = std::isnan(scaled) ? 0 : std::llround(std::min(std::max(scaled, -SNAP_LIMIT), SNAP_LIMIT));
+    }
+    return key;
+}
+
+size_t assets::weldVertices(const Vertex* vertices, size_t count, float epsilon, std::vector<Vertex>& outVertices, std::vector<uint32_t>& outIndices)
+{
+    outVertices.clear();
+    outVertices.reserve(count);
+    outIndices.resize(count);
+
+    //open addressing, at most half full
+    size_t tableSize = 1;
+    while (tableSize < count * 2) tableSize *= 2;
+    std::vector<uint32_t> table(tableSize, EMPTY_SLOT);
+
+    //with an epsilon the quantized attributes are the keys, otherwise the attribute bits are
+    const bool snap = epsilon > 0.f;
+    const double inverseEpsilon = snap ? 1.0 / epsilon : 0.0;
+    std::vector<VertexKey> keys;
+    keys.reserve(count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const VertexKey key = quantize_vertex(vertices[i], snap, inverseEpsilon);
+
+        size_t slot = XXH64(&key, sizeof(VertexKey), 0) & (tableSize - 1);
+        while (true)
+        {
+            uint32_t existing = table[slot];
+            if (existing == EMPTY_SLOT)
+            {
+                existing = static_cast<uint32_t>(outVertices.size());
+                table[slot] = existing;
+                outVertices.push_back(vertices[i]);
+                keys.push_back(key);
+
+                outIndices[i] = existing;
+                break;
+            }
+
+            if (memcmp(&key, &keys[existing], sizeof(VertexKey)) == 0)
+            {
+                outIndices[i] = existing;
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
+        }
+    }
+
+    return outVertices.size();
+}
+
+assets::VertexCacheStats assets::analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+    //fifo cache, a vertex is in it if it was loaded less than cacheSize misses ago
+    std::vector<uint64_t> loadedAt(vertexCount, 0);
+    uint64_t misses = 0;
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        uint32_t v = indices[i];
+        if (loadedAt[v] == 0 || misses - loadedAt[v] + 1 > cacheSize)
+        {
+            misses++;
+            loadedAt[v] = misses;
+        }
+    }
+
+    VertexCacheStats stats;
+    stats.acmr = indexCount ? float(misses) / float(indexCount / 3) : 0.f;
+    stats.atvr = vertexCount ? float(misses) / float(vertexCount) : 0.f;
+    return stats;
+}
+
+std::vector<uint32_t> assets::optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+    std::vector<uint32_t> clusters;
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0) return clusters;
+
+    //triangles using every vertex, as offsets in a single array
+    std::vector<uint32_t> liveTriangles(vertexCount, 0);
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        liveTriangles[indices[i]]++;
+    }
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+    }
+    std::vector<uint32_t> adjacency(indexCount);
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<uint32_t> output;
+    output.reserve(indexCount);
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+
+    uint32_t time = cacheSize + 1;
+    size_t cursor = 0;
+    int64_t fanning = indices[0];
+
+    clusters.push_back(0);
+    while (fanning >= 0)
+    {
+        candidates.clear();
+        for (uint32_t a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; a++)
+        {
+            uint32_t t = adjacency[a];
+            if (emitted[t]) continue;
+
+            for (int c = 0; c < 3; c++)
+            {
+                uint32_t v = indices[t * 3 + c];
+                output.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > cacheSize)
+                {
+                    cacheTime[v] = time++;
+                }
+            }
+            emitted[t] = true;
+        }
+
+        //next fanning vertex, the one still in the cache that will be used the longest
+        fanning = -1;
+        int64_t bestPriority = -1;
+        for (uint32_t v : candidates)
+        {
+            if (liveTriangles[v] == 0) continue;
+
+            int64_t priority = 0;
+            if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+            {
+                priority = time - cacheTime[v];
+            }
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                fanning = v;
+            }
+        }
+
+        if (fanning < 0)
+        {
+            //nothing usable in the cache, this is a hard boundary
+            while (!deadEnds.empty() && fanning < 0)
+            {
+                uint32_t v = deadEnds.back();
+                deadEnds.pop_back();
+                if (liveTriangles[v] > 0) fanning = v;
+            }
+            while (fanning < 0 && cursor < vertexCount)
+            {
+                if (liveTriangles[cursor] > 0) fanning = static_cast<int64_t>(cursor);
+                cursor++;
+            }
+            if (fanning >= 0 && output.size() < indexCount)
+            {
+                clusters.push_back(static_cast<uint32_t>(output.size()));
+            }
+        }
+    }
+
+    memcpy(indices, output.data(), indexCount * sizeof(uint32_t));
+    return clusters;
+}
+
+void assets::optimizeOverdraw(uint32_t* indices, size_t indexCount, const std::vector<uint32_t>& clusters, const Vertex* vertices)
+{
+    if (clusters.size() < 2) return;
+
+    //center of the mesh, weighted by triangle area
+    float meshCenter[3] = {0, 0, 0};
+    float meshArea = 0;
+
+    struct Cluster
+    {
+        uint32_t begin;
+        uint32_t end;
+        float center[3];
+        float normal[3];
+        float area;
+        float sortKey;
+    };
+    std::vector<Cluster> sorted(clusters.size());
+
+    for (size_t c = 0; c < clusters.size(); c++)
+    {
+        Cluster& cluster = sorted[c];
+        cluster = {};
+        cluster.begin = clusters[c];
+        cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : static_cast<uint32_t>(indexCount);
+
+        for (uint32_t i = cluster.begin; i < cluster.end; i += 3)
+        {
+            const float* p0 = vertices[indices[i + 0]].position;
+            const float* p1 = vertices[indices[i + 1]].position;
+            const float* p2 = vertices[indices[i + 2]].position;
+
+            float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            //the cross product is the normal scaled by twice the area
+            float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+            float area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+            for (int k = 0; k < 3; k++)
+            {
+                cluster.center[k] += (p0[k] + p1[k] + p2[k]) / 3.f * area;
+                cluster.normal[k] += n[k];
+            }
+            cluster.area += area;
+        }
+
+        for (int k = 0; k < 3; k++)
+        {
+            meshCenter[k] += cluster.center[k];
+        }
+        meshArea += cluster.area;
+
+        if (cluster.area > 0)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                cluster.center[k] /= cluster.area;
+            }
+        }
+    }
+
+    if (meshArea > 0)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            meshCenter[k] /= meshArea;
+        }
+    }
+
+    for (Cluster& cluster : sorted)
+    {
+        float length = std::sqrt(cluster.normal[0] * cluster.normal[0] + cluster.normal[1] * cluster.normal[1] + cluster.normal[2] * cluster.normal[2]);
+        if (length > 0)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                cluster.normal[k] /= length;
+            }
+        }
+        cluster.sortKey = (cluster.center[0] - meshCenter[0]) * cluster.normal[0]
+            + (cluster.center[1] - meshCenter[1]) * cluster.normal[1]
+            + (cluster.center[2] - meshCenter[2]) * cluster.normal[2];
+    }
+
+    //the clusters that face outwards are the most likely to occlude the others
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b){ return a.sortKey > b.sortKey; });
+
+    std::vector<uint32_t> output;
+    output.reserve(indexCount);
+    for (const Cluster& cluster : sorted)
+    {
+        output.insert(output.end(), indices + cluster.begin, indices + cluster.end);
+    }
+    memcpy(indices, output.data(), indexCount * sizeof(uint32_t));
+}
+
+size_t assets::optimizeVertexFetch(Vertex* vertices, size_t vertexCount, uint32_t* indices, size_t indexCount)
+{
+    std::vector<uint32_t> remap(vertexCount, EMPTY_SLOT);
+    std::vector<Vertex> ordered;
+    ordered.reserve(vertexCount);
+
+    for (size_t i = 0; i < indexCount; i++)
+    {
+        uint32_t& target = remap[indices[i]];
+        if (target == EMPTY_SLOT)
+        {
+            target = static_cast<uint32_t>(ordered.size());
+            ordered.push_back(vertices[indices[i]]);
+        }
+        indices[i] = target;
+    }
+
+    memcpy(vertices, ordered.data(), ordered.size() * sizeof(Vertex));
+    return ordered.size();
+}
+
+static void compute_meshlet_bounds(assets::Meshlet& meshlet, const uint32_t* indices, const assets::Vertex* vertices)
+{
+    const uint32_t* triangles = indices + meshlet.indexOffset;
+    const size_t meshletIndexCount = meshlet.triangleCount * 3;
+
+    //the sphere is centered on the box of the vertices, close enough to the minimal one for culling
+    float boxMin[3] = {vertices[triangles[0]].position[0], vertices[triangles[0]].position[1], vertices[triangles[0]].position[2]};
+    float boxMax[3] = {boxMin[0], boxMin[1], boxMin[2]};
+    for (size_t i = 1; i < meshletIndexCount; i++)
+    {
+        const float* position = vertices[triangles[i]].position;
+        for (int k = 0; k < 3; k++)
+        {
+            boxMin[k] = std::min(boxMin[k], position[k]);
+            boxMax[k] = std::max(boxMax[k], position[k]);
+        }
+    }
+
+    float radiusSquared = 0;
+    for (int k = 0; k < 3; k++)
+    {
+        meshlet.center[k] = (boxMin[k] + boxMax[k]) * 0.5f;
+    }
+    for (size_t i = 0; i < meshletIndexCount; i++)
+    {
+        const float* position = vertices[triangles[i]].position;
+        float dx = position[0] - meshlet.center[0];
+        float dy = position[1] - meshlet.center[1];
+        float dz = position[2] - meshlet.center[2];
+        radiusSquared = std::max(radiusSquared, dx * dx + dy * dy + dz * dz);
+    }
+    meshlet.radius = std::sqrt(radiusSquared);
+
+    //the cone axis is the average of the triangle normals, degenerate triangles are ignored
+    struct TrianglePlane
+    {
+        float normal[3];
+        const float* point;
+    };
+    std::vector<TrianglePlane> planes;
+    planes.reserve(meshlet.triangleCount);
+    float axis[3] = {0, 0, 0};
+    for (uint32_t t = 0; t < meshlet.triangleCount; t++)
+    {
+        const float* p0 = vertices[triangles[t * 3 + 0]].position;
+        const float* p1 = vertices[triangles[t * 3 + 1]].position;
+        const float* p2 = vertices[triangles[t * 3 + 2]].position;
+
+        float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+        float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0)
+        {
+            continue;
+        }
+
+        TrianglePlane plane{{n[0] / length, n[1] / length, n[2] / length}, p0};
+        for (int k = 0; k < 3; k++)
+        {
+            axis[k] += plane.normal[k];
+        }
+        planes.push_back(plane);
+    }
+
+    //by default the cone never culls
+    for (int k = 0; k < 3; k++)
+    {
+        meshlet.coneApex[k] = meshlet.center[k];
+        meshlet.coneAxis[k] = 0;
+    }
+    meshlet.coneCutoff = 1;
+
+    float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (axisLength == 0)
+    {
+        return;
+    }
+    for (int k = 0; k < 3; k++)
+    {
+        axis[k] /= axisLength;
+    }
+
+    //the cone must contain every normal, its half angle comes from the normal furthest from the axis
+    float minDot = 1;
+    for (const TrianglePlane& plane : planes)
+    {
+        minDot = std::min(minDot, plane.normal[0] * axis[0] + plane.normal[1] * axis[1] + plane.normal[2] * axis[2]);
+    }
+
+    //past about 84 degrees the cone would almost never cull anything
+    if (minDot <= 0.1f)
+    {
+        return;
+    }
+
+    //move the apex back along the axis until it is behind every triangle plane,
+    //then a camera inside the cone sees the back of all the triangles
+    float maxT = 0;
+    for (const TrianglePlane& plane : planes)
+    {
+        const float* p0 = plane.point;
+        const float* n = plane.normal;
+        float dc = (meshlet.center[0] - p0[0]) * n[0] + (meshlet.center[1] - p0[1]) * n[1] + (meshlet.center[2] - p0[2]) * n[2];
+        float dn = axis[0] * n[0] + axis[1] * n[1] + axis[2] * n[2];
+        maxT = std::max(maxT, dc / dn);
+    }
+
+    for (int k = 0; k < 3; k++)
+    {
+        meshlet.coneAxis[k] = axis[k];
+        meshlet.coneApex[k] = meshlet.center[k] - axis[k] * maxT;
+    }
+    meshlet.coneCutoff = std::sqrt(1 - minDot * minDot);
+}
+
+//vertices of the triangle not used yet by the meshlet, a vertex repeated inside the triangle is only counted once
+static uint32_t count_new_vertices(const uint32_t* triangle, const std::vector<uint32_t>& owner, uint32_t meshletId)
+{
+    uint32_t count = 0;
+    for (int k = 0; k < 3; k++)
+    {
+        bool repeated = (k > 0 && triangle[k] == triangle[0]) || (k > 1 && triangle[k] == triangle[1]);
+        if (!repeated && owner[triangle[k]] != meshletId)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+struct SectorTriangle
+{
+    float centroid[3];
+    uint32_t triangle;
+};
+
+static void split_sector(std::vector<SectorTriangle>& triangles, size_t begin, size_t end, size_t maxTriangles,
+    std::vector<assets::SectorNode>& nodes, std::vector<uint32_t>& sectorSizes)
+{
+    float min[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (size_t i = begin; i < end; i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            min[k] = std::min(min[k], triangles[i].centroid[k]);
+            max[k] = std::max(max[k], triangles[i].centroid[k]);
+        }
+    }
+    int axis = 0;
+    for (int k = 1; k < 3; k++)
+    {
+        if (max[k] - min[k] > max[axis] - min[axis])
+        {
+            axis = k;
+        }
+    }
+
+    //all the centroids at one point can't be split any further
+    if (end - begin <= maxTriangles || max[axis] <= min[axis])
+    {
+        nodes.push_back({-1, 0.f, static_cast<uint32_t>(sectorSizes.size())});
+        sectorSizes.push_back(static_cast<uint32_t>((end - begin) * 3));
+        return;
+    }
+
+    const size_t middle = begin + (end - begin) / 2;
+    std::nth_element(triangles.begin() + begin, triangles.begin() + middle, triangles.begin() + end, [&](const SectorTriangle& a, const SectorTriangle& b){
+        return a.centroid[axis] < b.centroid[axis];
+    });
+
+    const size_t node = nodes.size();
+    nodes.push_back({axis, triangles[middle].centroid[axis], 0});
+    split_sector(triangles, begin, middle, maxTriangles, nodes, sectorSizes);
+    nodes[node].next = static_cast<uint32_t>(nodes.size());
+    split_sector(triangles, middle, end, maxTriangles, nodes, sectorSizes);
+}
+
+std::vector<assets::SectorNode> assets::splitSectors(uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t maxTriangles, std::vector<uint32_t>& outSectorSizes)
+{
+    std::vector<SectorTriangle> triangles(indexCount / 3);
+    for (size_t t = 0; t < triangles.size(); t++)
+    {
+        triangles[t].triangle = static_cast<uint32_t>(t);
+        for (int k = 0; k < 3; k++)
+        {
+            triangles[t].centroid[k] = (vertices[indices[t * 3]].position[k] + vertices[indices[t * 3 + 1]].position[k] + vertices[indices[t * 3 + 2]].position[k]) / 3.f;
+        }
+    }
+
+    std::vector<SectorNode> nodes;
+    outSectorSizes.clear();
+    split_sector(triangles, 0, triangles.size(), std::max<size_t>(maxTriangles, 1), nodes, outSectorSizes);
+
+    //the leaves are made from left to right, so the triangles are already in sector order
+    std::vector<uint32_t> source(indices, indices + triangles.size() * 3);
+    for (size_t t = 0; t < triangles.size(); t++)
+    {
+        std::copy_n(source.begin() + size_t(triangles[t].triangle) * 3, 3, indices + t * 3);
+    }
+    return nodes;
+}
+
+uint32_t assets::findSector(const std::vector<SectorNode>& nodes, const float* point)
+{
+    uint32_t node = 0;
+    while (nodes[node].axis >= 0)
+    {
+        node = point[nodes[node].axis] < nodes[node].split ? node + 1 : nodes[node].next;
+    }
+    return nodes[node].next;
+}
+
+std::vector<assets::Meshlet> assets::buildMeshlets(const uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, uint32_t maxVertices, uint32_t maxTriangles)
+{
+    std::vector<Meshlet> meshlets;
+
+    //meshlet that last used each vertex, so the unique vertices are counted without clearing anything
+    std::vector<uint32_t> owner(vertexCount, EMPTY_SLOT);
+
+    Meshlet current{};
+    uint32_t currentId = 0;
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        uint32_t newVertices = count_new_vertices(indices + i, owner, currentId);
+        if (current.triangleCount > 0 && (current.vertexCount + newVertices > maxVertices || current.triangleCount == maxTriangles))
+        {
+            meshlets.push_back(current);
+            currentId++;
+            current = Meshlet{};
+            current.indexOffset = static_cast<uint32_t>(i);
+            newVertices = count_new_vertices(indices + i, owner, currentId);
+        }
+
+        for (int k = 0; k < 3; k++)
+        {
+            owner[indices[i + k]] = currentId;
+        }
+        current.vertexCount += newVertices;
+        current.triangleCount++;
+    }
+    if (current.triangleCount > 0)
+    {
+        meshlets.push_back(current);
+    }
+
+    for (Meshlet& meshlet : meshlets)
+    {
+        compute_meshlet_bounds(meshlet, indices, vertices);
+    }
+    return meshlets;
+}
+
+//sum of squared distances to planes, a weight is kept so the error can be brought back to a distance
+struct Quadric
+{
+    double a00, a11, a22, a10, a20, a21;
+    double b0, b1, b2;
+    double c;
+    double w;
+};
+
+static void add_plane_quadric(Quadric& q, const double* normal, double d, double weight)
+{
+    q.a00 += normal[0] * normal[0] * weight;
+    q.a11 += normal[1] * normal[1] * weight;
+    q.a22 += normal[2] * normal[2] * weight;
+    q.a10 += normal[1] * normal[0] * weight;
+    q.a20 += normal[2] * normal[0] * weight;
+    q.a21 += normal[2] * normal[1] * weight;
+    q.b0 += normal[0] * d * weight;
+    q.b1 += normal[1] * d * weight;
+    q.b2 += normal[2] * d * weight;
+    q.c += d * d * weight;
+    q.w += weight;
+}
+
+static void add_quadric(Quadric& q, const Quadric& other)
+{
+    q.a00 += other.a00; q.a11 += other.a11; q.a22 += other.a22;
+    q.a10 += other.a10; q.a20 += other.a20; q.a21 += other.a21;
+    q.b0 += other.b0; q.b1 += other.b1; q.b2 += other.b2;
+    q.c += other.c;
+    q.w += other.w;
+}
+
+//weighted mean of the squared distances of the point to the planes
+static double quadric_error(const Quadric& q, const float* p)
+{
+    double x = p[0], y = p[1], z = p[2];
+    double r = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z
+        + 2 * (q.a10 * x * y + q.a20 * x * z + q.a21 * y * z)
+        + 2 * (q.b0 * x + q.b1 * y + q.b2 * z)
+        + q.c;
+    return q.w > 0 ? std::abs(r) / q.w : 0;
+}
+
+static void triangle_normal(const float* p0, const float* p1, const float* p2, double* normal)
+{
+    double e1[3] = {double(p1[0]) - p0[0], double(p1[1]) - p0[1], double(p1[2]) - p0[2]};
+    double e2[3] = {double(p2[0]) - p0[0], double(p2[1]) - p0[1], double(p2[2]) - p0[2]};
+    normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+//manifold vertices collapse anywhere, border and seam ones only along their border or seam
+enum class VertexKind : uint8_t
+{
+    Manifold,
+    Border,
+    Seam,
+    Locked
+};
+
+//border edges count this much more than the triangle planes, so the outline barely moves
+constexpr double BORDER_WEIGHT = 10.0;
+
+static uint64_t edge_key(uint32_t a, uint32_t b)
+{
+    return (uint64_t(a) << 32) | b;
+}
+
+float assets::simplifyMesh(const uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount,
+    size_t targetIndexCount, float targetError, std::vector<uint32_t>& outIndices)
+{
+    outIndices.assign(indices, indices + indexCount);
+    if (indexCount <= targetIndexCount || vertexCount == 0)
+    {
+        return 0.f;
+    }
+
+    //vertices at the same position are wedges of one group, they only differ by the attributes of a seam
+    std::vector<uint32_t> sorted(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++)
+    {
+        sorted[v] = v;
+    }
+    std::sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b){
+        const float* pa = vertices[a].position;
+        const float* pb = vertices[b].position;
+        return std::lexicographical_compare(pa, pa + 3, pb, pb + 3);
+    });
+
+    std::vector<uint32_t> group(vertexCount);
+    std::vector<uint32_t> wedge(vertexCount);
+    for (size_t begin = 0; begin < vertexCount;)
+    {
+        size_t end = begin + 1;
+        while (end < vertexCount && std::equal(vertices[sorted[begin]].position, vertices[sorted[begin]].position + 3, vertices[sorted[end]].position))
+        {
+            end++;
+        }
+        for (size_t i = begin; i < end; i++)
+        {
+            group[sorted[i]] = sorted[begin];
+            wedge[sorted[i]] = sorted[i + 1 < end ? i + 1 : begin];
+        }
+        begin = end;
+    }
+
+    std::vector<uint32_t>& current = outIndices;
+    std::vector<VertexKind> kinds(vertexCount);
+    std::vector<Quadric> quadrics(vertexCount, Quadric{});
+    std::unordered_set<uint64_t> indexEdges;
+    std::unordered_map<uint64_t, uint32_t> positionEdges;
+
+    auto classify = [&]()
+    {
+        indexEdges.clear();
+        positionEdges.clear();
+        for (size_t i = 0; i < current.size(); i += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t a = current[i + k];
+                uint32_t b = current[i + (k + 1) % 3];
+                indexEdges.insert(edge_key(a, b));
+                positionEdges[edge_key(group[a], group[b])]++;
+            }
+        }
+
+        std::vector<uint8_t> borderOut(vertexCount, 0), borderIn(vertexCount, 0), seamOut(vertexCount, 0), seamIn(vertexCount, 0);
+        std::vector<bool> complex(vertexCount, false);
+        for (size_t i = 0; i < current.size(); i += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t a = current[i + k];
+                uint32_t b = current[i + (k + 1) % 3];
+                //the same position edge twice in one direction is not a surface anymore
+                if (positionEdges[edge_key(group[a], group[b])] > 1)
+                {
+                    complex[group[a]] = complex[group[b]] = true;
+                }
+                if (indexEdges.count(edge_key(b, a)))
+                {
+                    continue;
+                }
+                //open in the index buffer, it is a seam if the other side exists with other wedges
+                bool seam = positionEdges.count(edge_key(group[b], group[a])) > 0;
+                std::vector<uint8_t>& out = seam ? seamOut : borderOut;
+                std::vector<uint8_t>& in = seam ? seamIn : borderIn;
+                out[a] = static_cast<uint8_t>(std::min(out[a] + 1, 255));
+                in[b] = static_cast<uint8_t>(std::min(in[b] + 1, 255));
+            }
+        }
+
+        for (uint32_t v = 0; v < vertexCount; v++)
+        {
+            if (group[v] != v)
+            {
+                continue;
+            }
+            uint32_t wedgeCount = 0;
+            bool open = false;
+            bool border = true;
+            bool seam = true;
+            uint32_t w = v;
+            do
+            {
+                wedgeCount++;
+                open = open || borderOut[w] || borderIn[w] || seamOut[w] || seamIn[w];
+                border = border && borderOut[w] == 1 && borderIn[w] == 1 && seamOut[w] == 0 && seamIn[w] == 0;
+                seam = seam && seamOut[w] == 1 && seamIn[w] == 1 && borderOut[w] == 0 && borderIn[w] == 0;
+                w = wedge[w];
+            } while (w != v);
+
+            VertexKind kind = VertexKind::Locked;
+            if (complex[v])
+            {
+                kind = VertexKind::Locked;
+            }
+            else if (wedgeCount == 1 && !open)
+            {
+                kind = VertexKind::Manifold;
+            }
+            else if (wedgeCount == 1 && border)
+            {
+                kind = VertexKind::Border;
+            }
+            else if (wedgeCount == 2 && seam)
+            {
+                kind = VertexKind::Seam;
+            }
+            kinds[v] = kind;
+        }
+    };
+
+    classify();
+
+    //triangle planes weighted by area, then planes through the border and seam edges so the outline and the seams keep their shape
+    for (size_t i = 0; i < current.size(); i += 3)
+    {
+        const float* p[3] = {vertices[current[i]].position, vertices[current[i + 1]].position, vertices[current[i + 2]].position};
+        double normal[3];
+        triangle_normal(p[0], p[1], p[2], normal);
+        double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (length == 0)
+        {
+            continue;
+        }
+        for (int k = 0; k < 3; k++)
+        {
+            normal[k] /= length;
+        }
+        double d = -(normal[0] * p[0][0] + normal[1] * p[0][1] + normal[2] * p[0][2]);
+        for (int k = 0; k < 3; k++)
+        {
+            add_plane_quadric(quadrics[group[current[i + k]]], normal, d, length * 0.5);
+        }
+
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t a = current[i + k];
+            uint32_t b = current[i + (k + 1) % 3];
+            if (indexEdges.count(edge_key(b, a)))
+            {
+                continue;
+            }
+            const float* pa = vertices[a].position;
+            const float* pb = vertices[b].position;
+            double edge[3] = {double(pb[0]) - pa[0], double(pb[1]) - pa[1], double(pb[2]) - pa[2]};
+            double edgeLength = std::sqrt(edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2]);
+            if (edgeLength == 0)
+            {
+                continue;
+            }
+            double planeNormal[3] = {edge[1] * normal[2] - edge[2] * normal[1], edge[2] * normal[0] - edge[0] * normal[2], edge[0] * normal[1] - edge[1] * normal[0]};
+            for (int c = 0; c < 3; c++)
+            {
+                planeNormal[c] /= edgeLength;
+            }
+            double planeD = -(planeNormal[0] * pa[0] + planeNormal[1] * pa[1] + planeNormal[2] * pa[2]);
+            add_plane_quadric(quadrics[group[a]], planeNormal, planeD, edgeLength * edgeLength * BORDER_WEIGHT);
+            add_plane_quadric(quadrics[group[b]], planeNormal, planeD, edgeLength * edgeLength * BORDER_WEIGHT);
+        }
+    }
+
+    struct Collapse
+    {
+        uint32_t from;
+        uint32_t to;
+        double cost;
+    };
+
+    const double maxCost = double(targetError) * double(targetError);
+    double resultCost = 0;
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+    std::vector<uint32_t> adjacency;
+
+    //every pass applies the cheapest collapses that don't share a neighbourhood, then the topology is rebuilt
+    for (int pass = 0; current.size() > targetIndexCount; pass++)
+    {
+        if (pass > 0)
+        {
+            classify();
+        }
+
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (uint32_t index : current)
+        {
+            adjacencyOffsets[index + 1]++;
+        }
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        }
+        adjacency.resize(current.size());
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < current.size(); i++)
+        {
+            adjacency[fill[current[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        //edge of a single triangle in the index buffer, whichever its direction
+        auto open_edge = [&](uint32_t a, uint32_t b)
+        {
+            return indexEdges.count(edge_key(a, b)) ? !indexEdges.count(edge_key(b, a)) : indexEdges.count(edge_key(b, a)) > 0;
+        };
+
+        std::vector<Collapse> collapses;
+        for (size_t i = 0; i < current.size(); i += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t edge[2] = {current[i + k], current[i + (k + 1) % 3]};
+                for (int direction = 0; direction < 2; direction++)
+                {
+                    uint32_t from = edge[direction];
+                    uint32_t to = edge[1 - direction];
+                    VertexKind fromKind = kinds[group[from]];
+                    VertexKind toKind = kinds[group[to]];
+
+                    //the open edges of border and seam vertices are all border or seam edges
+                    bool allowed = fromKind == VertexKind::Manifold
+                        || (fromKind == toKind && (fromKind == VertexKind::Border || fromKind == VertexKind::Seam) && open_edge(from, to));
+                    if (!allowed)
+                    {
+                        continue;
+                    }
+                    collapses.push_back({from, to, quadric_error(quadrics[group[from]], vertices[to].position)});
+                }
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b){ return a.cost < b.cost; });
+
+        for (uint32_t v = 0; v < vertexCount; v++)
+        {
+            remap[v] = v;
+        }
+        std::fill(touched.begin(), touched.end(), false);
+
+        size_t triangleCount = current.size() / 3;
+        const size_t targetTriangles = targetIndexCount / 3;
+        if (collapses.empty())
+        {
+            break;
+        }
+
+        //a collapse removes about two triangles, the pass stops a bit past the cost that would be enough
+        //so the expensive collapses are only taken once the cheap ones of the next passes are used up
+        size_t goal = std::min(collapses.size() - 1, (triangleCount - targetTriangles) / 2);
+        const double passCost = std::min(maxCost, collapses[goal].cost * 1.5);
+
+        size_t applied = 0;
+        for (const Collapse& collapse : collapses)
+        {
+            if (collapse.cost > passCost || triangleCount <= targetTriangles)
+            {
+                break;
+            }
+            uint32_t fromGroup = group[collapse.from];
+            uint32_t toGroup = group[collapse.to];
+            if (touched[fromGroup] || touched[toGroup])
+            {
+                continue;
+            }
+
+            //the other wedge of a seam vertex must follow the seam on its own side
+            if (kinds[fromGroup] == VertexKind::Seam && !open_edge(wedge[collapse.from], wedge[collapse.to]))
+            {
+                continue;
+            }
+
+            //moving the group must not flip any of the triangles that stay
+            bool flip = false;
+            size_t removed = 0;
+            uint32_t w = fromGroup;
+            do
+            {
+                for (uint32_t a = adjacencyOffsets[w]; a < adjacencyOffsets[w + 1] && !flip; a++)
+                {
+                    const uint32_t* triangle = &current[adjacency[a] * 3];
+                    if (group[triangle[0]] == toGroup || group[triangle[1]] == toGroup || group[triangle[2]] == toGroup)
+                    {
+                        removed++;
+                        continue;
+                    }
+                    const float* before[3];
+                    const float* after[3];
+                    for (int k = 0; k < 3; k++)
+                    {
+                        before[k] = vertices[triangle[k]].position;
+                        after[k] = group[triangle[k]] == fromGroup ? vertices[collapse.to].position : before[k];
+                    }
+                    double n0[3], n1[3];
+                    triangle_normal(before[0], before[1], before[2], n0);
+                    triangle_normal(after[0], after[1], after[2], n1);
+                    flip = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0;
+                }
+                w = wedge[w];
+            } while (w != fromGroup && !flip);
+
+            if (flip)
+            {
+                continue;
+            }
+
+            remap[collapse.from] = collapse.to;
+            if (kinds[fromGroup] == VertexKind::Seam)
+            {
+                remap[wedge[collapse.from]] = wedge[collapse.to];
+            }
+            add_quadric(quadrics[toGroup], quadrics[fromGroup]);
+            resultCost = std::max(resultCost, collapse.cost);
+
+            //the whole neighbourhood stays still until the next pass, so the flip tests above stay valid
+            w = fromGroup;
+            do
+            {
+                for (uint32_t a = adjacencyOffsets[w]; a < adjacencyOffsets[w + 1]; a++)
+                {
+                    const uint32_t* triangle = &current[adjacency[a] * 3];
+                    for (int k = 0; k < 3; k++)
+                    {
+                        touched[group[triangle[k]]] = true;
+                    }
+                }
+                w = wedge[w];
+            } while (w != fromGroup);
+            touched[toGroup] = true;
+
+            triangleCount -= std::min(removed, triangleCount);
+            applied++;
+        }
+
+        if (applied == 0)
+        {
+            break;
+        }
+
+        //collapsed triangles have two corners at the same position and are dropped
+        size_t write = 0;
+        for (size_t i = 0; i < current.size(); i += 3)
+        {
+            uint32_t a = remap[current[i]];
+            uint32_t b = remap[current[i + 1]];
+            uint32_t c = remap[current[i + 2]];
+            if (group[a] == group[b] || group[b] == group[c] || group[a] == group[c])
+            {
+                continue;
+            }
+            current[write++] = a;
+            current[write++] = b;
+            current[write++] = c;
+        }
+        current.resize(write);
+    }
+
+    return static_cast<float>(std::sqrt(resultCost));
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "mesh_asset.h"
+
+namespace assets
+{
+    //merges equal vertices, with epsilon above 0 every attribute is first snapped to a grid of that size
+    //outIndices gets one index per input vertex, so a triangle soup becomes an indexed mesh
+    //returns the number of unique vertices
+    size_t weldVertices(const Vertex* vertices, size_t count, float epsilon, std::vector<Vertex>& outVertices, std::vector<uint32_t>& outIndices);
+
+    //size of the simulated fifo cache, small enough to stay a good fit for any gpu
+    constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+
+    struct VertexCacheStats
+    {
+        //vertex shader invocations per triangle, 0.5 at best and 3 at worst
+        float acmr;
+        //vertex shader invocations per vertex, 1 at best
+        float atvr;
+    };
+
+    VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+    //reorders the triangles for the post transform cache (tipsify), returns the offsets in indices where a new cluster starts
+    //a cluster starts every time the walk has to jump to a vertex that is not in the cache anymore
+    std::vector<uint32_t> optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+    //sorts the clusters so the ones facing away from the mesh center are drawn first, which hides more of the inner ones
+    void optimizeOverdraw(uint32_t* indices, size_t indexCount, const std::vector<uint32_t>& clusters, const Vertex* vertices);
+
+    //reorders the vertices in the order the indices first use them and drops unused ones, returns the new vertex count
+    size_t optimizeVertexFetch(Vertex* vertices, size_t vertexCount, uint32_t* indices, size_t indexCount);
+
+    //limits that fit the usual mesh shader and compute culling group sizes
+    constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+    constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+    //splits the triangles in runs of the index buffer that stay under both limits, so the vertex cache order is kept
+    //and computes the bounding sphere and normal cone of every meshlet
+    std::vector<Meshlet> buildMeshlets(const uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount,
+        uint32_t maxVertices = MESHLET_MAX_VERTICES, uint32_t maxTriangles = MESHLET_MAX_TRIANGLES);
+
+    //node of a k-d split of a mesh, the leaves are the sectors
+    struct SectorNode
+    {
+        //split axis of an inner node, -1 for a leaf
+        int32_t axis;
+        //points below split go to the child right after the node, the others to the one at next
+        float split;
+        //child on the upper side for an inner node, index of the sector for a leaf
+        uint32_t next;
+    };
+
+    //k-d split of the triangles by centroid, each node cuts the longest axis of its centroids at the median
+    //until the sectors have at most maxTriangles, the triangles are reordered so every sector is contiguous
+    //outSectorSizes gets the index count of every sector, in the order they are in indices
+    std::vector<SectorNode> splitSectors(uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t maxTriangles, std::vector<uint32_t>& outSectorSizes);
+
+    //sector of a point, for triangles made after the split like the ones of the simplified levels
+    uint32_t findSector(const std::vector<SectorNode>& nodes, const float* point);
+
+    //quadric error edge collapse down to targetIndexCount indices, or until a collapse would move the surface more than targetError
+    //border and seam vertices only slide along the border or the seam, the vertices are kept and outIndices points into them
+    //returns the largest error of the applied collapses, in the units of the positions
+    float simplifyMesh(const uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount,
+        size_t targetIndexCount, float targetError, std::vector<uint32_t>& outIndices);
+
+} // namespace assets
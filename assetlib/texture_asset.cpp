@@ -1,15 +1,53 @@
 #include <texture_asset.h>
+#include <texture_compression.h>
 #include <json.hpp>
 #include <lz4.h>
+#include <algorithm>
+#include <numeric>
+
+//groups the levels in the order of their offsets, the consecutive small ones go in the same record
+static std::vector<assets::TextureRecord> build_texture_records(const std::vector<assets::TextureMip>& mips, uint32_t chunkSize)
+{
+    std::vector<uint32_t> order(mips.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b){ return mips[a].offset < mips[b].offset; });
+
+    std::vector<assets::TextureRecord> records;
+    for (uint32_t level : order)
+    {
+        const assets::TextureMip& mip = mips[level];
+        if (!records.empty())
+        {
+            assets::TextureRecord& last = records.back();
+            const bool follows = last.firstMip == level + 1 && last.unpackedOffset + last.unpackedSize == mip.offset;
+            if (follows && last.unpackedSize + mip.size <= chunkSize)
+            {
+                last.firstMip = level;
+                last.mipCount++;
+                last.unpackedSize += mip.size;
+                continue;
+            }
+        }
+
+        assets::TextureRecord record{};
+        record.unpackedOffset = mip.offset;
+        record.unpackedSize = mip.size;
+        record.firstMip = level;
+        record.mipCount = 1;
+        records.push_back(record);
+    }
+    return records;
+}
 
 assets::AssetFile assets::packTexture(assets::TextureInfo* info, void* pixelData)
 {
     nlohmann::json textureMetadata;
-    textureMetadata["format"] ="RGBA8";
+    textureMetadata["format"] = textureFormatName(info->textureFormat);
     textureMetadata["width"] = info->pixelsize[0];
     textureMetadata["height"] = info->pixelsize[1];
     textureMetadata["bufferSize"] = info->textureSize;
     textureMetadata["originalFile"] = info->originalFile;
+    textureMetadata["mipCount"] = info->mips.size();
 
     //core file header
 
@@ -18,62 +56,232 @@ assets::AssetFile assets::packTexture(assets::TextureInfo* info, void* pixelData
     file.type[1] = 'E';
     file.type[2] = 'X';
     file.type[3] = 'I';
-    file.version = 1;
+    file.version = BINARY_METADATA_VERSION;
 
-    //compress buffer into blob
-    //set buffer size to maximum worst case compression size
-    int compressStaging = LZ4_compressBound(info->textureSize);
-    file.binaryBlob.resize(compressStaging);
-
-    //set size to actual compressed data
-    int compressedSize = LZ4_compress_default((const char*)pixelData,file.binaryBlob.data(),info->textureSize,compressStaging);
-    file.binaryBlob.resize(compressedSize);
+    //compress buffer into blob, chunk by chunk so it can be decompressed in parallel
+    info->chunkSize = DEFAULT_CHUNK_SIZE;
+    info->chunks.clear();
+    info->records = build_texture_records(info->mips, info->chunkSize);
+    if (info->records.empty())
+    {
+        info->chunks = compressChunked((const char*)pixelData, info->textureSize, info->chunkSize, file.binaryBlob);
+    }
+    //every record starts its own chunks, so it can be decompressed alone
+    for (TextureRecord& record : info->records)
+    {
+        record.blobOffset = file.binaryBlob.size();
+        record.firstChunk = static_cast<uint32_t>(info->chunks.size());
+        std::vector<uint32_t> chunks = compressChunked((const char*)pixelData + record.unpackedOffset, record.unpackedSize, info->chunkSize, file.binaryBlob);
+        info->chunks.insert(info->chunks.end(), chunks.begin(), chunks.end());
+        record.chunkCount = static_cast<uint32_t>(chunks.size());
+        record.blobSize = static_cast<uint32_t>(file.binaryBlob.size() - record.blobOffset);
+    }
+    textureMetadata["recordCount"] = info->records.size();
 
     textureMetadata["compression"] = "LZ4";
+    textureMetadata["chunkSize"] = info->chunkSize;
+    textureMetadata["chunks"] = info->chunks;
+
+    TextureHeader header{};
+    header.textureSize = info->textureSize;
+    header.textureFormat = info->textureFormat;
+    header.compressionMode = CompressionMode::LZ4;
+    header.pixelsize[0] = info->pixelsize[0];
+    header.pixelsize[1] = info->pixelsize[1];
+    header.pixelsize[2] = 1;
+    header.chunkSize = info->chunkSize;
 
+    file.json.assign((const char*)&header, sizeof(TextureHeader));
+    appendMetadataSection(file.json, "CHNK", info->chunks.data(), info->chunks.size() * sizeof(uint32_t));
+    appendMetadataSection(file.json, "FILE", info->originalFile.data(), info->originalFile.size());
+    if (!info->mips.empty())
+    {
+        appendMetadataSection(file.json, "MIPS", info->mips.data(), info->mips.size() * sizeof(TextureMip));
+        appendMetadataSection(file.json, "TREC", info->records.data(), info->records.size() * sizeof(TextureRecord));
+    }
+
+    //the json is not read anymore, it is only kept so the metadata stays easy to inspect
     std::string stringified = textureMetadata.dump();
-    file.json = stringified;
+    appendMetadataSection(file.json, "JSON", stringified.data(), stringified.size());
     return file;
 }
 
-assets::TextureFormat parse_image_format(const std::string& format) {
+const char* assets::textureFormatName(TextureFormat format)
+{
+    switch (format)
+    {
+    case TextureFormat::RGBA8: return "RGBA8";
+    case TextureFormat::BC1: return "BC1";
+    case TextureFormat::BC3: return "BC3";
+    case TextureFormat::BC4: return "BC4";
+    case TextureFormat::BC5: return "BC5";
+    case TextureFormat::BC7: return "BC7";
+    default: return "Unknown";
+    }
+}
 
-	if (format == "RGBA8")
-	{
-		return assets::TextureFormat::RGBA8;
-	}
-	else {
-		return assets::TextureFormat::Unknown;
-	}
+assets::TextureFormat assets::parseTextureFormat(const std::string& name)
+{
+    for (TextureFormat format : {TextureFormat::RGBA8, TextureFormat::BC1, TextureFormat::BC3, TextureFormat::BC4, TextureFormat::BC5, TextureFormat::BC7})
+    {
+        if (name == textureFormatName(format))
+        {
+            return format;
+        }
+    }
+    return TextureFormat::Unknown;
 }
 
-assets::TextureInfo assets::readTextureInfo(AssetFile* file)
+assets::TextureInfo parse_texture_json(std::string_view json)
 {
-    TextureInfo info;
+    assets::TextureInfo info;
 
-    nlohmann::json textureMetadata = nlohmann::json::parse(file->json);
+    nlohmann::json textureMetadata = nlohmann::json::parse(json.begin(), json.end());
     std::string formatString = textureMetadata["format"];
-    info.textureFormat = parse_image_format(formatString);
+    info.textureFormat = assets::parseTextureFormat(formatString);
 
     std::string compressionString = textureMetadata["compression"];
-    info.compressionMode = parse_compression(compressionString);
+    info.compressionMode = assets::parse_compression(compressionString);
 
     info.pixelsize[0] = textureMetadata["width"];
     info.pixelsize[1] = textureMetadata["height"];
     info.textureSize = textureMetadata["bufferSize"];
     info.originalFile = textureMetadata["originalFile"];
 
+    if (textureMetadata.contains("chunks"))
+    {
+        info.chunkSize = textureMetadata["chunkSize"];
+        info.chunks = textureMetadata["chunks"].get<std::vector<uint32_t>>();
+    }
+
     return info;  
 }
 
-void assets::unpackTexture(TextureInfo* info, const char* sourcebuffer, size_t sourcesize, char* destination)
+assets::TextureInfo parse_texture_binary(std::string_view metadata)
+{
+    assets::TextureInfo info;
+    assets::TextureHeader header{};
+    memcpy(&header, metadata.data(), std::min(metadata.size(), sizeof(assets::TextureHeader)));
+
+    info.textureSize = header.textureSize;
+    info.textureFormat = header.textureFormat;
+    info.compressionMode = header.compressionMode;
+    info.pixelsize[0] = header.pixelsize[0];
+    info.pixelsize[1] = header.pixelsize[1];
+    info.pixelsize[2] = header.pixelsize[2];
+    info.chunkSize = header.chunkSize;
+    info.chunks = assets::readMetadataArray<uint32_t>(metadata, sizeof(assets::TextureHeader), "CHNK");
+    info.mips = assets::readMetadataArray<assets::TextureMip>(metadata, sizeof(assets::TextureHeader), "MIPS");
+    info.records = assets::readMetadataArray<assets::TextureRecord>(metadata, sizeof(assets::TextureHeader), "TREC");
+
+    std::string_view originalFile = assets::findMetadataSection(metadata, sizeof(assets::TextureHeader), "FILE");
+    info.originalFile.assign(originalFile.begin(), originalFile.end());
+    return info;
+}
+
+assets::TextureInfo parse_texture_info(uint32_t version, std::string_view metadata)
+{
+    if (version >= assets::BINARY_METADATA_VERSION)
+    {
+        return parse_texture_binary(metadata);
+    }
+    return parse_texture_json(metadata);
+}
+
+assets::TextureInfo assets::readTextureInfo(AssetFile* file)
 {
-    if (info->compressionMode == CompressionMode::LZ4)
+    return parse_texture_info(file->version, file->json);
+}
+
+assets::TextureInfo assets::readTextureInfo(const AssetView* view)
+{
+    return parse_texture_info(view->version, view->json);
+}
+
+bool assets::validateTextureInfo(const TextureInfo* info, size_t blobSize)
+{
+    //assets baked without mips hold only the full image
+    if (info->mips.empty())
+    {
+        return info->records.empty() && info->textureSize >= textureLevelSize(info->textureFormat, info->pixelsize[0], info->pixelsize[1]);
+    }
+
+    //every level is half the one before and sized for its format, the copies to the image go by the dimensions
+    if (info->mips.size() > 32 || info->mips[0].width != info->pixelsize[0] || info->mips[0].height != info->pixelsize[1])
+    {
+        return false;
+    }
+    for (size_t level = 0; level < info->mips.size(); level++)
     {
-        LZ4_decompress_safe(sourcebuffer,destination,sourcesize,info->textureSize);
+        const TextureMip& mip = info->mips[level];
+        if (mip.width != std::max(info->pixelsize[0] >> level, 1u) || mip.height != std::max(info->pixelsize[1] >> level, 1u)
+            || mip.size != textureLevelSize(info->textureFormat, mip.width, mip.height)
+            || uint64_t(mip.offset) + mip.size > info->textureSize)
+        {
+            return false;
+        }
+    }
+
+    for (const TextureRecord& record : info->records)
+    {
+        if (uint64_t(record.firstChunk) + record.chunkCount > info->chunks.size()
+            || record.blobOffset > blobSize || record.blobSize > blobSize - record.blobOffset
+            || uint64_t(record.unpackedOffset) + record.unpackedSize > info->textureSize
+            || record.mipCount == 0 || uint64_t(record.firstMip) + record.mipCount > info->mips.size())
+        {
+            return false;
+        }
+        //the levels of the record are unpacked in its part of the buffer
+        for (uint32_t level = record.firstMip; level < record.firstMip + record.mipCount; level++)
+        {
+            const TextureMip& mip = info->mips[level];
+            if (mip.offset < record.unpackedOffset || uint64_t(mip.offset) + mip.size > uint64_t(record.unpackedOffset) + record.unpackedSize)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool assets::unpackTexture(TextureInfo* info, const char* sourcebuffer, size_t sourcesize, char* destination)
+{
+    if (!validateTextureInfo(info, sourcesize))
+    {
+        return false;
+    }
+    if (!info->records.empty())
+    {
+        for (size_t i = 0; i < info->records.size(); i++)
+        {
+            const TextureRecord& record = info->records[i];
+            if (!unpackTextureRecord(info, i, sourcebuffer + record.blobOffset, destination + record.unpackedOffset))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    else if (!info->chunks.empty())
+    {
+        Span<char> region{destination, info->textureSize};
+        return decompressChunked(sourcebuffer, sourcesize, info->chunks, info->chunkSize, &region, 1);
+    }
+    else if (info->compressionMode == CompressionMode::LZ4)
+    {
+        return LZ4_decompress_safe(sourcebuffer,destination,sourcesize,info->textureSize) == static_cast<int>(info->textureSize);
     }
     else
     {
-        memcpy(destination,sourcebuffer,sourcesize);
+        if (sourcesize < info->textureSize) return false;
+        memcpy(destination,sourcebuffer,info->textureSize);
+        return true;
     }
-}
\ No newline at end of file
+}
+bool assets::unpackTextureRecord(const TextureInfo* info, size_t record, const char* recordBlob, char* destination, ThreadPool* pool)
+{
+    const TextureRecord& textureRecord = info->records[record];
+    std::vector<uint32_t> chunks(info->chunks.begin() + textureRecord.firstChunk, info->chunks.begin() + textureRecord.firstChunk + textureRecord.chunkCount);
+    Span<char> region{destination, textureRecord.unpackedSize};
+    return decompressChunked(recordBlob, textureRecord.blobSize, chunks, info->chunkSize, &region, 1, pool);
+}
@@ -7,9 +7,49 @@ namespace assets
 	enum class TextureFormat : uint32_t
 	{
 		Unknown = 0,
-		RGBA8
+		RGBA8,
+		//4x4 blocks, see texture_compression.h
+		BC1,
+		BC3,
+		BC4,
+		BC5,
+		BC7
 	};
 
+	//name used in the json metadata and on the baker command line
+	const char* textureFormatName(TextureFormat format);
+
+	TextureFormat parseTextureFormat(const std::string& name);
+
+    //one level of the mip chain, the offset is in the unpacked texture buffer
+    struct TextureMip
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    static_assert(sizeof(TextureMip) == 16, "mips are written as is");
+
+    //run of levels compressed on their own, so it can be read and unpacked without the rest of the blob
+    //the levels that are smaller than a chunk share one record, the bigger ones get one each
+    struct TextureRecord
+    {
+        uint64_t blobOffset;
+        uint32_t blobSize;
+        uint32_t unpackedOffset;
+        uint32_t unpackedSize;
+        //range of TextureInfo::chunks
+        uint32_t firstChunk;
+        uint32_t chunkCount;
+        //range of TextureInfo::mips, the levels are contiguous in the unpacked buffer
+        uint32_t firstMip;
+        uint32_t mipCount;
+    };
+
+    static_assert(sizeof(TextureRecord) == 40, "records are written as is");
+
     struct TextureInfo
     {
         uint64_t textureSize;
@@ -17,13 +57,43 @@ namespace assets
         CompressionMode compressionMode;
         uint32_t pixelsize[3];
         std::string originalFile;
+        //compressed size of every chunk of the blob, empty for version 1 single block assets
+        uint32_t chunkSize{0};
+        std::vector<uint32_t> chunks;
+        //levels stored one after the other in the texture buffer, empty for assets baked with only the full image
+        std::vector<TextureMip> mips;
+        //independently compressed parts of the blob in file order, empty when the blob is compressed as a whole
+        std::vector<TextureRecord> records;
     };
+
+    //fixed part of the version 3 metadata, read with a single memcpy
+    struct TextureHeader
+    {
+        uint64_t textureSize;
+        TextureFormat textureFormat;
+        CompressionMode compressionMode;
+        uint32_t pixelsize[3];
+        uint32_t chunkSize;
+    };
+
+    static_assert(sizeof(TextureHeader) == 32, "texture header is written as is");
     
-    //parse the texture metadata from an asset file
+    //parse the texture metadata from an asset file, json for version 1 and 2 and binary from version 3
     TextureInfo readTextureInfo(AssetFile* file);
 
-    void unpackTexture(TextureInfo* info, const char* sourcebuffer, size_t sourceSize, char* destination);
+    TextureInfo readTextureInfo(const AssetView* view);
+
+    //checks that the mips fit in textureSize and every record in the chunk table, the blob, the texture buffer and the mips
+    //the metadata comes straight from the file, nothing should index the blob or the buffers with it before this passed
+    bool validateTextureInfo(const TextureInfo* info, size_t blobSize);
+
+    //false when the blob is truncated or corrupt, the destination is then left partially written
+    bool unpackTexture(TextureInfo* info, const char* sourcebuffer, size_t sourceSize, char* destination);
+
+    //unpacks a single record of an info that passed validateTextureInfo, recordBlob points to its blobSize compressed bytes and destination gets its unpackedSize bytes
+    bool unpackTextureRecord(const TextureInfo* info, size_t record, const char* recordBlob, char* destination, ThreadPool* pool = nullptr);
 
+    //with mips, the levels are grouped in records in the order of their offsets, so the data should hold the smallest levels first
     AssetFile packTexture(TextureInfo* info, void* pixelData);
 
 } // namespace assets
@@ -0,0 +1,784 @@
+#include "texture_compression.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+//interpolation weights of the 4 bit bc7 indices, in 64ths
+static const int BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+//least squares refinement passes of the high quality mode
+constexpr int REFINE_ITERATIONS = 2;
+
+size_t assets::blockSize(TextureFormat format)
+{
+    switch (format)
+    {
+    case TextureFormat::BC1:
+    case TextureFormat::BC4:
+        return 8;
+    case TextureFormat::BC3:
+    case TextureFormat::BC5:
+    case TextureFormat::BC7:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+size_t assets::textureLevelSize(TextureFormat format, uint32_t width, uint32_t height)
+{
+    const size_t block = blockSize(format);
+    if (block == 0)
+    {
+        return size_t(width) * height * 4;
+    }
+    return size_t((width + 3) / 4) * ((height + 3) / 4) * block;
+}
+
+//texels outside of the image repeat the last row and column, so partial blocks don't pull the endpoints away
+static void load_block(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, uint8_t block[16][4])
+{
+    for (uint32_t y = 0; y < 4; y++)
+    {
+        const uint32_t sourceY = std::min(blockY * 4 + y, height - 1);
+        for (uint32_t x = 0; x < 4; x++)
+        {
+            const uint32_t sourceX = std::min(blockX * 4 + x, width - 1);
+            memcpy(block[y * 4 + x], pixels + (size_t(sourceY) * width + sourceX) * 4, 4);
+        }
+    }
+}
+
+static void store_block(const uint8_t block[16][4], uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, uint8_t* pixels)
+{
+    for (uint32_t y = 0; y < 4 && blockY * 4 + y < height; y++)
+    {
+        for (uint32_t x = 0; x < 4 && blockX * 4 + x < width; x++)
+        {
+            memcpy(pixels + (size_t(blockY * 4 + y) * width + blockX * 4 + x) * 4, block[y * 4 + x], 4);
+        }
+    }
+}
+
+//endpoints at the extremes of the points along their principal axis, found by power iteration on the covariance
+static void principal_endpoints(const float points[16][4], int channels, float start[4], float end[4])
+{
+    float mean[4] = {};
+    float minimum[4] = {255.f, 255.f, 255.f, 255.f};
+    float maximum[4] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            mean[c] += points[i][c] / 16.f;
+            minimum[c] = std::min(minimum[c], points[i][c]);
+            maximum[c] = std::max(maximum[c], points[i][c]);
+        }
+    }
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        for (int a = 0; a < channels; a++)
+        {
+            for (int b = 0; b < channels; b++)
+            {
+                covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+            }
+        }
+    }
+
+    //the box diagonal is a good first guess and avoids starting orthogonal to the axis
+    float axis[4] = {};
+    for (int c = 0; c < channels; c++)
+    {
+        axis[c] = maximum[c] - minimum[c];
+    }
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float next[4] = {};
+        float length = 0.f;
+        for (int a = 0; a < channels; a++)
+        {
+            for (int b = 0; b < channels; b++)
+            {
+                next[a] += covariance[a][b] * axis[b];
+            }
+            length = std::max(length, std::abs(next[a]));
+        }
+        if (length < 1e-6f)
+        {
+            break;
+        }
+        for (int c = 0; c < channels; c++)
+        {
+            axis[c] = next[c] / length;
+        }
+    }
+
+    float axisLength = 0.f;
+    for (int c = 0; c < channels; c++)
+    {
+        axisLength += axis[c] * axis[c];
+    }
+    if (axisLength < 1e-12f)
+    {
+        //flat block, both endpoints are the mean
+        for (int c = 0; c < channels; c++)
+        {
+            start[c] = end[c] = mean[c];
+        }
+        return;
+    }
+
+    float low = FLT_MAX;
+    float high = -FLT_MAX;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = 0.f;
+        for (int c = 0; c < channels; c++)
+        {
+            t += (points[i][c] - mean[c]) * axis[c];
+        }
+        low = std::min(low, t);
+        high = std::max(high, t);
+    }
+    for (int c = 0; c < channels; c++)
+    {
+        start[c] = std::min(std::max(mean[c] + axis[c] * low / axisLength, 0.f), 255.f);
+        end[c] = std::min(std::max(mean[c] + axis[c] * high / axisLength, 0.f), 255.f);
+    }
+}
+
+//endpoints that minimize the squared error for the chosen indices, weights[index] is the position between start and end
+//returns false when all the texels use the same position and the system has no single solution
+static bool refine_endpoints(const float points[16][4], int channels, const uint8_t indices[16], const float* weights, float start[4], float end[4])
+{
+    float alpha2 = 0.f, beta2 = 0.f, alphaBeta = 0.f;
+    float alphaX[4] = {}, betaX[4] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        const float beta = weights[indices[i]];
+        const float alpha = 1.f - beta;
+        alpha2 += alpha * alpha;
+        beta2 += beta * beta;
+        alphaBeta += alpha * beta;
+        for (int c = 0; c < channels; c++)
+        {
+            alphaX[c] += alpha * points[i][c];
+            betaX[c] += beta * points[i][c];
+        }
+    }
+
+    const float determinant = alpha2 * beta2 - alphaBeta * alphaBeta;
+    if (std::abs(determinant) < 1e-6f)
+    {
+        return false;
+    }
+    for (int c = 0; c < channels; c++)
+    {
+        start[c] = std::min(std::max((alphaX[c] * beta2 - betaX[c] * alphaBeta) / determinant, 0.f), 255.f);
+        end[c] = std::min(std::max((betaX[c] * alpha2 - alphaX[c] * alphaBeta) / determinant, 0.f), 255.f);
+    }
+    return true;
+}
+
+//nearest palette entry of every texel, returns the total squared error
+static float choose_indices(const float points[16][4], int channels, const int palette[][4], int paletteSize, uint8_t indices[16])
+{
+    float total = 0.f;
+    for (int i = 0; i < 16; i++)
+    {
+        float best = FLT_MAX;
+        for (int p = 0; p < paletteSize; p++)
+        {
+            float error = 0.f;
+            for (int c = 0; c < channels; c++)
+            {
+                const float d = points[i][c] - palette[p][c];
+                error += d * d;
+            }
+            if (error < best)
+            {
+                best = error;
+                indices[i] = static_cast<uint8_t>(p);
+            }
+        }
+        total += best;
+    }
+    return total;
+}
+
+//BC1
+
+static uint16_t pack_565(const float color[4])
+{
+    const uint16_t r = static_cast<uint16_t>(std::lround(color[0] * 31.f / 255.f));
+    const uint16_t g = static_cast<uint16_t>(std::lround(color[1] * 63.f / 255.f));
+    const uint16_t b = static_cast<uint16_t>(std::lround(color[2] * 31.f / 255.f));
+    return static_cast<uint16_t>(r << 11 | g << 5 | b);
+}
+
+static void unpack_565(uint16_t value, int color[4])
+{
+    const int r = (value >> 11) & 31;
+    const int g = (value >> 5) & 63;
+    const int b = value & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+    color[3] = 255;
+}
+
+//bc3 color blocks always use four colors, bc1 switches to three colors and black when color0 <= color1
+static void bc1_palette(uint16_t color0, uint16_t color1, bool fourColors, int palette[4][4])
+{
+    unpack_565(color0, palette[0]);
+    unpack_565(color1, palette[1]);
+    for (int c = 0; c < 3; c++)
+    {
+        if (fourColors || color0 > color1)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+        }
+        else
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    palette[2][3] = 255;
+    palette[3][3] = (fourColors || color0 > color1) ? 255 : 0;
+}
+
+static void write_bc1(uint16_t color0, uint16_t color1, const uint8_t indices[16], uint8_t* destination)
+{
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        bits |= uint32_t(indices[i]) << (i * 2);
+    }
+    memcpy(destination, &color0, 2);
+    memcpy(destination + 2, &color1, 2);
+    memcpy(destination + 4, &bits, 4);
+}
+
+//the encoder always writes color0 >= color1, so the block decodes the same as bc1 and as the color part of bc3
+static void encode_bc1(const uint8_t block[16][4], assets::BlockQuality quality, uint8_t* destination)
+{
+    static const float weights[4] = {0.f, 1.f, 1.f / 3.f, 2.f / 3.f};
+
+    float points[16][4];
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            points[i][c] = block[i][c];
+        }
+    }
+
+    float start[4], end[4];
+    principal_endpoints(points, 3, start, end);
+
+    float bestError = FLT_MAX;
+    uint16_t bestColors[2] = {};
+    uint8_t bestIndices[16] = {};
+
+    const int iterations = quality == assets::BlockQuality::High ? REFINE_ITERATIONS + 1 : 1;
+    for (int iteration = 0; iteration < iterations; iteration++)
+    {
+        uint16_t color0 = pack_565(start);
+        uint16_t color1 = pack_565(end);
+        if (color0 < color1)
+        {
+            std::swap(color0, color1);
+        }
+
+        int palette[4][4];
+        bc1_palette(color0, color1, true, palette);
+        uint8_t indices[16];
+        //equal colors are three color blocks, only the first entry is safe to use
+        const float error = choose_indices(points, 3, palette, color0 == color1 ? 1 : 4, indices);
+        if (error < bestError)
+        {
+            bestError = error;
+            bestColors[0] = color0;
+            bestColors[1] = color1;
+            memcpy(bestIndices, indices, 16);
+        }
+
+        //the refined endpoints are in palette order, start is color0
+        if (bestError == 0.f || !refine_endpoints(points, 3, indices, weights, start, end))
+        {
+            break;
+        }
+    }
+
+    write_bc1(bestColors[0], bestColors[1], bestIndices, destination);
+}
+
+static void decode_bc1(const uint8_t* source, bool fourColors, uint8_t block[16][4])
+{
+    uint16_t color0, color1;
+    uint32_t bits;
+    memcpy(&color0, source, 2);
+    memcpy(&color1, source + 2, 2);
+    memcpy(&bits, source + 4, 4);
+
+    int palette[4][4];
+    bc1_palette(color0, color1, fourColors, palette);
+    for (int i = 0; i < 16; i++)
+    {
+        const int index = (bits >> (i * 2)) & 3;
+        for (int c = 0; c < 4; c++)
+        {
+            block[i][c] = static_cast<uint8_t>(palette[index][c]);
+        }
+    }
+}
+
+//BC4
+
+//eight interpolated values when value0 > value1, else six with 0 and 255 at the end
+static void bc4_palette(int value0, int value1, int palette[8][4])
+{
+    palette[0][0] = value0;
+    palette[1][0] = value1;
+    if (value0 > value1)
+    {
+        for (int i = 1; i < 7; i++)
+        {
+            palette[i + 1][0] = ((7 - i) * value0 + i * value1 + 3) / 7;
+        }
+    }
+    else
+    {
+        for (int i = 1; i < 5; i++)
+        {
+            palette[i + 1][0] = ((5 - i) * value0 + i * value1 + 2) / 5;
+        }
+        palette[6][0] = 0;
+        palette[7][0] = 255;
+    }
+}
+
+static void write_bc4(int value0, int value1, const uint8_t indices[16], uint8_t* destination)
+{
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        bits |= uint64_t(indices[i]) << (i * 3);
+    }
+    destination[0] = static_cast<uint8_t>(value0);
+    destination[1] = static_cast<uint8_t>(value1);
+    for (int i = 0; i < 6; i++)
+    {
+        destination[2 + i] = static_cast<uint8_t>(bits >> (i * 8));
+    }
+}
+
+static void encode_bc4(const uint8_t block[16][4], int channel, assets::BlockQuality quality, uint8_t* destination)
+{
+    float points[16][4];
+    int minimum = 255, maximum = 0;
+    //the six value mode gets 0 and 255 for free, so its endpoints only have to cover the values in between
+    int innerMinimum = 255, innerMaximum = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        const int value = block[i][channel];
+        points[i][0] = static_cast<float>(value);
+        minimum = std::min(minimum, value);
+        maximum = std::max(maximum, value);
+        if (value != 0 && value != 255)
+        {
+            innerMinimum = std::min(innerMinimum, value);
+            innerMaximum = std::max(innerMaximum, value);
+        }
+    }
+
+    int palette[8][4];
+    uint8_t indices[16];
+    bc4_palette(maximum, minimum, palette);
+    float bestError = choose_indices(points, 1, palette, maximum > minimum ? 8 : 1, indices);
+    int best[2] = {maximum, minimum};
+    uint8_t bestIndices[16];
+    memcpy(bestIndices, indices, 16);
+
+    if (quality == assets::BlockQuality::High && bestError > 0.f)
+    {
+        if (innerMinimum > innerMaximum)
+        {
+            innerMinimum = innerMaximum = 0;
+        }
+        bc4_palette(innerMinimum, innerMaximum, palette);
+        const float error = choose_indices(points, 1, palette, 8, indices);
+        if (error < bestError)
+        {
+            bestError = error;
+            best[0] = innerMinimum;
+            best[1] = innerMaximum;
+            memcpy(bestIndices, indices, 16);
+        }
+    }
+
+    write_bc4(best[0], best[1], bestIndices, destination);
+}
+
+static void decode_bc4(const uint8_t* source, int channel, uint8_t block[16][4])
+{
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; i++)
+    {
+        bits |= uint64_t(source[2 + i]) << (i * 8);
+    }
+
+    int palette[8][4];
+    bc4_palette(source[0], source[1], palette);
+    for (int i = 0; i < 16; i++)
+    {
+        block[i][channel] = static_cast<uint8_t>(palette[(bits >> (i * 3)) & 7][0]);
+    }
+}
+
+//BC7 mode 6, one subset of rgba endpoints with 7 bits and a shared lowest bit each, and 4 bit indices
+
+struct Bc7Endpoint
+{
+    int values[4];
+    int pbit;
+};
+
+//7 bit endpoint with the p-bit that keeps it closest to the float one
+static Bc7Endpoint quantize_bc7(const float color[4], int pbit)
+{
+    Bc7Endpoint endpoint;
+    endpoint.pbit = pbit;
+    for (int c = 0; c < 4; c++)
+    {
+        endpoint.values[c] = std::min(std::max(static_cast<int>(std::lround((color[c] - pbit) / 2.f)), 0), 127);
+    }
+    return endpoint;
+}
+
+static float bc7_quantization_error(const float color[4], const Bc7Endpoint& endpoint)
+{
+    float error = 0.f;
+    for (int c = 0; c < 4; c++)
+    {
+        const float d = color[c] - float(endpoint.values[c] << 1 | endpoint.pbit);
+        error += d * d;
+    }
+    return error;
+}
+
+static void bc7_palette(const Bc7Endpoint& start, const Bc7Endpoint& end, int palette[16][4])
+{
+    for (int c = 0; c < 4; c++)
+    {
+        const int a = start.values[c] << 1 | start.pbit;
+        const int b = end.values[c] << 1 | end.pbit;
+        for (int i = 0; i < 16; i++)
+        {
+            palette[i][c] = ((64 - BC7_WEIGHTS[i]) * a + BC7_WEIGHTS[i] * b + 32) >> 6;
+        }
+    }
+}
+
+//projects every texel on the endpoint segment and only compares the nearest weights to it, instead of the whole palette
+static float choose_bc7_indices(const float points[16][4], const int palette[16][4], uint8_t indices[16])
+{
+    float direction[4];
+    float lengthSquared = 0.f;
+    for (int c = 0; c < 4; c++)
+    {
+        direction[c] = float(palette[15][c] - palette[0][c]);
+        lengthSquared += direction[c] * direction[c];
+    }
+    if (lengthSquared == 0.f)
+    {
+        return choose_indices(points, 4, palette, 1, indices);
+    }
+
+    float total = 0.f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = 0.f;
+        for (int c = 0; c < 4; c++)
+        {
+            t += (points[i][c] - palette[0][c]) * direction[c];
+        }
+        const int weight = static_cast<int>(std::min(std::max(t / lengthSquared, 0.f), 1.f) * 64.f + 0.5f);
+        const int guess = static_cast<int>(std::lower_bound(BC7_WEIGHTS, BC7_WEIGHTS + 16, weight) - BC7_WEIGHTS);
+
+        //the rounding of the palette can make a neighbour of the projected weight slightly closer
+        float best = FLT_MAX;
+        for (int p = std::max(guess - 1, 0); p <= std::min(guess + 1, 15); p++)
+        {
+            float error = 0.f;
+            for (int c = 0; c < 4; c++)
+            {
+                const float d = points[i][c] - palette[p][c];
+                error += d * d;
+            }
+            if (error < best)
+            {
+                best = error;
+                indices[i] = static_cast<uint8_t>(p);
+            }
+        }
+        total += best;
+    }
+    return total;
+}
+
+struct BitWriter
+{
+    uint64_t words[2] = {};
+    int position = 0;
+
+    void write(uint32_t value, int count)
+    {
+        for (int i = 0; i < count; i++, position++)
+        {
+            words[position / 64] |= uint64_t((value >> i) & 1) << (position % 64);
+        }
+    }
+};
+
+struct BitReader
+{
+    uint64_t words[2] = {};
+    int position = 0;
+
+    uint32_t read(int count)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < count; i++, position++)
+        {
+            value |= uint32_t((words[position / 64] >> (position % 64)) & 1) << i;
+        }
+        return value;
+    }
+};
+
+static void write_bc7_mode6(Bc7Endpoint start, Bc7Endpoint end, uint8_t indices[16], uint8_t* destination)
+{
+    //the top bit of the first index is implied 0, so the endpoints are swapped when it would be set
+    if (indices[0] >= 8)
+    {
+        std::swap(start, end);
+        for (int i = 0; i < 16; i++)
+        {
+            indices[i] = static_cast<uint8_t>(15 - indices[i]);
+        }
+    }
+
+    BitWriter writer;
+    writer.write(1 << 6, 7);
+    for (int c = 0; c < 4; c++)
+    {
+        writer.write(start.values[c], 7);
+        writer.write(end.values[c], 7);
+    }
+    writer.write(start.pbit, 1);
+    writer.write(end.pbit, 1);
+    writer.write(indices[0], 3);
+    for (int i = 1; i < 16; i++)
+    {
+        writer.write(indices[i], 4);
+    }
+    memcpy(destination, writer.words, 16);
+}
+
+static void encode_bc7(const uint8_t block[16][4], assets::BlockQuality quality, uint8_t* destination)
+{
+    float weights[16];
+    for (int i = 0; i < 16; i++)
+    {
+        weights[i] = BC7_WEIGHTS[i] / 64.f;
+    }
+
+    float points[16][4];
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            points[i][c] = block[i][c];
+        }
+    }
+
+    float start[4], end[4];
+    principal_endpoints(points, 4, start, end);
+
+    float bestError = FLT_MAX;
+    Bc7Endpoint best[2] = {};
+    uint8_t bestIndices[16] = {};
+
+    const bool high = quality == assets::BlockQuality::High;
+    const int iterations = high ? REFINE_ITERATIONS + 1 : 1;
+    for (int iteration = 0; iteration < iterations; iteration++)
+    {
+        //the fast mode only tries the p-bits closest to each endpoint
+        const int combinations = high ? 4 : 1;
+        for (int combination = 0; combination < combinations; combination++)
+        {
+            Bc7Endpoint quantizedStart = quantize_bc7(start, combination & 1);
+            Bc7Endpoint quantizedEnd = quantize_bc7(end, combination >> 1);
+            if (!high)
+            {
+                const Bc7Endpoint oddStart = quantize_bc7(start, 1);
+                const Bc7Endpoint oddEnd = quantize_bc7(end, 1);
+                if (bc7_quantization_error(start, oddStart) < bc7_quantization_error(start, quantizedStart)) quantizedStart = oddStart;
+                if (bc7_quantization_error(end, oddEnd) < bc7_quantization_error(end, quantizedEnd)) quantizedEnd = oddEnd;
+            }
+
+            uint8_t indices[16];
+
+            int palette[16][4];
+            bc7_palette(quantizedStart, quantizedEnd, palette);
+            const float error = choose_bc7_indices(points, palette, indices);
+            if (error < bestError)
+            {
+                bestError = error;
+                best[0] = quantizedStart;
+                best[1] = quantizedEnd;
+                memcpy(bestIndices, indices, 16);
+            }
+        }
+
+        if (iteration + 1 == iterations || bestError == 0.f || !refine_endpoints(points, 4, bestIndices, weights, start, end))
+        {
+            break;
+        }
+    }
+
+    write_bc7_mode6(best[0], best[1], bestIndices, destination);
+}
+
+static void decode_bc7(const uint8_t* source, uint8_t block[16][4])
+{
+    BitReader reader;
+    memcpy(reader.words, source, 16);
+    if (reader.read(7) != 1 << 6)
+    {
+        memset(block, 0, 16 * 4);
+        for (int i = 0; i < 16; i++)
+        {
+            block[i][3] = 255;
+        }
+        return;
+    }
+
+    Bc7Endpoint start, end;
+    for (int c = 0; c < 4; c++)
+    {
+        start.values[c] = reader.read(7);
+        end.values[c] = reader.read(7);
+    }
+    start.pbit = reader.read(1);
+    end.pbit = reader.read(1);
+
+    int palette[16][4];
+    bc7_palette(start, end, palette);
+    for (int i = 0; i < 16; i++)
+    {
+        const uint32_t index = reader.read(i == 0 ? 3 : 4);
+        for (int c = 0; c < 4; c++)
+        {
+            block[i][c] = static_cast<uint8_t>(palette[index][c]);
+        }
+    }
+}
+
+void assets::compressBlocks(const uint8_t* pixels, uint32_t width, uint32_t height, TextureFormat format, BlockQuality quality, uint8_t* destination, ThreadPool* pool)
+{
+    const size_t block = blockSize(format);
+    if (block == 0 || width == 0 || height == 0)
+    {
+        return;
+    }
+
+    const uint32_t blocksX = (width + 3) / 4;
+    const uint32_t blocksY = (height + 3) / 4;
+    ThreadPool& workers = pool ? *pool : ThreadPool::get();
+    workers.parallel_for(blocksY, [&](size_t blockY){
+        uint8_t texels[16][4];
+        uint8_t* output = destination + blockY * blocksX * block;
+        for (uint32_t blockX = 0; blockX < blocksX; blockX++, output += block)
+        {
+            load_block(pixels, width, height, blockX, static_cast<uint32_t>(blockY), texels);
+            switch (format)
+            {
+            case TextureFormat::BC1:
+                encode_bc1(texels, quality, output);
+                break;
+            case TextureFormat::BC3:
+                encode_bc4(texels, 3, quality, output);
+                encode_bc1(texels, quality, output + 8);
+                break;
+            case TextureFormat::BC4:
+                encode_bc4(texels, 0, quality, output);
+                break;
+            case TextureFormat::BC5:
+                encode_bc4(texels, 0, quality, output);
+                encode_bc4(texels, 1, quality, output + 8);
+                break;
+            case TextureFormat::BC7:
+                encode_bc7(texels, quality, output);
+                break;
+            default:
+                break;
+            }
+        }
+    });
+}
+
+void assets::decompressBlocks(const uint8_t* blocks, uint32_t width, uint32_t height, TextureFormat format, uint8_t* destination, ThreadPool* pool)
+{
+    const size_t block = blockSize(format);
+    if (block == 0 || width == 0 || height == 0)
+    {
+        return;
+    }
+
+    const uint32_t blocksX = (width + 3) / 4;
+    const uint32_t blocksY = (height + 3) / 4;
+    ThreadPool& workers = pool ? *pool : ThreadPool::get();
+    workers.parallel_for(blocksY, [&](size_t blockY){
+        const uint8_t* input = blocks + blockY * blocksX * block;
+        for (uint32_t blockX = 0; blockX < blocksX; blockX++, input += block)
+        {
+            uint8_t texels[16][4] = {};
+            for (int i = 0; i < 16; i++)
+            {
+                texels[i][3] = 255;
+            }
+            switch (format)
+            {
+            case TextureFormat::BC1:
+                decode_bc1(input, false, texels);
+                break;
+            case TextureFormat::BC3:
+                decode_bc1(input + 8, true, texels);
+                decode_bc4(input, 3, texels);
+                break;
+            case TextureFormat::BC4:
+                decode_bc4(input, 0, texels);
+                break;
+            case TextureFormat::BC5:
+                decode_bc4(input, 0, texels);
+                decode_bc4(input + 8, 1, texels);
+                break;
+            case TextureFormat::BC7:
+                decode_bc7(input, texels);
+                break;
+            default:
+                break;
+            }
+            store_block(texels, width, height, blockX, static_cast<uint32_t>(blockY), destination);
+        }
+    });
+}
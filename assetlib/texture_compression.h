@@ -0,0 +1,31 @@
+#pragma once
+
+#include "texture_asset.h"
+
+namespace assets
+{
+    class ThreadPool;
+
+    enum class BlockQuality : uint32_t
+    {
+        //endpoints straight from the principal axis of the block
+        Fast = 0,
+        //least squares refinement of the endpoints and every bc7 p-bit combination
+        High
+    };
+
+    //bytes of a 4x4 block, 0 for the uncompressed formats
+    size_t blockSize(TextureFormat format);
+
+    //bytes of a level of the given size, partial blocks at the edges count as whole ones
+    size_t textureLevelSize(TextureFormat format, uint32_t width, uint32_t height);
+
+    //encodes an rgba8 level, rows of blocks are spread over the pool
+    //bc4 keeps the red channel and bc5 red and green, bc7 only uses mode 6
+    void compressBlocks(const uint8_t* pixels, uint32_t width, uint32_t height, TextureFormat format, BlockQuality quality, uint8_t* destination, ThreadPool* pool = nullptr);
+
+    //decodes a level back to rgba8, for devices that can't sample the block formats
+    //missing channels are 0 and alpha 255, bc7 blocks in modes other than 6 decode as black
+    void decompressBlocks(const uint8_t* blocks, uint32_t width, uint32_t height, TextureFormat format, uint8_t* destination, ThreadPool* pool = nullptr);
+
+} // namespace assets
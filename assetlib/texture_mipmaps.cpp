@@ -0,0 +1,262 @@
+#include "texture_mipmaps.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+#include <xmmintrin.h>
+#define MIPMAP_SSE 1
+#endif
+
+//a texel is 4 floats, so a whole rgba texel fits in one sse register
+#ifdef MIPMAP_SSE
+typedef __m128 Pixel;
+
+static inline Pixel load_pixel(const float* p) { return _mm_loadu_ps(p); }
+static inline void store_pixel(float* p, Pixel v) { _mm_storeu_ps(p, v); }
+static inline Pixel zero_pixel() { return _mm_setzero_ps(); }
+static inline Pixel madd_pixel(Pixel sum, Pixel v, float weight) { return _mm_add_ps(sum, _mm_mul_ps(v, _mm_set1_ps(weight))); }
+static inline Pixel saturate_pixel(Pixel v) { return _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.f)); }
+#else
+struct Pixel
+{
+    float v[4];
+};
+
+static inline Pixel load_pixel(const float* p) { return Pixel{{p[0], p[1], p[2], p[3]}}; }
+static inline void store_pixel(float* p, Pixel v) { std::copy(v.v, v.v + 4, p); }
+static inline Pixel zero_pixel() { return Pixel{}; }
+static inline Pixel madd_pixel(Pixel sum, Pixel v, float weight)
+{
+    for (int i = 0; i < 4; i++) sum.v[i] += v.v[i] * weight;
+    return sum;
+}
+static inline Pixel saturate_pixel(Pixel v)
+{
+    for (int i = 0; i < 4; i++) v.v[i] = std::min(std::max(v.v[i], 0.f), 1.f);
+    return v;
+}
+#endif
+
+//half width of the kaiser window, in texels of the smaller level
+constexpr float KAISER_RADIUS = 3.f;
+constexpr float KAISER_ALPHA = 4.f;
+//the linear to srgb table is indexed with 16 bits, fine enough for the darkest values where the curve is steepest
+constexpr uint32_t LINEAR_TO_SRGB_SIZE = 1 << 16;
+
+static float srgb_to_linear(float c)
+{
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linear_to_srgb(float c)
+{
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+}
+
+struct SrgbTables
+{
+    float toLinear[256];
+    uint8_t toSrgb[LINEAR_TO_SRGB_SIZE];
+
+    SrgbTables()
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            toLinear[i] = srgb_to_linear(i / 255.f);
+        }
+        for (uint32_t i = 0; i < LINEAR_TO_SRGB_SIZE; i++)
+        {
+            toSrgb[i] = static_cast<uint8_t>(std::lround(linear_to_srgb(i / float(LINEAR_TO_SRGB_SIZE - 1)) * 255.f));
+        }
+    }
+};
+
+static const SrgbTables& srgb_tables()
+{
+    static SrgbTables tables;
+    return tables;
+}
+
+//zeroth order modified bessel function, the series converges quickly for the small arguments of the window
+static double bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static float kaiser_sinc(float t)
+{
+    const float x = t / KAISER_RADIUS;
+    if (std::abs(x) >= 1.f)
+    {
+        return 0.f;
+    }
+    const float pi = 3.14159265358979f;
+    const float sinc = t == 0.f ? 1.f : std::sin(pi * t) / (pi * t);
+    const double window = bessel_i0(KAISER_ALPHA * std::sqrt(1.0 - x * x)) / bessel_i0(KAISER_ALPHA);
+    return sinc * static_cast<float>(window);
+}
+
+struct FilterTap
+{
+    uint32_t index;
+    float weight;
+};
+
+//taps of every destination texel along one axis, destination i uses taps[first[i]] to taps[first[i + 1]]
+struct FilterKernel
+{
+    std::vector<uint32_t> first;
+    std::vector<FilterTap> taps;
+};
+
+static FilterKernel build_kernel(uint32_t sourceSize, uint32_t destinationSize, assets::MipFilter filter)
+{
+    FilterKernel kernel;
+    const float scale = float(sourceSize) / float(destinationSize);
+    const float halfWidth = filter == assets::MipFilter::Kaiser ? KAISER_RADIUS * scale : 0.5f * scale;
+
+    for (uint32_t i = 0; i < destinationSize; i++)
+    {
+        kernel.first.push_back(static_cast<uint32_t>(kernel.taps.size()));
+
+        const float center = (i + 0.5f) * scale;
+        const int begin = static_cast<int>(std::floor(center - halfWidth));
+        const int end = static_cast<int>(std::ceil(center + halfWidth));
+        const size_t firstTap = kernel.taps.size();
+        float total = 0.f;
+        for (int s = begin; s < end; s++)
+        {
+            float weight;
+            if (filter == assets::MipFilter::Kaiser)
+            {
+                weight = kaiser_sinc((s + 0.5f - center) / scale);
+            }
+            else
+            {
+                //coverage of the source texel by the destination one, exact for odd sizes too
+                weight = std::max(0.f, std::min(float(s + 1), center + halfWidth) - std::max(float(s), center - halfWidth));
+            }
+            if (weight == 0.f)
+            {
+                continue;
+            }
+
+            //the edges are clamped, so texels outside of the image count as the border one
+            const uint32_t index = static_cast<uint32_t>(std::min(std::max(s, 0), int(sourceSize) - 1));
+            if (kernel.taps.size() > firstTap && kernel.taps.back().index == index)
+            {
+                kernel.taps.back().weight += weight;
+            }
+            else
+            {
+                kernel.taps.push_back({index, weight});
+            }
+            total += weight;
+        }
+        for (size_t t = firstTap; t < kernel.taps.size(); t++)
+        {
+            kernel.taps[t].weight /= total;
+        }
+    }
+    kernel.first.push_back(static_cast<uint32_t>(kernel.taps.size()));
+    return kernel;
+}
+
+//separable resize of a linear float image, rows first then columns
+static void downsample(const std::vector<float>& source, uint32_t width, uint32_t height, uint32_t newWidth, uint32_t newHeight,
+    assets::MipFilter filter, std::vector<float>& rows, std::vector<float>& destination)
+{
+    const FilterKernel horizontal = build_kernel(width, newWidth, filter);
+    const FilterKernel vertical = build_kernel(height, newHeight, filter);
+
+    rows.resize(size_t(newWidth) * height * 4);
+    for (uint32_t y = 0; y < height; y++)
+    {
+        const float* sourceRow = source.data() + size_t(y) * width * 4;
+        float* row = rows.data() + size_t(y) * newWidth * 4;
+        for (uint32_t x = 0; x < newWidth; x++)
+        {
+            Pixel sum = zero_pixel();
+            for (uint32_t t = horizontal.first[x]; t < horizontal.first[x + 1]; t++)
+            {
+                sum = madd_pixel(sum, load_pixel(sourceRow + horizontal.taps[t].index * 4), horizontal.taps[t].weight);
+            }
+            store_pixel(row + x * 4, sum);
+        }
+    }
+
+    //the columns are accumulated a whole row at a time, so the reads stay sequential
+    destination.assign(size_t(newWidth) * newHeight * 4, 0.f);
+    for (uint32_t y = 0; y < newHeight; y++)
+    {
+        float* destinationRow = destination.data() + size_t(y) * newWidth * 4;
+        for (uint32_t t = vertical.first[y]; t < vertical.first[y + 1]; t++)
+        {
+            const float* row = rows.data() + size_t(vertical.taps[t].index) * newWidth * 4;
+            const float weight = vertical.taps[t].weight;
+            for (uint32_t x = 0; x < newWidth; x++)
+            {
+                store_pixel(destinationRow + x * 4, madd_pixel(load_pixel(destinationRow + x * 4), load_pixel(row + x * 4), weight));
+            }
+        }
+        //the negative lobes of the kaiser filter can overshoot
+        for (uint32_t x = 0; x < newWidth; x++)
+        {
+            store_pixel(destinationRow + x * 4, saturate_pixel(load_pixel(destinationRow + x * 4)));
+        }
+    }
+}
+
+std::vector<assets::TextureMip> assets::generateMipmaps(const uint8_t* pixels, uint32_t width, uint32_t height, MipFilter filter, bool srgb, std::vector<uint8_t>& outPixels)
+{
+    std::vector<TextureMip> mips;
+    const size_t baseSize = size_t(width) * height * 4;
+    mips.push_back({width, height, 0, static_cast<uint32_t>(baseSize)});
+    outPixels.assign(pixels, pixels + baseSize);
+
+    if (filter == MipFilter::None || width == 0 || height == 0)
+    {
+        return mips;
+    }
+
+    const SrgbTables& tables = srgb_tables();
+
+    //every level is filtered from the previous one, kept in float so the rounding does not add up along the chain
+    std::vector<float> level(baseSize);
+    for (size_t i = 0; i < baseSize; i++)
+    {
+        level[i] = (srgb && i % 4 != 3) ? tables.toLinear[pixels[i]] : pixels[i] / 255.f;
+    }
+
+    std::vector<float> rows;
+    std::vector<float> next;
+    while (width > 1 || height > 1)
+    {
+        const uint32_t newWidth = std::max(width / 2, 1u);
+        const uint32_t newHeight = std::max(height / 2, 1u);
+        downsample(level, width, height, newWidth, newHeight, filter, rows, next);
+
+        const size_t size = size_t(newWidth) * newHeight * 4;
+        const size_t offset = outPixels.size();
+        outPixels.resize(offset + size);
+        for (size_t i = 0; i < size; i++)
+        {
+            const float value = next[i];
+            outPixels[offset + i] = (srgb && i % 4 != 3) ? tables.toSrgb[static_cast<uint32_t>(value * (LINEAR_TO_SRGB_SIZE - 1) + 0.5f)]
+                : static_cast<uint8_t>(value * 255.f + 0.5f);
+        }
+        mips.push_back({newWidth, newHeight, static_cast<uint32_t>(offset), static_cast<uint32_t>(size)});
+
+        level.swap(next);
+        width = newWidth;
+        height = newHeight;
+    }
+    return mips;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "texture_asset.h"
+
+namespace assets
+{
+    enum class MipFilter : uint32_t
+    {
+        //single level, the mip chain is not generated
+        None = 0,
+        //average of the texels covered by the smaller texel
+        Box,
+        //windowed sinc, sharper than the box filter without its aliasing
+        Kaiser
+    };
+
+    //generates the full mip chain of an rgba8 image down to 1x1, all the levels are written one after the other in outPixels
+    //with srgb the color channels are filtered in linear space and converted back, alpha is always linear
+    //returns the offset and size of every level, the first one being the image itself
+    std::vector<TextureMip> generateMipmaps(const uint8_t* pixels, uint32_t width, uint32_t height, MipFilter filter, bool srgb, std::vector<uint8_t>& outPixels);
+
+} // namespace assets
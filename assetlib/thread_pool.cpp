@@ -0,0 +1,114 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <memory>
+
+uint32_t assets::ThreadPool::default_worker_count()
+{
+    uint32_t hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+}
+
+assets::ThreadPool::ThreadPool(uint32_t workerCount)
+{
+    _workers.reserve(workerCount);
+    for (uint32_t i = 0; i < workerCount; i++)
+    {
+        _workers.emplace_back([this](){ worker_loop(); });
+    }
+}
+
+assets::ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _condition.notify_all();
+
+    for (auto& worker : _workers)
+    {
+        worker.join();
+    }
+}
+
+assets::ThreadPool& assets::ThreadPool::get()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void assets::ThreadPool::push(std::function<void()>&& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _jobs.push_back(std::move(job));
+    }
+    _condition.notify_one();
+}
+
+void assets::ThreadPool::worker_loop()
+{
+    while (true)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock, [this](){ return _stop || !_jobs.empty(); });
+            if (_stop && _jobs.empty()) return;
+
+            job = std::move(_jobs.front());
+            _jobs.pop_front();
+        }
+        job();
+    }
+}
+
+void assets::ThreadPool::parallel_for(size_t count, const std::function<void(size_t)>& function)
+{
+    if (count == 0) return;
+    if (count == 1)
+    {
+        function(0);
+        return;
+    }
+
+    //helpers can start after this call returned when the workers are busy, so the state they touch is shared
+    struct State
+    {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        size_t count;
+        const std::function<void(size_t)>* function;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    auto state = std::make_shared<State>();
+    state->count = count;
+    state->function = &function;
+
+    auto work = [](State& s){
+        size_t i;
+        while ((i = s.next.fetch_add(1)) < s.count)
+        {
+            (*s.function)(i);
+            if (s.done.fetch_add(1) + 1 == s.count)
+            {
+                std::lock_guard<std::mutex> lock(s.mutex);
+                s.finished.notify_all();
+            }
+        }
+    };
+
+    size_t helpers = std::min<size_t>(_workers.size(), count - 1);
+    for (size_t h = 0; h < helpers; h++)
+    {
+        //late helpers find no index left and never dereference the function
+        push([state, work](){ work(*state); });
+    }
+
+    work(*state);
+
+    //only indices already taken by running threads can be pending here
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&](){ return state->done.load() == count; });
+}
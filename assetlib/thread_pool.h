@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace assets
+{
+    //fixed set of worker threads consuming a FIFO of jobs
+    class ThreadPool
+    {
+    public:
+        //with 0 workers parallel_for runs everything on the calling thread
+        explicit ThreadPool(uint32_t workerCount = default_worker_count());
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        //shared pool used by the asset functions when none is given
+        static ThreadPool& get();
+
+        void push(std::function<void()>&& job);
+
+        //calls function(i) for every i in [0,count) and returns once all of them are done
+        //the calling thread takes part in the work, so it is safe to call from inside a job
+        void parallel_for(size_t count, const std::function<void(size_t)>& function);
+
+        uint32_t workerCount() const { return static_cast<uint32_t>(_workers.size()); }
+
+        //one worker per hardware thread, minus the calling thread
+        static uint32_t default_worker_count();
+
+    private:
+        void worker_loop();
+
+        std::vector<std::thread> _workers;
+        std::deque<std::function<void()>> _jobs;
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        bool _stop{false};
+    };
+
+} // namespace assets
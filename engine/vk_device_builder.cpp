@@ -21,7 +21,7 @@ void VulkanDeviceBuilder::createLogicalDevice()
 {
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {_physicalDevice._graphicsQueueFamily,_physicalDevice._presentQueueFamily};
+    std::set<uint32_t> uniqueQueueFamilies = {_physicalDevice._graphicsQueueFamily,_physicalDevice._presentQueueFamily,_physicalDevice._transferQueueFamily};
 
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies)
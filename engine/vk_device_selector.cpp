@@ -43,6 +43,9 @@ VulkanDeviceSelector& VulkanDeviceSelector::select()
         QueueFamilyIndices indices = findQueueFamilies(_value._device);
         _value._graphicsQueueFamily = indices.graphicsFamily.value();
         _value._presentQueueFamily = indices.presentFamily.value();
+        //graphics families can copy any region
+        _value._transferGranularity = {1, 1, 1};
+        _value._transferQueueFamily = findDedicatedTransferFamily(_value._device, _value._transferGranularity).value_or(_value._graphicsQueueFamily);
         vkGetPhysicalDeviceProperties(_value._device,&_value._properties);
         vkGetPhysicalDeviceFeatures(_value._device,&_value._features);
         _value._extensions = _deviceExtensions;
@@ -198,6 +201,25 @@ VulkanDeviceSelector::QueueFamilyIndices VulkanDeviceSelector::findQueueFamilies
     return indices;
 }
 
+std::optional<uint32_t> VulkanDeviceSelector::findDedicatedTransferFamily(VkPhysicalDevice device, VkExtent3D& outGranularity)
+{
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+    for (uint32_t i = 0; i < queueFamilyCount; i++)
+    {
+        const VkQueueFlags flags = queueFamilies[i].queueFlags;
+        const VkExtent3D granularity = queueFamilies[i].minImageTransferGranularity;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) && granularity.width > 0 && granularity.height > 0)
+        {
+            outGranularity = granularity;
+            return i;
+        }
+    }
+    return std::nullopt;
+}
 
 bool VulkanDeviceSelector::checkDeviceExtensionSupport(VkPhysicalDevice device)
 {
@@ -54,6 +54,10 @@ private:
 
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
 
+    //the copy engine of discrete gpus, its queue runs the uploads next to the rendering
+    //families that can only copy whole levels are skipped, the uploads split the big levels in rows
+    std::optional<uint32_t> findDedicatedTransferFamily(VkPhysicalDevice device, VkExtent3D& outGranularity);
+
     bool checkDeviceExtensionSupport(VkPhysicalDevice device);
 
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
@@ -11,10 +11,16 @@
 #include <imgui_impl_vulkan.h>
 
 #include <vk_initializers.h>
+#include <thread_pool.h>
 
 #include <iostream>
 #include <fstream>
 #include <functional>
+#include <tuple>
+#include <filesystem>
+#include <algorithm>
+#include <future>
+#include <memory>
 
 #include <glm/gtx/transform.hpp>
 #include <glm/gtx/string_cast.hpp>
@@ -39,6 +45,32 @@ constexpr bool enableValidationLayers = true;
 #endif
 
 AutoCVar_Int CVAR_OutputIndirectToFile("culling.outputIndirectBufferToFile", "output the indirect data to a file. Autoresets", 0, CVarFlags::EditCheckBox);
+AutoCVar_Int CVAR_ObjectCulling("culling.objects", "skip the objects whose bounding sphere is outside of the frustum", 1, CVarFlags::EditCheckBox);
+AutoCVar_Int CVAR_MeshletCulling("culling.meshlets", "cull the meshlets of the meshes that have some in a compute pass, instead of drawing them whole", 1, CVarFlags::EditCheckBox);
+AutoCVar_Float CVAR_LodPixelError("lod.pixelError", "largest error in pixels a lower level of detail can add on screen", 1.0, CVarFlags::EditFloatDrag);
+AutoCVar_Int CVAR_StagingSize("upload.stagingSize", "size in MB of the staging ring every upload goes through, read at startup", 64, CVarFlags::EditReadOnly);
+AutoCVar_Int CVAR_GeometryBlockSize("geometry.blockSize", "size in MB of the buffers the vertices and the indices of the meshes are sub-allocated from, read at startup", 64, CVarFlags::EditReadOnly);
+AutoCVar_Int CVAR_GeometryCompaction("geometry.compaction", "move the live vertices and indices down into the holes the freed meshes leave in the geometry blocks", 1, CVarFlags::EditCheckBox);
+AutoCVar_Int CVAR_GeometryCompactionBudget("geometry.compactionBudget", "size in MB of the vertices and indices the compaction copies per frame", 8);
+AutoCVar_Float CVAR_LodHysteresis("lod.hysteresis", "fraction of the pixel error an object has to move past before it changes level", 0.25, CVarFlags::EditFloatDrag);
+
+
+//separate files of the levels of detail of a mesh, level 1 is the first one after the full mesh
+static std::string mesh_lod_path(const std::string& basePath, int level)
+{
+	return basePath + ".lod" + std::to_string(level) + ".mesh";
+}
+
+//the float format keeps the plain material names
+static std::string material_variant_name(const std::string& name, assets::VertexFormat format)
+{
+	switch (format)
+	{
+	case assets::VertexFormat::PNV_Q16: return name + "_PNV_Q16";
+	case assets::VertexFormat::PNCV_Q16: return name + "_PNCV_Q16";
+	default: return name;
+	}
+}
 
 
 #pragma region init
@@ -52,55 +84,100 @@ void VulkanEngine::init()
 {	
 	ZoneScopedN("Engine Init");
 	LOG_TRACE("Engine Init");
-	// We initialize SDL and create a window with it.
-	SDL_Init(SDL_INIT_VIDEO);
+	_startupTimeline.start = StartupTimeline::Clock::now();
 
-	SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN);
+	//the asset files don't need the device, they are read and decompressed on the workers while vulkan initializes
+	begin_asset_loads();
 
-	_window = SDL_CreateWindow(
-		"Vulkan Engine",
-		SDL_WINDOWPOS_UNDEFINED,
-		SDL_WINDOWPOS_UNDEFINED,
-		_windowExtent.width,
-		_windowExtent.height,
-		window_flags);
+	//every phase of the main thread is a zone of the startup timeline, the workers add theirs as they finish
+	auto phase = [this](const char* name, const std::function<void()>& function){
+		ZoneTransientN(zone, name, true);
+		const auto begin = StartupTimeline::Clock::now();
+		function();
+		_startupTimeline.add(name, begin);
+	};
+
+	phase("Create window", [&](){
+		// We initialize SDL and create a window with it.
+		SDL_Init(SDL_INIT_VIDEO);
+
+		SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN);
+
+		_window = SDL_CreateWindow(
+			"Vulkan Engine",
+			SDL_WINDOWPOS_UNDEFINED,
+			SDL_WINDOWPOS_UNDEFINED,
+			_windowExtent.width,
+			_windowExtent.height,
+			window_flags);
+	});
 
 	_renderables.reserve(10000);
 	// load the core vulkan structures
-	init_vulkan();
+	phase("Init vulkan", [&](){
+		init_vulkan();
 
-	_profiler = vkutil::VulkanProfiler();
+		_profiler = vkutil::VulkanProfiler();
 
-	PROFILER_CHECK(_profiler.init(_device, _gpuProperties.limits.timestampPeriod));
+		PROFILER_CHECK(_profiler.init(_device, _gpuProperties.limits.timestampPeriod));
+	});
 	
 	// create the swapchain
-	init_swapchain();
+	phase("Init swapchain", [&](){ init_swapchain(); });
+
+	phase("Init commands", [&](){ init_commands(); });
 
-	init_commands();
+	phase("Init render pass", [&](){
+		init_default_renderpass();
 
-	init_default_renderpass();
+		init_framebuffers();
+	});
+
+	phase("Init sync structures", [&](){ init_sync_structures(); });
 
-	init_framebuffers();
+	phase("Init descriptors", [&](){ init_descriptors(); });
 
-	init_sync_structures();
+	//only starts the builds, they run on the workers next to the uploads
+	phase("Start pipelines", [&](){ init_pipelines(); });
 
-	init_descriptors();
+	phase("Init imgui", [&](){ init_imgui(); });
 
-	init_pipelines();
+	phase("Load textures", [&](){ load_images(); });
 
-	init_imgui();
+	phase("Load meshes", [&](){ load_meshes(); });
 
-	load_images();
+	phase("Wait pipelines", [&](){ finish_pipelines(); });
 
-	load_meshes();
+	phase("Init scene", [&](){ init_scene(); });
 
-	init_scene();
+	//every asset of the scene goes in one batch, the first frame is the first to wait for it
+	phase("Flush uploads", [&](){ _uploadQueue.flush(); });
+
+	_startupTimeline.log();
 
 	// everything went fine
 	_isInitialized = true;
 }
 
+void VulkanEngine::StartupTimeline::add(const char* name, Clock::time_point begin)
+{
+	const Clock::time_point end = Clock::now();
+	std::lock_guard<std::mutex> lock(mutex);
+	phases.push_back({name, begin, end});
+}
+
+void VulkanEngine::StartupTimeline::log()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::sort(phases.begin(), phases.end(), [](const Phase& a, const Phase& b){ return a.begin < b.begin; });
 
+	auto milliseconds = [](Clock::duration duration){ return std::chrono::duration<double, std::milli>(duration).count(); };
+	LOG_INFO("Engine initialized in {:.1f} ms", milliseconds(Clock::now() - start));
+	for (const Phase& phase : phases)
+	{
+		LOG_INFO("    {:>8.1f} ms +{:>7.1f} ms  {}", milliseconds(phase.begin - start), milliseconds(phase.end - phase.begin), phase.name);
+	}
+}
 
 void VulkanEngine::init_vulkan()
 {
@@ -148,6 +225,14 @@ void VulkanEngine::init_vulkan()
     vkGetDeviceQueue(_device, _graphicsQueueFamily, 0, &_graphicsQueue);
     vkGetDeviceQueue(_device, _presentQueueFamily, 0, &_presentQueue);
 
+	_transferQueueFamily = physicalDevice._transferQueueFamily;
+	_transferGranularity = physicalDevice._transferGranularity;
+	vkGetDeviceQueue(_device, _transferQueueFamily, 0, &_transferQueue);
+	if (_transferQueueFamily != _graphicsQueueFamily)
+	{
+		LOG_INFO("Uploads use the dedicated transfer queue family {}", _transferQueueFamily);
+	}
+
 	//initialize the memory allocator
 	VmaAllocatorCreateInfo allocatorInfo{};
 	allocatorInfo.physicalDevice = _chosenGPU;
@@ -160,6 +245,11 @@ void VulkanEngine::init_vulkan()
 	});
 
 	_gpuProperties = physicalDevice._properties;
+	_gpuFeatures = physicalDevice._features;
+	if (!_gpuFeatures.drawIndirectFirstInstance)
+	{
+		LOG_INFO("The GPU can't offset the instances of indirect draws, the meshlets are not culled");
+	}
 
 	LOG_INFO("The GPU has a minimum buffer alignment of {}", _gpuProperties.limits.minUniformBufferOffsetAlignment);
 }
@@ -314,6 +404,36 @@ void VulkanEngine::init_commands()
 
 	VkCommandBufferAllocateInfo cmdAllocInfo = vkinit::command_buffer_allocate_info(_uploadContext._commandPool,1);
 	VK_CHECK(vkAllocateCommandBuffers(_device,&cmdAllocInfo,&_uploadContext._commandBuffer));
+
+	//the copy offsets of the block compressed levels have to be multiples of their block size, the queue aligns to 16 at least
+	const size_t stagingSize = static_cast<size_t>(std::max(CVAR_StagingSize.Get(), 1)) * 1024 * 1024;
+	_uploadQueue.init(_device, _allocator, _graphicsQueue, _graphicsQueueFamily, _transferQueue, _transferQueueFamily, _transferGranularity,
+		stagingSize, _gpuProperties.limits.optimalBufferCopyOffsetAlignment);
+
+	_mainDeletionQueue.push_function([=](){
+		_uploadQueue.cleanup();
+	});
+
+	//one set of blocks per vertex format, so vertexOffset always counts whole vertices of the bound block
+	//the blocks are shared with the transfer queue, the uploads of the ranges of a block in use need no ownership transfer
+	const size_t blockSize = static_cast<size_t>(std::max(CVAR_GeometryBlockSize.Get(), 1)) * 1024 * 1024;
+	const std::vector<uint32_t> geometryFamilies = {_graphicsQueueFamily, _transferQueueFamily};
+	for (assets::VertexFormat format : {assets::VertexFormat::PNCV_F32, assets::VertexFormat::PNV_Q16, assets::VertexFormat::PNCV_Q16})
+	{
+		const size_t vertexSize = assets::vertexFormatSize(format);
+		vertex_arena(format).init(_allocator, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, static_cast<uint32_t>(vertexSize), static_cast<uint32_t>(blockSize / vertexSize), 1, geometryFamilies);
+	}
+	//the culling pass binds the index range of a mesh as a storage buffer, so the ranges start at the storage offset alignment
+	const uint32_t indexAlignment = static_cast<uint32_t>(std::max<VkDeviceSize>(_gpuProperties.limits.minStorageBufferOffsetAlignment / sizeof(uint32_t), 1));
+	_indexArena.init(_allocator, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t), static_cast<uint32_t>(blockSize / sizeof(uint32_t)), indexAlignment, geometryFamilies);
+
+	_mainDeletionQueue.push_function([=](){
+		for (vkutil::GeometryArena& arena : _vertexArenas)
+		{
+			arena.cleanup();
+		}
+		_indexArena.cleanup();
+	});
 }
 
 void VulkanEngine::init_default_renderpass()
@@ -561,6 +681,22 @@ void VulkanEngine::init_descriptors()
 
 	_singleTextureSetLayout = _descriptorLayoutCache.createDescriptorLayout(&set3info);
 
+	//the culling outputs and the mesh inputs are both a pair of storage buffers
+	VkDescriptorSetLayoutBinding cullingBindings[] = {
+		vkinit::descriptorset_layout_binding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,0),
+		vkinit::descriptorset_layout_binding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT,1)
+	};
+
+	VkDescriptorSetLayoutCreateInfo cullingSetInfo{};
+	cullingSetInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	cullingSetInfo.pNext = nullptr;
+	cullingSetInfo.bindingCount = 2;
+	cullingSetInfo.pBindings = cullingBindings;
+	cullingSetInfo.flags = 0;
+
+	_cullingSetLayout = _descriptorLayoutCache.createDescriptorLayout(&cullingSetInfo);
+	_meshletSetLayout = _descriptorLayoutCache.createDescriptorLayout(&cullingSetInfo);
+
 	for (int i = 0; i < FRAME_OVERLAP; i++)
 	{
 		const int MAX_OBJECTS = 10000;
@@ -568,6 +704,9 @@ void VulkanEngine::init_descriptors()
 		_frames[i]._instanceBuffer = create_buffer(sizeof(uint32_t) * MAX_OBJECTS,VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,VMA_MEMORY_USAGE_CPU_TO_GPU);
 
 		_frames[i]._cameraBuffer = create_buffer(sizeof(GPUCameraData),VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+		//the commands are reset by the cpu every frame before the culling shader counts the visible indices in them
+		_frames[i]._indirectBuffer = create_buffer(sizeof(VkDrawIndexedIndirectCommand) * MAX_CULLED_DRAWS,VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,VMA_MEMORY_USAGE_CPU_TO_GPU);
 	
 		//allocate one descriptor set for each frame
 		_descriptorAllocator.allocate(&_frames[i]._globalDescriptor,_globalSetLayout);
@@ -621,50 +760,61 @@ void VulkanEngine::init_descriptors()
 			vmaDestroyBuffer(_allocator,_frames[i]._cameraBuffer._buffer,_frames[i]._cameraBuffer._allocation);			
 			vmaDestroyBuffer(_allocator,_frames[i]._objectBuffer._buffer,_frames[i]._objectBuffer._allocation);			
 			vmaDestroyBuffer(_allocator,_frames[i]._instanceBuffer._buffer,_frames[i]._instanceBuffer._allocation);			
+			vmaDestroyBuffer(_allocator,_frames[i]._indirectBuffer._buffer,_frames[i]._indirectBuffer._allocation);
+			//the culled index buffer is reallocated as it grows, this destroys the last one
+			vmaDestroyBuffer(_allocator,_frames[i]._culledIndexBuffer._buffer,_frames[i]._culledIndexBuffer._allocation);
 		}	
 	});
 }
 
 void VulkanEngine::init_pipelines()
 {
-	VkShaderModule triangleFragShader;
-	if (!load_shader_module("colored_triangle.frag", &triangleFragShader))
-	{
-		LOG_ERROR("Error when building the triangle fragment shader module.");
-	}
-	else
-	{
-		LOG_SUCCESS("Triangle fragment shader successfully loaded.");
-	}
+	//the pipelines only need the render pass and the set layouts, the drivers compile them on the workers while the assets upload
+	auto built = std::make_shared<std::promise<void>>();
+	_pipelinesBuilt = built->get_future();
+	assets::ThreadPool::get().push([this, built](){
+		const auto begin = StartupTimeline::Clock::now();
+		build_pipelines();
+		_startupTimeline.add("Build pipelines", begin);
+		built->set_value();
+	});
+}
 
-	VkShaderModule triangleVertexShader;
-	if (!load_shader_module("colored_triangle.vert", &triangleVertexShader))
-	{
-		LOG_ERROR("Error when building the triangle vertex shader module");
-	}
-	else
-	{
-		LOG_SUCCESS("Triangle vertex shader successfully loaded.");
-	}
-	VkShaderModule redTriangleFragShader;
-	if (!load_shader_module("triangle.frag", &redTriangleFragShader))
-	{
-		LOG_ERROR("Error when building the triangle fragment shader module.");
-	}
-	else
-	{
-		LOG_SUCCESS("Red Triangle fragment shader successfully loaded.");
-	}
+void VulkanEngine::add_built_pipeline(VkPipeline pipeline, VkPipelineLayout layout, const std::string& material)
+{
+	std::lock_guard<std::mutex> lock(_builtPipelinesMutex);
+	_builtPipelines.push_back({pipeline, layout, material});
+}
 
-	VkShaderModule redTriangleVertexShader;
-	if (!load_shader_module("triangle.vert", &redTriangleVertexShader))
-	{
-		LOG_ERROR("Error when building the triangle vertex shader module");
-	}
-	else
+void VulkanEngine::build_pipelines()
+{
+	ZoneScopedNC("Build pipelines", tracy::Color::Purple);
+
+	//the modules are read in parallel too, they are only needed until the pipelines are built
+	const char* shaderFiles[] = {"colored_triangle.frag", "colored_triangle.vert", "triangle.frag", "triangle.vert",
+		"tri_mesh.vert", "default_lit.frag", "textured_lit.frag", "meshlet_cull.comp"};
+	constexpr size_t shaderCount = sizeof(shaderFiles) / sizeof(shaderFiles[0]);
+	VkShaderModule shaders[shaderCount];
+	bool shaderLoaded[shaderCount];
+	assets::ThreadPool::get().parallel_for(shaderCount, [&](size_t i){
+		shaderLoaded[i] = load_shader_module(shaderFiles[i], &shaders[i]);
+	});
+	for (size_t i = 0; i < shaderCount; i++)
 	{
-		LOG_SUCCESS("Red Triangle vertex shader successfully loaded.");
+		if (!shaderLoaded[i])
+		{
+			LOG_ERROR("Error when building the shader module {}", shaderFiles[i]);
+			shaders[i] = VK_NULL_HANDLE;
+		}
 	}
+	const VkShaderModule triangleFragShader = shaders[0];
+	const VkShaderModule triangleVertexShader = shaders[1];
+	const VkShaderModule redTriangleFragShader = shaders[2];
+	const VkShaderModule redTriangleVertexShader = shaders[3];
+	const VkShaderModule meshVertShader = shaders[4];
+	const VkShaderModule meshFragShader = shaders[5];
+	const VkShaderModule texturedFragShader = shaders[6];
+	const VkShaderModule meshletCullShader = shaders[7];
 	
 	//build the pipeline layout that controls the inputs/outputs of the shader
 	//we are not using descriptor sets or other systems yet, so no need to use anything than empty default
@@ -674,16 +824,48 @@ void VulkanEngine::init_pipelines()
 
 	VK_CHECK(vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &trianglePipelineLayout));
 
-	//build the stage create info for both vertex and fragment stages.
-	PipelineBuilder pipelineBuilder;
+	//create the mesh pipeline layout
+	VkPipelineLayoutCreateInfo meshPipelineLayoutInfo = vkinit::pipeline_layout_create_info();
+
+	VkDescriptorSetLayout setLayouts[] = {_globalSetLayout, _objectSetLayout};
+
+	meshPipelineLayoutInfo.setLayoutCount = 2;
+	meshPipelineLayoutInfo.pSetLayouts = setLayouts;
+
+	VkPipelineLayout meshPipelineLayout;
+
+	VK_CHECK(vkCreatePipelineLayout(_device,&meshPipelineLayoutInfo,nullptr,&meshPipelineLayout));
+
+	//create pipeline layout for the textured mesh which has 3 descriptor sets
+	VkPipelineLayoutCreateInfo texturedPipelineLayoutInfo = meshPipelineLayoutInfo;
+
+	VkDescriptorSetLayout texturedSetLayouts[] = {_globalSetLayout, _objectSetLayout, _singleTextureSetLayout};
+
+	texturedPipelineLayoutInfo.setLayoutCount = 3;
+	texturedPipelineLayoutInfo.pSetLayouts = texturedSetLayouts;
 
-	pipelineBuilder._shaderStages.push_back(
-		vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_VERTEX_BIT,triangleVertexShader)
-	);
+	VkPipelineLayout texturedPipeLayout;
+	VK_CHECK(vkCreatePipelineLayout(_device,&texturedPipelineLayoutInfo,nullptr,&texturedPipeLayout));
+
+	VkPushConstantRange cullConstants{};
+	cullConstants.offset = 0;
+	cullConstants.size = sizeof(MeshletCullConstants);
+	cullConstants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayout cullSetLayouts[] = {_cullingSetLayout, _meshletSetLayout};
 
-	pipelineBuilder._shaderStages.push_back(
-		vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_FRAGMENT_BIT,triangleFragShader)
-	);
+	VkPipelineLayoutCreateInfo cullLayoutInfo = vkinit::pipeline_layout_create_info();
+	cullLayoutInfo.setLayoutCount = 2;
+	cullLayoutInfo.pSetLayouts = cullSetLayouts;
+	cullLayoutInfo.pushConstantRangeCount = 1;
+	cullLayoutInfo.pPushConstantRanges = &cullConstants;
+
+	VK_CHECK(vkCreatePipelineLayout(_device,&cullLayoutInfo,nullptr,&_meshletCullLayout));
+
+	_builtPipelineLayouts = {trianglePipelineLayout, meshPipelineLayout, texturedPipeLayout};
+
+	//state shared by every graphics pipeline, each build copies it and sets its shaders and vertex input
+	PipelineBuilder pipelineBuilder;
 
 	//vertex input controls how to read vertices from vertex buffers, not used yet
 	pipelineBuilder._vertexInputInfo = vkinit::vertex_input_state_create_info();
@@ -711,286 +893,518 @@ void VulkanEngine::init_pipelines()
 	//a single blend attachment with no blending and writing to RGBA 
 	pipelineBuilder._colorBlendAttachment = vkinit::color_blend_attachment_state();
 
-	//use the triangle layout
-	pipelineBuilder._pipelineLayout = trianglePipelineLayout;
-
 	//add depth testing
 	pipelineBuilder._depthStencil = vkinit::depth_stencil_create_info(true,true,VK_COMPARE_OP_LESS_OR_EQUAL);
 
-	//build the pipeline
-	VkPipeline trianglePipeline = pipelineBuilder.build_pipeline(_device,_renderPass);
-
-	create_material(trianglePipeline,trianglePipelineLayout,"triangle");
+	//one job per pipeline, the driver compiles them on separate workers
+	std::vector<std::function<void()>> builds;
 
-	//clear the shader stages for the builder
-	pipelineBuilder._shaderStages.clear();
-
-	//add the other shaders
-	pipelineBuilder._shaderStages.push_back(
-		vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_VERTEX_BIT,redTriangleVertexShader)
-	);
-	pipelineBuilder._shaderStages.push_back(
-		vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_FRAGMENT_BIT,redTriangleFragShader)
-	);
+	//the triangle pipelines use the triangle layout
+	builds.push_back([=](){
+		PipelineBuilder builder = pipelineBuilder;
+		builder._pipelineLayout = trianglePipelineLayout;
+		builder._shaderStages.push_back(vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_VERTEX_BIT,triangleVertexShader));
+		builder._shaderStages.push_back(vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_FRAGMENT_BIT,triangleFragShader));
+		add_built_pipeline(builder.build_pipeline(_device,_renderPass),trianglePipelineLayout,"triangle");
+	});
+	builds.push_back([=](){
+		PipelineBuilder builder = pipelineBuilder;
+		builder._pipelineLayout = trianglePipelineLayout;
+		builder._shaderStages.push_back(vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_VERTEX_BIT,redTriangleVertexShader));
+		builder._shaderStages.push_back(vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_FRAGMENT_BIT,redTriangleFragShader));
+		add_built_pipeline(builder.build_pipeline(_device,_renderPass),trianglePipelineLayout,"red triangle");
+	});
 
-	VkPipeline redTrianglePipeline = pipelineBuilder.build_pipeline(_device,_renderPass);
+	//one mesh pipeline and one textured pipeline per vertex format, tri_mesh.vert is specialized for each of them
+	const assets::VertexFormat meshFormats[] = {assets::VertexFormat::PNCV_F32, assets::VertexFormat::PNV_Q16, assets::VertexFormat::PNCV_Q16};
+	for (assets::VertexFormat format : meshFormats)
+	{
+		for (bool textured : {false, true})
+		{
+			builds.push_back([=](){
+				VertexInputDescription vertexDescription = Vertex::get_vertex_description(format);
+
+				PipelineBuilder builder = pipelineBuilder;
+
+				//connect the pipeline builder vertex input info to the one we get from Vertex
+				builder._vertexInputInfo.pVertexAttributeDescriptions = vertexDescription.attributes.data();
+				builder._vertexInputInfo.vertexAttributeDescriptionCount = vertexDescription.attributes.size();
+
+				builder._vertexInputInfo.pVertexBindingDescriptions = vertexDescription.bindings.data();
+				builder._vertexInputInfo.vertexBindingDescriptionCount = vertexDescription.bindings.size();
+
+				//QUANTIZED and HAS_COLOR constants of the vertex shader
+				VkBool32 constants[2] = {format != assets::VertexFormat::PNCV_F32, format != assets::VertexFormat::PNV_Q16};
+				VkSpecializationMapEntry entries[2] = {{0, 0, sizeof(VkBool32)}, {1, sizeof(VkBool32), sizeof(VkBool32)}};
+				VkSpecializationInfo specialization{};
+				specialization.mapEntryCount = 2;
+				specialization.pMapEntries = entries;
+				specialization.dataSize = sizeof(constants);
+				specialization.pData = constants;
+
+				VkPipelineShaderStageCreateInfo vertexStage = vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_VERTEX_BIT,meshVertShader);
+				vertexStage.pSpecializationInfo = &specialization;
+
+				builder._shaderStages.push_back(vertexStage);
+				builder._shaderStages.push_back(
+					vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_FRAGMENT_BIT,textured ? texturedFragShader : meshFragShader)
+				);
+				builder._pipelineLayout = textured ? texturedPipeLayout : meshPipelineLayout;
+
+				//the default material uses the mesh pipeline, the textured ones are created per texture from the textured pipeline
+				add_built_pipeline(builder.build_pipeline(_device,_renderPass),builder._pipelineLayout,
+					material_variant_name(textured ? "texturedmesh" : "defaultmesh", format));
+			});
+		}
+	}
 
-	create_material(redTrianglePipeline,trianglePipelineLayout,"red triangle");
-	//create the mesh pipeline layout
-	VkPipelineLayoutCreateInfo meshPipelineLayoutInfo = vkinit::pipeline_layout_create_info();
+	//meshlet culling compute pipeline
+	builds.push_back([=](){
+		VkComputePipelineCreateInfo cullPipelineInfo{};
+		cullPipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		cullPipelineInfo.pNext = nullptr;
+		cullPipelineInfo.stage = vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_COMPUTE_BIT,meshletCullShader);
+		cullPipelineInfo.layout = _meshletCullLayout;
 
-	//TODO: remove
-	//setup push constants
-	// VkPushConstantRange pushConstant;
-	// //this push constant range starts at the beginning
-	// pushConstant.offset = 0;
-	// //this push constant range takes up the size of a meshpushconstants struct
-	// pushConstant.size = sizeof(MeshPushConstants);
-	// //this push constant range is accessible only in the vertex shader
-	// pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		VK_CHECK(vkCreateComputePipelines(_device,VK_NULL_HANDLE,1,&cullPipelineInfo,nullptr,&_meshletCullPipeline));
+	});
 
-	// meshPipelineLayoutInfo.pPushConstantRanges = &pushConstant;
-	// meshPipelineLayoutInfo.pushConstantRangeCount = 1;
+	assets::ThreadPool::get().parallel_for(builds.size(), [&](size_t i){
+		builds[i]();
+	});
 
-	VkDescriptorSetLayout setLayouts[] = {_globalSetLayout, _objectSetLayout};
+	for (VkShaderModule shader : shaders)
+	{
+		vkDestroyShaderModule(_device,shader,nullptr);
+	}
+}
 
-	meshPipelineLayoutInfo.setLayoutCount = 2;
-	meshPipelineLayoutInfo.pSetLayouts = setLayouts;
+void VulkanEngine::finish_pipelines()
+{
+	_pipelinesBuilt.wait();
 
-	VkPipelineLayout meshPipelineLayout;
+	//the materials map is only touched by the main thread, they are created once every pipeline is built
+	for (const BuiltPipeline& built : _builtPipelines)
+	{
+		create_material(built.pipeline,built.layout,built.material);
+	}
 
-	VK_CHECK(vkCreatePipelineLayout(_device,&meshPipelineLayoutInfo,nullptr,&meshPipelineLayout));
+	std::vector<BuiltPipeline> pipelines = std::move(_builtPipelines);
+	std::vector<VkPipelineLayout> layouts = std::move(_builtPipelineLayouts);
+	_mainDeletionQueue.push_function([=](){
+		for (const BuiltPipeline& built : pipelines)
+		{
+			vkDestroyPipeline(_device,built.pipeline,nullptr);
+		}
+		for (VkPipelineLayout layout : layouts)
+		{
+			vkDestroyPipelineLayout(_device,layout,nullptr);
+		}
 
-	//build the mesh pipeline
-	
-	VertexInputDescription vertexDescription = Vertex::get_vertex_description();
+		vkDestroyPipeline(_device,_meshletCullPipeline,nullptr);
+		vkDestroyPipelineLayout(_device,_meshletCullLayout,nullptr);
+	});
+}
 
-	//connect the pipeline builder vertex input info to the one we get from Vertex
-	pipelineBuilder._vertexInputInfo.pVertexAttributeDescriptions = vertexDescription.attributes.data();
-	pipelineBuilder._vertexInputInfo.vertexAttributeDescriptionCount = vertexDescription.attributes.size();
-	
-	pipelineBuilder._vertexInputInfo.pVertexBindingDescriptions = vertexDescription.bindings.data();
-	pipelineBuilder._vertexInputInfo.vertexBindingDescriptionCount = vertexDescription.bindings.size();
+void VulkanEngine::load_meshes()
+{
+	ZoneScopedNC("Upload Mesh", tracy::Color::Orange);
 
-	//clear the shader stages for the builder
-	pipelineBuilder._shaderStages.clear();
+	//the meshes are loaded in place in the registry, so their vectors are never copied
+	//the scene only draws them, none of them keeps a cpu copy of its geometry
+	Mesh& triangleMesh = _meshes["triangle"];
+	//make the array 3 vertices long
+	triangleMesh._vertices.resize(3);
 
-	//compile mesh vertex shader
+	//vertex positions
+	triangleMesh._vertices[0].position = {1.f,1.f,0.f};
+	triangleMesh._vertices[1].position = {-1.f,1.f,0.f};
+	triangleMesh._vertices[2].position = {0.f,-1.f,0.f};
 
-	VkShaderModule meshVertShader;
-	if (!load_shader_module("tri_mesh.vert",&meshVertShader))
-	{
-		LOG_ERROR("Error when building the triangle vertex shader module");
-	}
-	else
-	{
-		LOG_SUCCESS("Mesh Triangle vertex shader successfully loaded");
-	}
+	//vertex colors all green
+	triangleMesh._vertices[0].color = {0.f,1.f,0.f};
+	triangleMesh._vertices[1].color = {0.f,1.f,0.f};
+	triangleMesh._vertices[2].color = {0.f,1.f,0.f};
 
-	VkShaderModule meshFragShader;
-	if (!load_shader_module("default_lit.frag",&meshFragShader))
-	{
-		LOG_ERROR("Error when building the triangle vertex shader module");
-	}
-	else
+	//the files were read and decompressed on the workers since the start of init, only the copies are left
 	{
-		LOG_SUCCESS("Mesh Triangle fragment shader successfully loaded");
+		ZoneScopedNC("Wait mesh unpacks", tracy::Color::Red);
+		const auto begin = StartupTimeline::Clock::now();
+		_startupMeshesUnpacked.wait();
+		_startupTimeline.add("Wait mesh unpacks", begin);
 	}
 
-	//add the other shaders
-	pipelineBuilder._shaderStages.push_back(
-		vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_VERTEX_BIT,meshVertShader)
-	);
+	load_mesh(_assetsPath+"monkey_smooth.mesh", _meshes["monkey"], MeshResidency::GpuOnly);
+	load_mesh(_assetsPath+"lost_empire.mesh", _meshes["empire"], MeshResidency::GpuOnly);
 
-	//make sure that triangleFragShader is holding the compiled colored_triangle.frag
-	pipelineBuilder._shaderStages.push_back(
-		vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_FRAGMENT_BIT,meshFragShader)
-	);
+	//no vertex normals for now
+	upload_mesh(triangleMesh);
 
-	pipelineBuilder._pipelineLayout = meshPipelineLayout;
+	load_mesh_lods("monkey", _assetsPath + "monkey_smooth");
+	load_mesh_lods("empire", _assetsPath + "lost_empire");
 
-	//build the mesh triangle pipeline
-	VkPipeline meshPipeline = pipelineBuilder.build_pipeline(_device,_renderPass);
+	load_materials(_assetsPath + "lost_empire.mat");
+}
 
-	//create a default material with the mesh pipeline
-	create_material(meshPipeline,meshPipelineLayout, "defaultmesh");
+void VulkanEngine::begin_asset_loads()
+{
+	ZoneScopedNC("Begin asset loads", tracy::Color::Magenta);
 
-	//textured pipeline
-	VkShaderModule texturedFragShader;
-	if (!load_shader_module("textured_lit.frag",&texturedFragShader))
+	//the levels of detail are found now, so they are read in the same batch as their meshes
+	std::vector<std::string> paths;
+	for (const char* name : {"monkey_smooth", "lost_empire"})
 	{
-		LOG_ERROR("Error when building the textured mesh shader");
+		const std::string basePath = _assetsPath + name;
+		paths.push_back(basePath + ".mesh");
+		for (int level = 1; std::filesystem::exists(mesh_lod_path(basePath, level)); level++)
+		{
+			paths.push_back(mesh_lod_path(basePath, level));
+		}
 	}
-	else
+
+	//the entries exist before the job starts, so the workers only look them up
+	for (const std::string& path : paths)
 	{
-		LOG_SUCCESS("Textured mesh fragment shader successfully loaded");
+		_startupMeshes[path].filename = path;
 	}
 
+	auto unpacked = std::make_shared<std::promise<void>>();
+	_startupMeshesUnpacked = unpacked->get_future();
+	assets::ThreadPool::get().push([this, paths, unpacked](){
+		std::vector<std::vector<char>> files;
+		{
+			ZoneScopedNC("Read mesh files", tracy::Color::Magenta);
+			const auto begin = StartupTimeline::Clock::now();
+			//a missing file is reported when its mesh is uploaded
+			_assetIO.readFiles(paths, files)->wait();
+			_startupTimeline.add("Read mesh files", begin);
+		}
 
-	//create pipeline layout for the textured mesh which has 3 descriptor sets
-	VkPipelineLayoutCreateInfo texturedPipelineLayoutInfo = meshPipelineLayoutInfo;
+		{
+			ZoneScopedNC("Unpack mesh files", tracy::Color::Magenta);
+			const auto begin = StartupTimeline::Clock::now();
+			assets::ThreadPool::get().parallel_for(paths.size(), [&](size_t i){
+				vkutil::unpack_mesh_asset(files[i].data(), files[i].size(), _startupMeshes.at(paths[i]));
+			});
+			_startupTimeline.add("Unpack mesh files", begin);
+		}
+		unpacked->set_value();
+	});
+}
 
-	VkDescriptorSetLayout texturedSetLayouts[] = {_globalSetLayout, _objectSetLayout, _singleTextureSetLayout};
+bool VulkanEngine::load_mesh(const std::string& path, Mesh& outMesh, MeshResidency residency)
+{
+	outMesh._residency = residency;
+	auto unpacked = _startupMeshes.find(path);
+	if (unpacked == _startupMeshes.end())
+	{
+		return vkutil::load_mesh_from_asset(*this, path, outMesh);
+	}
 
-	texturedPipelineLayoutInfo.setLayoutCount = 3;
-	texturedPipelineLayoutInfo.pSetLayouts = texturedSetLayouts;
+	const bool loaded = vkutil::upload_mesh_asset(*this, unpacked->second, outMesh);
+	_startupMeshes.erase(unpacked);
+	return loaded;
+}
 
-	VkPipelineLayout texturedPipeLayout;
-	VK_CHECK(vkCreatePipelineLayout(_device,&texturedPipelineLayoutInfo,nullptr,&texturedPipeLayout));
+void VulkanEngine::load_mesh_lods(const std::string& name, const std::string& basePath)
+{
+	Mesh* mesh = get_mesh(name);
+	if (mesh == nullptr || mesh->_lods.empty())
+	{
+		return;
+	}
 
-	pipelineBuilder._pipelineLayout = texturedPipeLayout;
+	for (int level = 1; ; level++)
+	{
+		const std::string path = mesh_lod_path(basePath, level);
+		if (!std::filesystem::exists(path))
+		{
+			break;
+		}
 
-	pipelineBuilder._shaderStages.clear();
-	pipelineBuilder._shaderStages.push_back(
-		vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_VERTEX_BIT,meshVertShader)
-	);
+		//the level lives in the map next to its mesh, so the pointer the mesh keeps stays valid
+		const std::string lodName = name + ".lod" + std::to_string(level);
+		Mesh& lodMesh = _meshes[lodName];
+		//the levels keep the same copies as their mesh
+		const bool loaded = load_mesh(path, lodMesh, mesh->_residency);
+		if (!loaded || lodMesh._lods.empty())
+		{
+			if (loaded)
+			{
+				release_mesh_geometry(lodMesh);
+			}
+			_meshes.erase(lodName);
+			break;
+		}
 
-	pipelineBuilder._shaderStages.push_back(
-		vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_FRAGMENT_BIT,texturedFragShader)
-	);
+		//separate files do not store how far they are from the full mesh, so the error is estimated from the growth of the average edge length
+		const float fullTriangles = static_cast<float>(mesh->_lods[0].indexCount / 3);
+		const float lodTriangles = static_cast<float>(std::max<uint32_t>(lodMesh._lods[0].indexCount / 3, 1));
+		const float error = mesh->_boundsRadius * std::max(1.f / std::sqrt(lodTriangles) - 1.f / std::sqrt(fullTriangles), 0.f);
 
-	VkPipeline texPipeline = pipelineBuilder.build_pipeline(_device,_renderPass);
+		if (!mesh->add_lod(lodMesh, error))
+		{
+			LOG_ERROR("Could not use {} as a level of detail of {}", path, name);
+		}
+	}
+}
 
-	create_material(texPipeline,texturedPipeLayout,"texturedmesh");
+void VulkanEngine::upload_mesh(Mesh& mesh)
+{
+	const size_t verticesBufferSize = mesh._vertices.size() * sizeof(Vertex);
+	const size_t indicesBufferSize = mesh._indices.size() * sizeof(uint32_t);
 
+	//same layout as the asset vertices, so the bounds are computed the same way as the baker does
+	if (mesh._boundsRadius == 0.f && !mesh._vertices.empty())
+	{
+		assets::MeshBounds bounds = assets::calculateBounds(reinterpret_cast<assets::Vertex*>(mesh._vertices.data()), mesh._vertices.size());
+		mesh._boundsCenter = glm::vec3(bounds.origin[0], bounds.origin[1], bounds.origin[2]);
+		mesh._boundsRadius = bounds.radius;
+	}
 
-	vkDestroyShaderModule(_device,texturedFragShader,nullptr);
-	vkDestroyShaderModule(_device,meshFragShader,nullptr);
-	vkDestroyShaderModule(_device,meshVertShader,nullptr);
-	vkDestroyShaderModule(_device,redTriangleVertexShader,nullptr);
-	vkDestroyShaderModule(_device, redTriangleFragShader,nullptr);
-	vkDestroyShaderModule(_device, triangleVertexShader,nullptr);
-	vkDestroyShaderModule(_device, triangleFragShader,nullptr);
+	//the draws and the stats read the counts, the vectors can be released after
+	mesh._vertexCount = static_cast<uint32_t>(mesh._vertices.size());
+	mesh._indexCount = static_cast<uint32_t>(mesh._indices.size());
+	if (!mesh.on_gpu())
+	{
+		return;
+	}
 
-	_mainDeletionQueue.push_function([=](){
-		//destroy the 2 pipelines we have created
-		vkDestroyPipeline(_device,redTrianglePipeline,nullptr);
-		vkDestroyPipeline(_device,trianglePipeline,nullptr);
-		vkDestroyPipeline(_device,meshPipeline,nullptr);
-		vkDestroyPipeline(_device,texPipeline,nullptr);
-
-		//destroy the pipeline layout that they use
-		vkDestroyPipelineLayout(_device, trianglePipelineLayout,nullptr);
-		vkDestroyPipelineLayout(_device, meshPipelineLayout,nullptr);
-		vkDestroyPipelineLayout(_device, texturedPipeLayout,nullptr);
-	});
+	//the vertices then the indices, in the staging ring
+	vkutil::StagingAllocation staging = _uploadQueue.allocate_staging(verticesBufferSize + indicesBufferSize);
+	memcpy(staging.data, mesh._vertices.data(),verticesBufferSize);
+	memcpy(staging.data + verticesBufferSize, mesh._indices.data(),indicesBufferSize);
+
+	upload_mesh(mesh, staging, verticesBufferSize, indicesBufferSize);
 
+	if (mesh._residency == MeshResidency::GpuOnly)
+	{
+		mesh.release_cpu_geometry();
+	}
 }
 
-void VulkanEngine::load_meshes()
+void VulkanEngine::upload_mesh(Mesh& mesh, const vkutil::StagingAllocation& staging, size_t verticesBufferSize, size_t indicesBufferSize, size_t meshletsBufferSize)
 {
-	ZoneScopedNC("Upload Mesh", tracy::Color::Orange);
+	//the vertices and indices go in ranges of the arenas, only the meshlets get a buffer of their own
+	vkutil::GeometryArena& vertexArena = vertex_arena(mesh._vertexFormat);
+	const size_t vertexSize = assets::vertexFormatSize(mesh._vertexFormat);
+	if (!vertexArena.allocate(static_cast<uint32_t>(verticesBufferSize / vertexSize), mesh._vertexRange)
+		|| (indicesBufferSize > 0 && !_indexArena.allocate(static_cast<uint32_t>(indicesBufferSize / sizeof(uint32_t)), mesh._indexRange)))
+	{
+		LOG_FATAL("Could not allocate the geometry blocks of a mesh");
+		abort();
+	}
 
-	Mesh triangleMesh;
-	//make the array 3 vertices long
-	triangleMesh._vertices.resize(3);
+	//meshes without a lod chain draw their whole index buffer
+	if (mesh._lods.empty() && indicesBufferSize > 0)
+	{
+		mesh.add_lod(0, static_cast<uint32_t>(indicesBufferSize / sizeof(uint32_t)), 0.f);
+	}
 
-	//vertex positions
-	triangleMesh._vertices[0].position = {1.f,1.f,0.f};
-	triangleMesh._vertices[1].position = {-1.f,1.f,0.f};
-	triangleMesh._vertices[2].position = {0.f,-1.f,0.f};
+	if (meshletsBufferSize > 0)
+	{
+		VmaAllocationCreateInfo vmaallocInfo{};
+		vmaallocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
 
-	//vertex colors all green
-	triangleMesh._vertices[0].color = {0.f,1.f,0.f};
-	triangleMesh._vertices[1].color = {0.f,1.f,0.f};
-	triangleMesh._vertices[2].color = {0.f,1.f,0.f};
+		VkBufferCreateInfo meshletBufferInfo{};
+		meshletBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		meshletBufferInfo.pNext = nullptr;
+		meshletBufferInfo.size = meshletsBufferSize;
+		meshletBufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 
-	Mesh monkeyMesh;
-	monkeyMesh.loadFromAsset(_assetsPath+"monkey_smooth.mesh");
+		VK_CHECK(vmaCreateBuffer(_allocator, &meshletBufferInfo, &vmaallocInfo, &mesh._meshletBuffer._buffer, &mesh._meshletBuffer._allocation, nullptr));
 
-	Mesh lostEmpire{};
-	lostEmpire.loadFromAsset(_assetsPath+"lost_empire.mesh");
+		build_meshlet_descriptor(mesh);
 
-	//no vertex normals for now
-	upload_mesh(triangleMesh);
-	upload_mesh(monkeyMesh);
-	upload_mesh(lostEmpire);
+		//add destruction of mesh buffer to the deletion queue
+		//only the handles are captured, capturing the mesh would copy its vertices
+		AllocatedBuffer meshletBuffer = mesh._meshletBuffer;
+		_mainDeletionQueue.push_function([=](){
+			vmaDestroyBuffer(_allocator, meshletBuffer._buffer, meshletBuffer._allocation);
+		});
+	}
 
-	//triangle and monkey are copied in the map
-	_meshes["monkey"] = monkeyMesh;
-	_meshes["triangle"] = triangleMesh;
-	_meshes["empire"] = lostEmpire;
+	//the copies are only recorded, they are submitted with the rest of the batch
+	//the ranges too big for the staging ring can end in a later batch than the first ones, the mesh waits for the last
+	VkBufferCopy copy;
+	copy.dstOffset = vertexArena.byte_offset(mesh._vertexRange);
+	copy.srcOffset = 0;
+	copy.size = verticesBufferSize;
+	mesh._uploadTicket = _uploadQueue.copy_buffer(staging,vertexArena.buffer(mesh._vertexRange.block),copy,true);
+	if (indicesBufferSize > 0)
+	{
+		copy.dstOffset = _indexArena.byte_offset(mesh._indexRange);
+		copy.srcOffset = verticesBufferSize;
+		copy.size = indicesBufferSize;
+		mesh._uploadTicket = _uploadQueue.copy_buffer(staging,_indexArena.buffer(mesh._indexRange.block),copy,true);
+	}
+	if (meshletsBufferSize > 0)
+	{
+		copy.dstOffset = 0;
+		copy.srcOffset = verticesBufferSize + indicesBufferSize;
+		copy.size = meshletsBufferSize;
+		mesh._uploadTicket = _uploadQueue.copy_buffer(staging,mesh._meshletBuffer._buffer,copy);
+	}
 }
 
-void VulkanEngine::upload_mesh(Mesh& mesh)
+vkutil::GeometryArena& VulkanEngine::vertex_arena(assets::VertexFormat format)
 {
-	const size_t verticesBufferSize = mesh._vertices.size() * sizeof(Vertex);
-	const size_t indicesBufferSize = mesh._indices.size() * sizeof(uint32_t);
+	switch (format)
+	{
+	case assets::VertexFormat::PNV_Q16: return _vertexArenas[1];
+	case assets::VertexFormat::PNCV_Q16: return _vertexArenas[2];
+	default: return _vertexArenas[0];
+	}
+}
 
-	//allocate staging buffer on cpu
-	VkBufferCreateInfo stagingBufferInfo{};
-	stagingBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	stagingBufferInfo.pNext = nullptr;
-	stagingBufferInfo.size = verticesBufferSize + indicesBufferSize;
-	stagingBufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+void VulkanEngine::build_meshlet_descriptor(Mesh& mesh)
+{
+	VkDescriptorBufferInfo meshletInfo{};
+	meshletInfo.buffer = mesh._meshletBuffer._buffer;
+	meshletInfo.offset = 0;
+	meshletInfo.range = VK_WHOLE_SIZE;
 
-	VmaAllocationCreateInfo vmaallocInfo{};
-	vmaallocInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
-	AllocatedBuffer stagingBuffer;
+	//the index ranges start at the storage buffer alignment, so the shader sees the indices of the mesh from 0
+	VkDescriptorBufferInfo indexInfo{};
+	indexInfo.buffer = _indexArena.buffer(mesh._indexRange.block);
+	indexInfo.offset = _indexArena.byte_offset(mesh._indexRange);
+	indexInfo.range = _indexArena.byte_size(mesh._indexRange);
 
-	//allocate the buffer on cpu side
-	VK_CHECK(vmaCreateBuffer(_allocator,&stagingBufferInfo,&vmaallocInfo,&stagingBuffer._buffer,&stagingBuffer._allocation,nullptr));
+	vkutil::DescriptorBuilder::begin(&_descriptorLayoutCache,&_descriptorAllocator)
+	.bindBuffer(0,&meshletInfo,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT)
+	.bindBuffer(1,&indexInfo,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT)
+	.build(mesh._meshletDescriptor);
+}
+
+void VulkanEngine::release_mesh_geometry(const Mesh& mesh)
+{
+	release_geometry_range(vertex_arena(mesh._vertexFormat), mesh._vertexRange, mesh._uploadTicket);
+	if (mesh._indexRange.count > 0)
+	{
+		release_geometry_range(_indexArena, mesh._indexRange, mesh._uploadTicket);
+	}
+}
 
-	//copy vertex data
-	char* data;
-	VK_CHECK(vmaMapMemory(_allocator, stagingBuffer._allocation, (void**)&data));
+void VulkanEngine::release_geometry_range(vkutil::GeometryArena& arena, const vkutil::GeometryRange& range, vkutil::UploadTicket ticket)
+{
+	ReleasedGeometry released;
+	released.ticket = ticket;
+	released.frame = _frameNumber;
+	released.arena = &arena;
+	released.range = range;
+	_releasedGeometry.push_back(released);
+}
 
-	memcpy(data, mesh._vertices.data(),verticesBufferSize);
-	memcpy(data + verticesBufferSize, mesh._indices.data(),indicesBufferSize);
+void VulkanEngine::update_released_geometry()
+{
+	//a range is only reused once nothing can still copy into it, copies of different batches to the same range would race
+	//the frames recorded before the release can still draw it, draw() has waited for them once FRAME_OVERLAP frames started after
+	for (auto released = _releasedGeometry.begin(); released != _releasedGeometry.end();)
+	{
+		if (!_uploadQueue.is_ready(released->ticket) || _frameNumber < released->frame + static_cast<int>(FRAME_OVERLAP))
+		{
+			released++;
+			continue;
+		}
+		released->arena->free(released->range);
+		released = _releasedGeometry.erase(released);
+		_geometryCompacted = false;
+	}
+}
 
-	vmaUnmapMemory(_allocator,stagingBuffer._allocation);
+void VulkanEngine::compact_geometry()
+{
+	ZoneScopedNC("Compact Geometry", tracy::Color::Orange);
 
-	//allocate vertex buffer on gpu
-	VkBufferCreateInfo vertexBufferInfo{};
-	vertexBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	vertexBufferInfo.pNext = nullptr;
-	//this is the total size in bytes of the allocated buffer
-	vertexBufferInfo.size = verticesBufferSize;
-	//this buffer is going to be used as vertex buffer
-	vertexBufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	//the draws recorded from now on use the new ranges, the old ones are freed once the frames before are done
+	for (auto move = _geometryMoves.begin(); move != _geometryMoves.end();)
+	{
+		if (!_uploadQueue.is_ready(move->ticket))
+		{
+			move++;
+			continue;
+		}
 
-	//let vma lib know that this data should be gpu native
-	vmaallocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+		Mesh& mesh = *move->mesh;
+		if (move->vertices.count > 0)
+		{
+			release_geometry_range(vertex_arena(mesh._vertexFormat), mesh._vertexRange, move->ticket);
+			mesh._vertexRange = move->vertices;
+		}
+		if (move->indices.count > 0)
+		{
+			release_geometry_range(_indexArena, mesh._indexRange, move->ticket);
+			mesh._indexRange = move->indices;
+			//the frames in flight can still bind the old set, a new one is allocated instead of updating it
+			if (mesh._meshletDescriptor != VK_NULL_HANDLE)
+			{
+				build_meshlet_descriptor(mesh);
+			}
+		}
+		move = _geometryMoves.erase(move);
+	}
 
-	//allocate the buffer
-	VK_CHECK(vmaCreateBuffer(_allocator,&vertexBufferInfo,&vmaallocInfo,&mesh._vertexBuffer._buffer,&mesh._vertexBuffer._allocation,nullptr));
+	//one pass at a time, the meshes of a pass are only moved again once their copies are done
+	if (!CVAR_GeometryCompaction.Get() || _geometryCompacted || !_geometryMoves.empty())
+	{
+		return;
+	}
 
-	if (indicesBufferSize > 0)
+	const size_t budget = static_cast<size_t>(std::max(CVAR_GeometryCompactionBudget.Get(), 1)) * 1024 * 1024;
+	size_t copied = 0;
+	bool uploading = false;
+	for (auto& [name, mesh] : _meshes)
 	{
-		//allocate index buffer on gpu
-		VkBufferCreateInfo indexBufferInfo{};
-		indexBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		indexBufferInfo.pNext = nullptr;
-		indexBufferInfo.size = indicesBufferSize;
-		indexBufferInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		//the meshes still uploading keep their ranges for now, the empty ones are not worth a copy
+		if (!mesh.on_gpu() || mesh._vertexCount == 0)
+		{
+			continue;
+		}
+		if (!_uploadQueue.is_ready(mesh._uploadTicket))
+		{
+			uploading = true;
+			continue;
+		}
 
-		VK_CHECK(vmaCreateBuffer(_allocator, &indexBufferInfo, &vmaallocInfo, &mesh._indexBuffer._buffer, &mesh._indexBuffer._allocation, nullptr));		
-	}
+		GeometryMove move{};
+		move.mesh = &mesh;
 
-	//add destruction of mesh buffer to the deletion queue
-	_mainDeletionQueue.push_function([=](){
-		vmaDestroyBuffer(_allocator, mesh._vertexBuffer._buffer, mesh._vertexBuffer._allocation);
-		if (indicesBufferSize > 0)
-			vmaDestroyBuffer(_allocator, mesh._indexBuffer._buffer, mesh._indexBuffer._allocation);
-	});
+		vkutil::GeometryArena& vertexArena = vertex_arena(mesh._vertexFormat);
+		if (vertexArena.relocate(mesh._vertexRange, move.vertices))
+		{
+			VkBufferCopy copy;
+			copy.srcOffset = vertexArena.byte_offset(mesh._vertexRange);
+			copy.dstOffset = vertexArena.byte_offset(move.vertices);
+			copy.size = vertexArena.byte_size(mesh._vertexRange);
+			move.ticket = _uploadQueue.copy_buffer(vertexArena.buffer(mesh._vertexRange.block), vertexArena.buffer(move.vertices.block), copy);
+			copied += static_cast<size_t>(copy.size);
+		}
+		if (mesh._indexRange.count > 0 && _indexArena.relocate(mesh._indexRange, move.indices))
+		{
+			VkBufferCopy copy;
+			copy.srcOffset = _indexArena.byte_offset(mesh._indexRange);
+			copy.dstOffset = _indexArena.byte_offset(move.indices);
+			copy.size = _indexArena.byte_size(mesh._indexRange);
+			move.ticket = _uploadQueue.copy_buffer(_indexArena.buffer(mesh._indexRange.block), _indexArena.buffer(move.indices.block), copy);
+			copied += static_cast<size_t>(copy.size);
+		}
 
-	immediate_submit([=](VkCommandBuffer cmd){
-		VkBufferCopy copy;
-		copy.dstOffset = 0;
-		copy.srcOffset = 0;
-		copy.size = verticesBufferSize;
-		vkCmdCopyBuffer(cmd,stagingBuffer._buffer,mesh._vertexBuffer._buffer,1,&copy);
-		if (indicesBufferSize > 0)
+		if (move.vertices.count > 0 || move.indices.count > 0)
 		{
-			copy.dstOffset = 0;
-			copy.srcOffset = verticesBufferSize;
-			copy.size = indicesBufferSize;
-			vkCmdCopyBuffer(cmd,stagingBuffer._buffer,mesh._indexBuffer._buffer,1,&copy);
+			_geometryMoves.push_back(move);
 		}
-	});
+		//the rest of the meshes are looked at by the next pass
+		if (copied >= budget)
+		{
+			return;
+		}
+	}
 
-	//destroy the staging buffer, copy was done so can be freed immediately
-	vmaDestroyBuffer(_allocator,stagingBuffer._buffer,stagingBuffer._allocation);
+	//every mesh was looked at, the next pass waits for a range to be freed
+	if (_geometryMoves.empty() && !uploading)
+	{
+		_geometryCompacted = true;
+	}
 }
 
 void VulkanEngine::init_scene()
@@ -1001,7 +1415,7 @@ void VulkanEngine::init_scene()
 
 	RenderObject monkey;
 	monkey.mesh = get_mesh("monkey");
-	monkey.material = get_material("defaultmesh");
+	monkey.material = get_material("defaultmesh", monkey.mesh);
 	monkey.transformMatrix = glm::mat4(1.f);
 
 	_renderables.push_back(monkey);
@@ -1012,7 +1426,7 @@ void VulkanEngine::init_scene()
 		{
 			RenderObject tri;
 			tri.mesh = get_mesh("triangle");
-			tri.material = get_material("defaultmesh");
+			tri.material = get_material("defaultmesh", tri.mesh);
 			glm::mat4 translation = glm::translate(glm::mat4(1.f),glm::vec3(x,0,y));
 			glm::mat4 scale = glm::scale(glm::mat4(1.f), glm::vec3(0.2,0.2,0.2));
 			tri.transformMatrix = translation * scale;
@@ -1021,38 +1435,63 @@ void VulkanEngine::init_scene()
 		}
 	}
 
-	RenderObject map;
-	map.mesh = get_mesh("empire");
-	map.material = get_material("texturedmesh");
-	map.transformMatrix = glm::translate(glm::vec3{5,-10,0});
-
-	_renderables.push_back(map);	
-
-	Material* texturedMat = get_material("texturedmesh");
-
-	//allocate the descriptor set for single-texture to use on the material
-	_descriptorAllocator.allocate(&texturedMat->textureSet,_singleTextureSetLayout);
-
 	//create a sampler for the texture
 	//use filter nearest to make texture appear blocky, which is what we want
 	VkSamplerCreateInfo samplerInfo = vkinit::sampler_create_info(VK_FILTER_NEAREST);
+	//the texels stay blocky up close, the baked mips are blended in the distance
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
-	VkSampler blockySampler;
-	vkCreateSampler(_device,&samplerInfo,nullptr,&blockySampler);
+	vkCreateSampler(_device,&samplerInfo,nullptr,&_blockySampler);
 
 	_mainDeletionQueue.push_function([=](){
-		vkDestroySampler(_device,blockySampler,nullptr);
+		vkDestroySampler(_device,_blockySampler,nullptr);
 	});
 
-	//write to the descriptor set so that it points to our empire_diffuse texture
+	Mesh* empire = get_mesh("empire");
+	Material* texturedMat = get_material("texturedmesh", empire);
+	bind_texture(texturedMat,"lost_empire-RGBA.tx");
+
+	RenderObject map;
+	map.mesh = empire;
+	map.material = texturedMat;
+	map.transformMatrix = glm::translate(glm::vec3{5,-10,0});
+
+	//every submesh of the map is its own object, so the parts out of view are culled and the ones sharing a texture are batched
+	if (empire->submesh_count() == 0)
+	{
+		_renderables.push_back(map);
+	}
+	for (uint32_t i = 0; i < empire->submesh_count(); i++)
+	{
+		RenderObject part = map;
+		part.submesh = static_cast<int32_t>(i);
+		part.material = get_submesh_material(empire->_submeshMaterials[i], empire, texturedMat);
+		_renderables.push_back(part);
+	}
+}
+
+void VulkanEngine::bind_texture(Material* material, const std::string& textureName)
+{
+	bool bound = false;
+	for (auto& [boundMaterial, boundTexture] : _textureBindings)
+	{
+		bound |= boundMaterial == material && boundTexture == textureName;
+	}
+	if (!bound)
+	{
+		_textureBindings.push_back({material,textureName});
+	}
+
+	//write to the descriptor set so that it points to the texture
 	VkDescriptorImageInfo imageBufferInfo;
-	imageBufferInfo.sampler = blockySampler;
-	imageBufferInfo.imageView = _loadedTextures["empire_diffuse"].imageView;
+	imageBufferInfo.sampler = _blockySampler;
+	imageBufferInfo.imageView = _loadedTextures[textureName].imageView;
 	imageBufferInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
 	vkutil::DescriptorBuilder::begin(&_descriptorLayoutCache,&_descriptorAllocator)
 	.bindImage(0,&imageBufferInfo,VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,VK_SHADER_STAGE_FRAGMENT_BIT)
-	.build(texturedMat->textureSet);
+	.build(material->textureSet);
 }
 
 #pragma endregion init
@@ -1065,6 +1504,15 @@ void VulkanEngine::cleanup()
 		//make sur the gpu has stopped doing its things
 		vkDeviceWaitIdle(_device);
 
+		//the reads in flight write to the streams
+		for (auto& [name, stream] : _textureStreams)
+		{
+			if (stream.pending)
+			{
+				stream.pending->wait();
+			}
+		}
+
 		_mainDeletionQueue.flush();
 		TracyVkDestroy(_graphicsQueueContext);
 		_profiler.cleanup();
@@ -1125,6 +1573,14 @@ void VulkanEngine::draw()
 		// 	PROFILER_CHECK(vkutil::VulkanScopeTimer timer2(cmd, _profiler, "Ready Frame"));
 		// 	sort_renderables();
 		// }
+
+		select_lods(_renderables.data(),_renderables.size());
+		cull_objects(_renderables.data(),_renderables.size());
+
+		{
+			PROFILER_CHECK(vkutil::VulkanScopeTimer timer2(cmd, _profiler, "Meshlet Culling"));
+			cull_meshlets(cmd,_visibleObjects.data(),_visibleObjects.size());
+		}
 		
 		{
 			PROFILER_CHECK(vkutil::VulkanScopeTimer timer3(cmd, _profiler, "Render Pass"));
@@ -1148,7 +1604,7 @@ void VulkanEngine::draw()
 
 			{
 				TracyVkZone(_graphicsQueueContext, get_current_frame()._mainCommandBuffer, "Render Pass");
-				draw_objects(cmd,_renderables.data(),_renderables.size());
+				draw_objects(cmd,_visibleObjects.data(),_visibleObjects.size());
 			}
 
 			{
@@ -1274,9 +1730,33 @@ void VulkanEngine::run()
 			ImGui::Text("FPS: %d", int(1000.f / _stats._frametime));
 			ImGui::Text("Frametimes: %f ms", _stats._frametime);
 			ImGui::Text("Objects: %d", _stats._objects);
+			ImGui::Text("Objects culled: %d", _stats._culledObjects);
 			ImGui::Text("Drawcalls: %d", _stats._draws);
 			ImGui::Text("Batches: %d", _stats._draws);
 			ImGui::Text("Triangles: %d", _stats._triangles);
+			ImGui::Text("Meshlets: %d", _stats._meshlets);
+			ImGui::Text("Triangles saved by lods: %d", _stats._trianglesSaved);
+			ImGui::Text("Upload batches in flight: %d", _uploadQueue.batches_in_flight());
+			ImGui::Text("Staging used: %.1f / %.1f MB", _uploadQueue.staging_used() / (1024.f * 1024.f), _uploadQueue.staging_size() / (1024.f * 1024.f));
+
+			size_t geometryUsed = _indexArena.used_bytes();
+			size_t geometryCapacity = _indexArena.capacity_bytes();
+			uint32_t geometryBlocks = _indexArena.block_count();
+			for (const vkutil::GeometryArena& arena : _vertexArenas)
+			{
+				geometryUsed += arena.used_bytes();
+				geometryCapacity += arena.capacity_bytes();
+				geometryBlocks += arena.block_count();
+			}
+			ImGui::Text("Geometry used: %.1f / %.1f MB in %u blocks", geometryUsed / (1024.f * 1024.f), geometryCapacity / (1024.f * 1024.f), geometryBlocks);
+
+			//vertices and indices kept in host memory by the meshes that are not GpuOnly
+			size_t cpuGeometry = 0;
+			for (const auto& [name, mesh] : _meshes)
+			{
+				cpuGeometry += mesh.cpu_geometry_bytes();
+			}
+			ImGui::Text("CPU geometry: %.1f MB", cpuGeometry / (1024.f * 1024.f));
 
 			CVAR_OutputIndirectToFile.Set(false);
 			if (ImGui::Button("Output Indirect"))
@@ -1300,6 +1780,12 @@ void VulkanEngine::run()
 
 		_cameraController->update(_stats._frametime);
 		_playerTransform.update();
+		_uploadQueue.update();
+		update_released_geometry();
+		compact_geometry();
+		update_texture_streams();
+		//the copies recorded until now are submitted before the frame, so they run before anything in it reads them
+		_uploadQueue.flush();
 		draw();
 	}
 }
@@ -1313,6 +1799,11 @@ Material* VulkanEngine::create_material(VkPipeline pipeline, VkPipelineLayout la
 	return &_materials[name];
 }
 
+Material* VulkanEngine::get_material(const std::string& name, const Mesh* mesh)
+{
+	return get_material(material_variant_name(name, mesh ? mesh->_vertexFormat : assets::VertexFormat::PNCV_F32));
+}
+
 Material* VulkanEngine::get_material(const std::string& name)
 {
 	auto it = _materials.find(name);
@@ -1354,6 +1845,295 @@ void VulkanEngine::sort_renderables()
 	});	
 }
 
+//largest axis scale of a transform, the bounding spheres and the errors grow with it
+static float max_scale(const glm::mat4& model)
+{
+	return std::sqrt(std::max({glm::dot(glm::vec3(model[0]), glm::vec3(model[0])), glm::dot(glm::vec3(model[1]), glm::vec3(model[1])), glm::dot(glm::vec3(model[2]), glm::vec3(model[2]))}));
+}
+
+//bounding sphere of what the object draws, in model space
+static void object_bounds(const RenderObject& object, glm::vec3& center, float& radius)
+{
+	if (object.submesh >= 0)
+	{
+		const MeshSubmesh& submesh = object.mesh->_submeshes[object.submesh];
+		center = submesh.boundsCenter;
+		radius = submesh.boundsRadius;
+		return;
+	}
+	center = object.mesh->_boundsCenter;
+	radius = object.mesh->_boundsRadius;
+}
+
+void VulkanEngine::select_lods(RenderObject* first, int count)
+{
+	ZoneScopedNC("Select Lods", tracy::Color::Blue);
+	_stats._trianglesSaved = 0;
+
+	glm::mat4 view = _playerCamera->get_view_matrix(_playerTransform);
+	//pixels covered by one unit seen from a distance of one, the projection flip does not change it
+	const float pixelsPerUnit = std::abs(_playerCamera->get_projection_matrix()[1][1]) * 0.5f * _windowExtent.height;
+	const float pixelError = CVAR_LodPixelError.GetFloat();
+	const float hysteresis = CVAR_LodHysteresis.GetFloat();
+
+	for (int i = 0; i < count; i++)
+	{
+		RenderObject& object = first[i];
+		const std::vector<MeshLod>& lods = object.mesh->_lods;
+		if (lods.size() < 2)
+		{
+			object.lod = 0;
+			continue;
+		}
+
+		//the error grows with the largest axis scale of the transform
+		const glm::mat4& model = object.transformMatrix;
+		const float scale = max_scale(model);
+		glm::vec3 boundsCenter;
+		float boundsRadius;
+		object_bounds(object, boundsCenter, boundsRadius);
+		const glm::vec3 center = glm::vec3(view * model * glm::vec4(boundsCenter, 1.f));
+		//the closest point of the sphere has the largest projected error, the full mesh is kept when the camera is inside it
+		const float distance = glm::length(center) - boundsRadius * scale;
+
+		const uint32_t current = std::min<uint32_t>(object.lod, static_cast<uint32_t>(lods.size() - 1));
+		uint32_t selected = 0;
+		if (distance > 0.f)
+		{
+			const float errorToPixels = scale * pixelsPerUnit / distance;
+			//coarser levels have to be clearly under the threshold and the current one clearly over it to change, so objects at the limit do not flicker
+			for (uint32_t lod = static_cast<uint32_t>(lods.size() - 1); lod > 0; lod--)
+			{
+				const float threshold = lod <= current ? pixelError * (1.f + hysteresis) : pixelError * (1.f - hysteresis);
+				if (lods[lod].error * errorToPixels <= threshold)
+				{
+					selected = lod;
+					break;
+				}
+			}
+		}
+		object.lod = selected;
+
+		uint32_t offset, fullCount, selectedCount;
+		object.mesh->draw_range(object.submesh, 0, offset, fullCount);
+		object.mesh->draw_range(object.submesh, selected, offset, selectedCount);
+		_stats._trianglesSaved += (static_cast<int>(fullCount) - static_cast<int>(selectedCount)) / 3;
+	}
+}
+
+//plane of the clip space row combination, normalized so distances are in model units
+static glm::vec4 normalize_plane(glm::vec4 plane)
+{
+	return plane / glm::length(glm::vec3(plane));
+}
+
+//frustum planes of a clip matrix, in the space the matrix transforms from
+static void frustum_planes(const glm::mat4& clipMatrix, glm::vec4 planes[6])
+{
+	//the planes are the rows of the clip matrix
+	glm::mat4 clip = glm::transpose(clipMatrix);
+	planes[0] = normalize_plane(clip[3] + clip[0]);
+	planes[1] = normalize_plane(clip[3] - clip[0]);
+	planes[2] = normalize_plane(clip[3] + clip[1]);
+	planes[3] = normalize_plane(clip[3] - clip[1]);
+	//vulkan depth goes from 0 to w
+	planes[4] = normalize_plane(clip[2]);
+	planes[5] = normalize_plane(clip[3] - clip[2]);
+}
+
+//meshlets the object culls, none when it has no meshlets
+static void meshlet_range(const RenderObject& object, uint32_t& firstMeshlet, uint32_t& meshletCount)
+{
+	if (object.submesh >= 0)
+	{
+		const MeshSubmesh& submesh = object.mesh->_submeshes[object.submesh];
+		firstMeshlet = submesh.firstMeshlet;
+		meshletCount = submesh.meshletCount;
+		return;
+	}
+	firstMeshlet = 0;
+	meshletCount = object.mesh->_meshletCount;
+}
+
+void VulkanEngine::cull_objects(RenderObject* first, int count)
+{
+	ZoneScopedNC("Cull Objects", tracy::Color::Blue);
+	_visibleObjects.clear();
+	_stats._culledObjects = 0;
+
+	glm::mat4 projection = _playerCamera->get_projection_matrix();
+	projection[1][1] *= -1;
+	//world space planes, the spheres are moved to world space instead of the planes to every model space
+	glm::vec4 planes[6];
+	frustum_planes(projection * _playerCamera->get_view_matrix(_playerTransform), planes);
+
+	for (int i = 0; i < count; i++)
+	{
+		const RenderObject& object = first[i];
+		//meshes still being copied are skipped, drawing them would make the frame wait for the copy on the gpu
+		const Mesh& lodMesh = object.mesh->lod_mesh(object.lod);
+		if (!lodMesh.on_gpu() || !_uploadQueue.is_ready(lodMesh._uploadTicket))
+		{
+			continue;
+		}
+		if (!CVAR_ObjectCulling.Get())
+		{
+			_visibleObjects.push_back(object);
+			continue;
+		}
+
+		glm::vec3 center;
+		float radius;
+		object_bounds(object, center, radius);
+		center = glm::vec3(object.transformMatrix * glm::vec4(center, 1.f));
+		radius *= max_scale(object.transformMatrix);
+
+		bool visible = true;
+		for (int p = 0; p < 6 && visible; p++)
+		{
+			visible = glm::dot(glm::vec3(planes[p]), center) + planes[p].w > -radius;
+		}
+		if (visible)
+		{
+			_visibleObjects.push_back(object);
+		}
+		else
+		{
+			_stats._culledObjects++;
+		}
+	}
+}
+
+void VulkanEngine::cull_meshlets(VkCommandBuffer cmd, RenderObject* first, int count)
+{
+	ZoneScopedNC("Cull Meshlets", tracy::Color::Blue);
+	FrameData& frame = get_current_frame();
+
+	_meshletDraws.assign(count, -1);
+	_stats._meshlets = 0;
+	//the indirect draws of the culled objects find their object with firstInstance, without the feature they are drawn whole
+	if (!CVAR_MeshletCulling.Get() || !_gpuFeatures.drawIndirectFirstInstance)
+	{
+		return;
+	}
+
+	//every culled object gets its own range of the frame index buffer, big enough for all of its triangles
+	uint32_t drawCount = 0;
+	uint32_t indexCount = 0;
+	for (int i = 0; i < count; i++)
+	{
+		//the meshlets only cover the full detail level
+		uint32_t firstMeshlet, meshletCount;
+		meshlet_range(first[i], firstMeshlet, meshletCount);
+		if (meshletCount == 0 || first[i].lod != 0 || drawCount == MAX_CULLED_DRAWS)
+		{
+			continue;
+		}
+		_meshletDraws[i] = drawCount++;
+		uint32_t rangeOffset, rangeCount;
+		first[i].mesh->draw_range(first[i].submesh, 0, rangeOffset, rangeCount);
+		indexCount += rangeCount;
+	}
+
+	if (drawCount == 0)
+	{
+		return;
+	}
+
+	if (indexCount > frame._culledIndexCapacity)
+	{
+		//the fence of this frame was waited on, so its old buffer is not in use anymore
+		vmaDestroyBuffer(_allocator, frame._culledIndexBuffer._buffer, frame._culledIndexBuffer._allocation);
+		frame._culledIndexBuffer = create_buffer(indexCount * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+		frame._culledIndexCapacity = indexCount;
+
+		VkDescriptorBufferInfo indexInfo{};
+		indexInfo.buffer = frame._culledIndexBuffer._buffer;
+		indexInfo.offset = 0;
+		indexInfo.range = VK_WHOLE_SIZE;
+
+		VkDescriptorBufferInfo indirectInfo{};
+		indirectInfo.buffer = frame._indirectBuffer._buffer;
+		indirectInfo.offset = 0;
+		indirectInfo.range = VK_WHOLE_SIZE;
+
+		if (frame._cullingDescriptor == VK_NULL_HANDLE)
+		{
+			vkutil::DescriptorBuilder::begin(&_descriptorLayoutCache,&_descriptorAllocator)
+			.bindBuffer(0,&indexInfo,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT)
+			.bindBuffer(1,&indirectInfo,VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,VK_SHADER_STAGE_COMPUTE_BIT)
+			.build(frame._cullingDescriptor);
+		}
+		else
+		{
+			VkWriteDescriptorSet write = vkinit::write_descriptor_buffer(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,frame._cullingDescriptor,&indexInfo,0);
+			vkUpdateDescriptorSets(_device,1,&write,0,nullptr);
+		}
+	}
+
+	//the shader only adds to indexCount, the instance is set when the draw is recorded
+	VkDrawIndexedIndirectCommand* commands;
+	VK_CHECK(vmaMapMemory(_allocator,frame._indirectBuffer._allocation,(void**)&commands));
+	uint32_t firstIndex = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (_meshletDraws[i] < 0)
+		{
+			continue;
+		}
+		VkDrawIndexedIndirectCommand& command = commands[_meshletDraws[i]];
+		command.indexCount = 0;
+		command.instanceCount = 1;
+		command.firstIndex = firstIndex;
+		//the culled indices are the ones of the mesh, relative to its vertex range
+		command.vertexOffset = static_cast<int32_t>(first[i].mesh->_vertexRange.offset);
+		command.firstInstance = 0;
+		uint32_t rangeOffset, rangeCount;
+		first[i].mesh->draw_range(first[i].submesh, 0, rangeOffset, rangeCount);
+		firstIndex += rangeCount;
+	}
+	vmaUnmapMemory(_allocator,frame._indirectBuffer._allocation);
+
+	glm::mat4 view = _playerCamera->get_view_matrix(_playerTransform);
+	glm::mat4 projection = _playerCamera->get_projection_matrix();
+	projection[1][1] *= -1;
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _meshletCullPipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _meshletCullLayout, 0, 1, &frame._cullingDescriptor, 0, nullptr);
+
+	for (int i = 0; i < count; i++)
+	{
+		if (_meshletDraws[i] < 0)
+		{
+			continue;
+		}
+		const RenderObject& object = first[i];
+
+		//taken in model space the frustum planes work for any object transform
+		//the cones are only exact for transforms without non uniform scale
+		MeshletCullConstants constants;
+		frustum_planes(projection * view * object.transformMatrix, constants.frustumPlanes);
+		constants.cameraPosition = glm::vec3(glm::inverse(view * object.transformMatrix)[3]);
+		meshlet_range(object, constants.firstMeshlet, constants.meshletCount);
+		constants.drawIndex = static_cast<uint32_t>(_meshletDraws[i]);
+
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _meshletCullLayout, 1, 1, &object.mesh->_meshletDescriptor, 0, nullptr);
+		vkCmdPushConstants(cmd, _meshletCullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(MeshletCullConstants), &constants);
+		vkCmdDispatch(cmd, constants.meshletCount, 1, 1);
+
+		_stats._meshlets += static_cast<int>(constants.meshletCount);
+	}
+
+	//the draws read the counts and the indices written by the shader
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.pNext = nullptr;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
 void VulkanEngine::draw_objects(VkCommandBuffer cmd, RenderObject* first, int count)
 {
 	ZoneScopedNC("DrawObjects", tracy::Color::Blue);
@@ -1400,7 +2180,11 @@ void VulkanEngine::draw_objects(VkCommandBuffer cmd, RenderObject* first, int co
 	for (int i = 0; i < count; i++)
 	{
 		RenderObject& object = first[i];
+		//levels from another asset have their own quantization box
+		const Mesh& lodMesh = object.mesh->lod_mesh(object.lod);
 		objectSSBO[i].modelMatrix = object.transformMatrix;
+		objectSSBO[i].positionScale = glm::vec4(lodMesh._positionScale, 0.f);
+		objectSSBO[i].positionOffset = glm::vec4(lodMesh._positionOffset, 0.f);
 	}
 	vmaUnmapMemory(_allocator,get_current_frame()._objectBuffer._allocation);
 	
@@ -1409,10 +2193,16 @@ void VulkanEngine::draw_objects(VkCommandBuffer cmd, RenderObject* first, int co
 	_stats._objects = 0;
 	_stats._triangles = 0;
 
+	//everything can be out of the frustum
+	if (count == 0)
+	{
+		return;
+	}
+
 	{
 		ZoneScopedNC("Draw Commit", tracy::Color::Blue4);
 
-		Mesh* lastMesh = nullptr;
+		VkBuffer lastVertexBuffer = VK_NULL_HANDLE;
 		Material* lastMaterial = nullptr;
 		VkPipeline lastPipeline = VK_NULL_HANDLE;
 		
@@ -1425,6 +2215,8 @@ void VulkanEngine::draw_objects(VkCommandBuffer cmd, RenderObject* first, int co
 				RenderObject* object;
 				uint64_t sortKey;
 				uint64_t objectIndex;
+				uint32_t lod;
+				int32_t submesh;
 			};
 
 			std::vector<RenderBatch> batches;
@@ -1437,10 +2229,12 @@ void VulkanEngine::draw_objects(VkCommandBuffer cmd, RenderObject* first, int co
 				uint64_t materialHash = std::hash<void*>()(object->material) & UINT32_MAX;
 				uint64_t meshHash = std::hash<void*>()(object->mesh) & UINT32_MAX;
 				batches[i].sortKey = materialHash << 32 | meshHash;
+				batches[i].lod = object->mesh->_lods.empty() ? 0 : std::min<uint32_t>(object->lod, object->mesh->_lods.size() - 1);
+				batches[i].submesh = object->mesh->_lods.empty() ? -1 : object->submesh;
 			}
 
 			std::sort(batches.begin(), batches.end(), [](const RenderBatch& a, const RenderBatch& b){
-				return a.sortKey < b.sortKey;
+				return std::tie(a.sortKey, a.lod, a.submesh) < std::tie(b.sortKey, b.lod, b.submesh);
 			});
 
 			uint32_t* instanceData;
@@ -1455,6 +2249,8 @@ void VulkanEngine::draw_objects(VkCommandBuffer cmd, RenderObject* first, int co
 			{
 				Mesh* mesh;
 				Material* material;
+				uint32_t lod;
+				int32_t submesh;
 				uint64_t first;
 				uint64_t count;
 			};
@@ -1466,6 +2262,8 @@ void VulkanEngine::draw_objects(VkCommandBuffer cmd, RenderObject* first, int co
 			newBatch.count = 0;
 			newBatch.material = batches[0].object->material;
 			newBatch.mesh = batches[0].object->mesh;
+			newBatch.lod = batches[0].lod;
+			newBatch.submesh = batches[0].submesh;
 			
 			instances.push_back(newBatch);
 
@@ -1473,7 +2271,7 @@ void VulkanEngine::draw_objects(VkCommandBuffer cmd, RenderObject* first, int co
 			{
 				RenderObject *object = batches[i].object;
 
-				if(object->mesh == instances.back().mesh && object->material == instances.back().material)
+				if(object->mesh == instances.back().mesh && object->material == instances.back().material && batches[i].lod == instances.back().lod && batches[i].submesh == instances.back().submesh)
 					instances.back().count++;
 				else
 				{
@@ -1481,10 +2279,21 @@ void VulkanEngine::draw_objects(VkCommandBuffer cmd, RenderObject* first, int co
 					newBatch.count = 1;
 					newBatch.material = object->material;
 					newBatch.mesh = object->mesh;
+					newBatch.lod = batches[i].lod;
+					newBatch.submesh = batches[i].submesh;
 					instances.push_back(newBatch);
 				}
 			}
 
+			//objects culled by meshlets draw from the frame index buffer with the command the culling shader filled
+			const bool meshletCulling = _meshletDraws.size() == static_cast<size_t>(count);
+			VkDrawIndexedIndirectCommand* indirectCommands = nullptr;
+			if (meshletCulling)
+			{
+				VK_CHECK(vmaMapMemory(_allocator,get_current_frame()._indirectBuffer._allocation,(void**)&indirectCommands));
+			}
+			VkBuffer lastIndexBuffer = VK_NULL_HANDLE;
+
 			for(auto& instance : instances)
 			{
 				Material* drawMat = instance.material;
@@ -1522,30 +2331,79 @@ void VulkanEngine::draw_objects(VkCommandBuffer cmd, RenderObject* first, int co
 				// // upload the mesh to the gpu via push constants
 				// vkCmdPushConstants(cmd, drawMat->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &constants);
 
-				// only bind the mesh if it's a different one from last bind
-				if (drawMesh != lastMesh)
+				// only bind the arena block if it's a different one from last bind, the meshes in it are drawn at their offsets
+				// levels registered from another asset are drawn from the ranges of that asset
+				const Mesh& bufferMesh = drawMesh->lod_mesh(instance.lod);
+				VkBuffer vertexBuffer = vertex_arena(bufferMesh._vertexFormat).buffer(bufferMesh._vertexRange.block);
+				if (vertexBuffer != lastVertexBuffer)
 				{
 					VkDeviceSize offset = 0;
-					vkCmdBindVertexBuffers(cmd, 0, 1, &drawMesh->_vertexBuffer._buffer, &offset);
-					if (drawMesh->_indices.size() > 0)
-						vkCmdBindIndexBuffer(cmd, drawMesh->_indexBuffer._buffer, 0, VK_INDEX_TYPE_UINT32);
-					lastMesh = drawMesh;
+					vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer, &offset);
+					lastVertexBuffer = vertexBuffer;
+				}
+				const int32_t vertexOffset = static_cast<int32_t>(bufferMesh._vertexRange.offset);
+
+				// every object has its own culling result, so the instances are drawn one by one
+				if (meshletCulling && _meshletDraws[batches[instance.first].objectIndex] >= 0)
+				{
+					VkBuffer culledIndexBuffer = get_current_frame()._culledIndexBuffer._buffer;
+					if (lastIndexBuffer != culledIndexBuffer)
+					{
+						vkCmdBindIndexBuffer(cmd, culledIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+						lastIndexBuffer = culledIndexBuffer;
+					}
+					for (uint64_t i = instance.first; i < instance.first + instance.count; i++)
+					{
+						//past MAX_CULLED_DRAWS the rest of the batch is drawn whole
+						int32_t drawIndex = _meshletDraws[batches[i].objectIndex];
+						if (drawIndex < 0)
+						{
+							uint64_t remaining = instance.first + instance.count - i;
+							VkBuffer indexBuffer = _indexArena.buffer(drawMesh->_indexRange.block);
+							vkCmdBindIndexBuffer(cmd, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+							lastIndexBuffer = indexBuffer;
+							uint32_t indexOffset, indexCount;
+							drawMesh->draw_range(instance.submesh, 0, indexOffset, indexCount);
+							vkCmdDrawIndexed(cmd, indexCount, remaining, drawMesh->_indexRange.offset + indexOffset, vertexOffset, i);
+							_stats._triangles += static_cast<int32_t>(indexCount / 3);
+							_stats._draws++;
+							break;
+						}
+						indirectCommands[drawIndex].firstInstance = static_cast<uint32_t>(i);
+						vkCmdDrawIndexedIndirect(cmd, get_current_frame()._indirectBuffer._buffer, drawIndex * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+						_stats._draws++;
+					}
+					_stats._drawcalls++;
+					continue;
 				}
 
 				// finally the drawcall
-				if (drawMesh->_indices.size() > 0)
+				if (!drawMesh->_lods.empty())
 				{
-					vkCmdDrawIndexed(cmd, drawMesh->_indices.size(), instance.count, 0, 0, instance.first);
-					_stats._triangles += static_cast<int32_t>(drawMesh->_indices.size() / 3);
+					VkBuffer indexBuffer = _indexArena.buffer(bufferMesh._indexRange.block);
+					if (lastIndexBuffer != indexBuffer)
+					{
+						vkCmdBindIndexBuffer(cmd, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+						lastIndexBuffer = indexBuffer;
+					}
+					uint32_t indexOffset, indexCount;
+					drawMesh->draw_range(instance.submesh, instance.lod, indexOffset, indexCount);
+					vkCmdDrawIndexed(cmd, indexCount, instance.count, bufferMesh._indexRange.offset + indexOffset, vertexOffset, instance.first);
+					_stats._triangles += static_cast<int32_t>(indexCount / 3);
 				}
 				else
 				{
-					vkCmdDraw(cmd, drawMesh->_vertices.size(), instance.count, 0, instance.first);
-					_stats._triangles += static_cast<int32_t>(drawMesh->_vertices.size() / 3);
+					vkCmdDraw(cmd, drawMesh->_vertexCount, instance.count, vertexOffset, instance.first);
+					_stats._triangles += static_cast<int32_t>(drawMesh->_vertexCount / 3);
 				}
 				_stats._draws++;
 				_stats._drawcalls++;
 			}
+
+			if (indirectCommands != nullptr)
+			{
+				vmaUnmapMemory(_allocator,get_current_frame()._indirectBuffer._allocation);
+			}
 		}
 	}	
 }
@@ -1619,16 +2477,114 @@ void VulkanEngine::immediate_submit(std::function<void(VkCommandBuffer cmd)>&& f
 void VulkanEngine::load_images()
 {
 	ZoneScopedNC("Load textures", tracy::Color::Yellow);
-	Texture lostEmpire;
 
-	vkutil::load_image_from_asset(*this,_assetsPath+"lost_empire-RGBA.tx",lostEmpire.image);
+	load_texture("lost_empire-RGBA.tx");
+}
+
+bool VulkanEngine::load_texture(const std::string& file)
+{
+	//only the smallest levels are uploaded here, the others are read in the background and added as they arrive
+	vkutil::TextureStream& stream = _textureStreams[file];
+	if (!vkutil::begin_texture_stream(*this,_assetsPath+file,stream))
+	{
+		_textureStreams.erase(file);
+		return false;
+	}
+
+	_loadedTextures[file].image = stream.image;
+	create_texture_view(file,stream);
+	return true;
+}
+
+void VulkanEngine::load_materials(const std::string& path)
+{
+	assets::AssetView file;
+	if (!assets::loadBinaryFile(path, file))
+	{
+		LOG_ERROR("Error when loading materials {}", path);
+		return;
+	}
+
+	//the textures are relative to the library, the engine names them relative to the assets
+	const std::filesystem::path directory = std::filesystem::path(path).lexically_relative(_assetsPath).parent_path();
+	for (assets::MaterialInfo& material : assets::readMaterials(&file))
+	{
+		for (std::string* texture : {&material.diffuseTexture, &material.normalTexture, &material.alphaTexture})
+		{
+			if (!texture->empty())
+			{
+				*texture = (directory / *texture).generic_string();
+			}
+		}
+		std::string name = material.name;
+		_materialDescriptors[name] = std::move(material);
+	}
+	LOG_SUCCESS("Materials loaded successfully {}.", path);
+}
 
-	VkImageViewCreateInfo imageinfo = vkinit::imageview_create_info(VK_FORMAT_R8G8B8A8_SRGB, lostEmpire.image._image,VK_IMAGE_ASPECT_COLOR_BIT);
-	vkCreateImageView(_device,&imageinfo,nullptr,&lostEmpire.imageView);
+Material* VulkanEngine::get_submesh_material(const std::string& materialName, const Mesh* mesh, Material* fallback)
+{
+	auto descriptor = _materialDescriptors.find(materialName);
+	if (descriptor == _materialDescriptors.end())
+	{
+		return fallback;
+	}
+	const std::string& texture = descriptor->second.diffuseTexture;
+	if (texture.empty())
+	{
+		return get_material("defaultmesh", mesh);
+	}
 
+	//the pipelines only read the diffuse texture, so the descriptors sharing it share one material and are drawn in the same batches
+	const std::string name = material_variant_name("texturedmesh", mesh->_vertexFormat) + " " + texture;
+	if (Material* material = get_material(name))
+	{
+		return material;
+	}
+	if (_loadedTextures.find(texture) == _loadedTextures.end() && !load_texture(texture))
+	{
+		return fallback;
+	}
+	Material* textured = get_material("texturedmesh", mesh);
+	Material* material = create_material(textured->pipeline, textured->pipelineLayout, name);
+	bind_texture(material, texture);
+	return material;
+}
+
+void VulkanEngine::create_texture_view(const std::string& name, const vkutil::TextureStream& stream)
+{
+	Texture& texture = _loadedTextures[name];
+
+	VkImageViewCreateInfo imageinfo = vkinit::imageview_create_info(stream.image._format, stream.image._image,VK_IMAGE_ASPECT_COLOR_BIT);
+	imageinfo.subresourceRange.baseMipLevel = stream.residentLevel;
+	imageinfo.subresourceRange.levelCount = stream.image._mipLevels - stream.residentLevel;
+	vkCreateImageView(_device,&imageinfo,nullptr,&texture.imageView);
+
+	VkImageView imageView = texture.imageView;
 	_mainDeletionQueue.push_function([=](){
-		vkDestroyImageView(_device,lostEmpire.imageView,nullptr);
+		vkDestroyImageView(_device,imageView,nullptr);
 	});
+}
 
-	_loadedTextures["empire_diffuse"] = lostEmpire;
+void VulkanEngine::update_texture_streams()
+{
+	ZoneScopedNC("Update texture streams", tracy::Color::Yellow);
+	for (auto it = _textureStreams.begin(); it != _textureStreams.end();)
+	{
+		auto& [name, stream] = *it;
+		if (vkutil::update_texture_stream(*this,stream))
+		{
+			create_texture_view(name,stream);
+			for (auto& [material, textureName] : _textureBindings)
+			{
+				if (textureName == name)
+				{
+					bind_texture(material,textureName);
+				}
+			}
+		}
+		//finished streams are dropped once their last levels are resident, the image and its views stay with the texture
+		const bool finished = !stream.pending && stream.residentLevel == stream.uploadedLevel;
+		it = finished ? _textureStreams.erase(it) : std::next(it);
+	}
 }
\ No newline at end of file
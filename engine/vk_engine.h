@@ -4,10 +4,14 @@
 #pragma once
 
 #include <vector>
+#include <array>
 #include <deque>
 #include <unordered_map>
 #include <functional>
 #include <string>
+#include <chrono>
+#include <future>
+#include <mutex>
 
 
 #include <vk_mesh.h>
@@ -15,6 +19,9 @@
 #include <vk_types.h>
 #include <vk_descriptors.h>
 #include <vk_profiler.h>
+#include <vk_upload.h>
+#include <asset_io.h>
+#include <material_asset.h>
 #include "transform.h"
 #include "camera.h"
 #include "event_handler.h"
@@ -48,6 +55,10 @@ struct RenderObject
 	Mesh* mesh;
 	Material* material;
 	glm::mat4 transformMatrix;
+	//level of detail of the mesh to draw, picked every frame by select_lods from the projected error
+	uint32_t lod{0};
+	//submesh of the mesh drawn by the object, -1 to draw every submesh with the object material
+	int32_t submesh{-1};
 };
 
 struct GPUCameraData
@@ -82,20 +93,50 @@ struct FrameData
 	VkDescriptorSet _objectDescriptor;
 	
 	AllocatedBuffer _instanceBuffer;
+
+	//triangles of the visible meshlets, grown when the culled meshes need more room
+	AllocatedBuffer _culledIndexBuffer{};
+	uint32_t _culledIndexCapacity{0};
+	//one indexed indirect command per culled object, filled by the culling shader
+	AllocatedBuffer _indirectBuffer{};
+	VkDescriptorSet _cullingDescriptor{VK_NULL_HANDLE};
 };
 
 struct GPUObjectData
 {
 	glm::mat4 modelMatrix;
+	//dequantization of the mesh positions, identity for float meshes
+	glm::vec4 positionScale;
+	glm::vec4 positionOffset;
+};
+
+//frustum and camera moved to the model space of the culled object
+struct MeshletCullConstants
+{
+	glm::vec4 frustumPlanes[6];
+	glm::vec3 cameraPosition;
+	uint32_t meshletCount;
+	uint32_t drawIndex;
+	//meshlets of a submesh are a range of the mesh ones
+	uint32_t firstMeshlet;
 };
 
+//objects drawn with meshlet culling in a frame, each one gets an indirect command
+constexpr uint32_t MAX_CULLED_DRAWS = 1024;
+
 struct EngineStats
 {
 	float _frametime;
 	int _objects;
+	//objects outside of the frustum, skipped before the meshlet culling and the draws
+	int _culledObjects;
 	int _drawcalls;
 	int _draws;
 	int _triangles;
+	//meshlets sent to the culling shader, the drawn triangles are only known by the gpu
+	int _meshlets;
+	//triangles not drawn because objects use a lower level of detail
+	int _trianglesSaved;
 };
 
 
@@ -177,6 +218,11 @@ public:
 	VkQueue _presentQueue; // queue we will present to
 	uint32_t _presentQueueFamily; // family of that queue
 
+	//queue of the dedicated transfer family, the graphics queue when the device has none
+	VkQueue _transferQueue;
+	uint32_t _transferQueueFamily;
+	VkExtent3D _transferGranularity;
+
 	VkRenderPass _renderPass;
 	std::vector<VkFramebuffer> _framebuffers;
 
@@ -202,20 +248,65 @@ public:
 	
 	VkDescriptorSetLayout _singleTextureSetLayout;
 
+	//meshlet culling compute pass, set 0 is the frame outputs and set 1 the mesh
+	VkDescriptorSetLayout _cullingSetLayout;
+	VkDescriptorSetLayout _meshletSetLayout;
+	VkPipelineLayout _meshletCullLayout;
+	VkPipeline _meshletCullPipeline;
+
 	VkPhysicalDeviceProperties _gpuProperties;
+	//features enabled on the device, the textures check it for block compression support
+	VkPhysicalDeviceFeatures _gpuFeatures;
 
 	//default array of renderable objects
 	std::vector<RenderObject> _renderables;
 
 	std::unordered_map<std::string,Material> _materials;
 	std::unordered_map<std::string,Mesh> _meshes;
+	//materials of the baked .mtl libraries by name, the submeshes of the meshes refer to them
+	std::unordered_map<std::string,assets::MaterialInfo> _materialDescriptors;
 
 	GPUSceneData _sceneParameters;
 	AllocatedBuffer _sceneParametersBuffer;
 
 	UploadContext _uploadContext;
+	//batches the copies of the assets through its staging ring, flushed once per frame and at the end of the init
+	vkutil::UploadQueue _uploadQueue;
+
+	//blocks the vertices of every mesh are sub-allocated from, one arena per vertex format, and the blocks of their indices
+	std::array<vkutil::GeometryArena,3> _vertexArenas;
+	vkutil::GeometryArena _indexArena;
+
+	//ranges of the arenas nothing uses anymore, while copies from or to them or frames drawing them could still be in flight
+	struct ReleasedGeometry
+	{
+		vkutil::UploadTicket ticket;
+		//frame number when the range was released, the frames recorded before it can still read it
+		int frame;
+		vkutil::GeometryArena* arena;
+		vkutil::GeometryRange range;
+	};
+	std::vector<ReleasedGeometry> _releasedGeometry;
+
+	//geometry of a mesh being copied down the arenas, the mesh switches to the new ranges once the copy is done
+	//a range that did not move has a count of 0
+	struct GeometryMove
+	{
+		Mesh* mesh;
+		vkutil::UploadTicket ticket;
+		vkutil::GeometryRange vertices;
+		vkutil::GeometryRange indices;
+	};
+	std::vector<GeometryMove> _geometryMoves;
+	//no range was freed since the last compaction pass that found nothing to move
+	bool _geometryCompacted{false};
 
 	std::unordered_map<std::string,Texture> _loadedTextures;
+	//textures still getting their bigger levels, the views in _loadedTextures follow their resident levels
+	std::unordered_map<std::string,vkutil::TextureStream> _textureStreams;
+	//materials sampling each texture, their sets are rebuilt when the view changes
+	std::vector<std::pair<Material*,std::string>> _textureBindings;
+	VkSampler _blockySampler;
 
 	std::unique_ptr<Camera> _playerCamera;
 	Transform _playerTransform;
@@ -229,8 +320,12 @@ public:
 
 	AllocatedBuffer create_buffer(size_t allocSize,VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, VkMemoryPropertyFlags requiredFlags = 0);
 
+	//records and waits for the commands, only for the one off setup work, the assets go through _uploadQueue
 	void immediate_submit(std::function<void(VkCommandBuffer cmd)>&& function);
 
+	//allocate the arena ranges and the meshlet buffer of the mesh and copy them from a staging allocation holding the vertices followed by the indices and the meshlets
+	void upload_mesh(Mesh& mesh, const vkutil::StagingAllocation& staging, size_t verticesBufferSize, size_t indicesBufferSize, size_t meshletsBufferSize = 0);
+
 private:
 
 	void init_vulkan();
@@ -254,20 +349,79 @@ private:
 
 	void init_descriptors();
 
+	//starts building the pipelines on the workers, finish_pipelines waits for them and creates their materials
 	void init_pipelines();
 
+	//runs on a worker, the pipelines are built in parallel
+	void build_pipelines();
+
+	//thread safe, the material is created by finish_pipelines
+	void add_built_pipeline(VkPipeline pipeline, VkPipelineLayout layout, const std::string& material);
+
+	void finish_pipelines();
+
+	//starts reading and decompressing the meshes of the scene on the workers, before the device exists
+	void begin_asset_loads();
+
 	void load_meshes();
 
+	//uploads a mesh unpacked by begin_asset_loads, meshes that were not part of them are read now
+	//the residency decides which copies of the geometry the mesh keeps
+	bool load_mesh(const std::string& path, Mesh& outMesh, MeshResidency residency);
+
 	void upload_mesh(Mesh& mesh);
 
+	//arena of the blocks holding the vertices of a format
+	vkutil::GeometryArena& vertex_arena(assets::VertexFormat format);
+
+	//gives the arena ranges of a mesh nothing draws back, once its copies are done
+	void release_mesh_geometry(const Mesh& mesh);
+
+	//gives a range back to its arena once the copies of the ticket and the frames recorded until now are done
+	void release_geometry_range(vkutil::GeometryArena& arena, const vkutil::GeometryRange& range, vkutil::UploadTicket ticket);
+
+	//frees the released ranges whose copies and frames are done
+	void update_released_geometry();
+
+	//switches the meshes whose geometry moves are done to their new ranges, then copies more live ranges down into the holes of the arenas
+	void compact_geometry();
+
+	//binds the meshlets and the index range of the mesh for the culling pass
+	void build_meshlet_descriptor(Mesh& mesh);
+
+	//register the levels of detail baked to basePath.lod1.mesh, basePath.lod2.mesh... on the mesh
+	void load_mesh_lods(const std::string& name, const std::string& basePath);
+
 	void load_images();
 
+	//stream a baked texture, it is named after its file relative to the assets
+	bool load_texture(const std::string& file);
+
+	//add the materials of a baked library to the descriptors
+	void load_materials(const std::string& path);
+
+	//material drawing a submesh, shared by every submesh with the same pipeline and texture
+	//fallback is used for the materials that no library describes
+	Material* get_submesh_material(const std::string& materialName, const Mesh* mesh, Material* fallback);
+
+	//view of the resident levels of a texture, the previous one is destroyed at cleanup as frames in flight can still use it
+	void create_texture_view(const std::string& name, const vkutil::TextureStream& stream);
+
+	//write the texture in a new descriptor set of the material, sets already recorded in frames are left untouched
+	void bind_texture(Material* material, const std::string& textureName);
+
+	//upload the levels read since the last frame and move the views of their textures to them
+	void update_texture_streams();
+
 	//create material and add it to the map
 	Material* create_material(VkPipeline pipeline, VkPipelineLayout layout, const std::string& name);
 
 	//returns nullptr if it can't be found
 	Material* get_material(const std::string& name);
 
+	//variant of the material built for the vertex format of the mesh
+	Material* get_material(const std::string& name, const Mesh* mesh);
+
 	//return nullptr if it can't be found
 	Mesh* get_mesh(const std::string& name);
 
@@ -277,10 +431,65 @@ private:
 
 	void sort_renderables();	
 
+	//pick the level of detail of every object from the projected error of its levels
+	void select_lods(RenderObject* first, int count);
+
+	//copy the objects whose bounds are in the frustum to _visibleObjects
+	void cull_objects(RenderObject* first, int count);
+
+	//dispatch the culling of the objects that have meshlets, must be recorded outside of the render pass
+	void cull_meshlets(VkCommandBuffer cmd, RenderObject* first, int count);
+
 	//draw function
 	void draw_objects(VkCommandBuffer cmd, RenderObject* first, int count);
 
 	EngineStats _stats;
+	//objects of the frame that passed cull_objects, the later passes only see these
+	std::vector<RenderObject> _visibleObjects;
+	//indirect command of every object of the last cull_meshlets, -1 when the object is drawn whole
+	std::vector<int32_t> _meshletDraws;
 	const std::string _shaderPath;
 	const std::string _assetsPath;
+
+	//asset files are read asynchronously in batches, instead of one after another
+	assets::AssetIO _assetIO;
+
+	//meshes of the scene read and decompressed on the workers from the start of init, by path
+	std::unordered_map<std::string,vkutil::MeshAssetData> _startupMeshes;
+	std::future<void> _startupMeshesUnpacked;
+
+	struct BuiltPipeline
+	{
+		VkPipeline pipeline;
+		VkPipelineLayout layout;
+		std::string material;
+	};
+	//pipelines built on the workers, their materials are created on the main thread
+	std::vector<BuiltPipeline> _builtPipelines;
+	std::vector<VkPipelineLayout> _builtPipelineLayouts;
+	std::mutex _builtPipelinesMutex;
+	std::future<void> _pipelinesBuilt;
+
+	//wall time of the phases of init, on the main thread and on the workers, logged once it is done
+	struct StartupTimeline
+	{
+		using Clock = std::chrono::steady_clock;
+
+		struct Phase
+		{
+			const char* name;
+			Clock::time_point begin;
+			Clock::time_point end;
+		};
+
+		Clock::time_point start;
+		std::vector<Phase> phases;
+		std::mutex mutex;
+
+		//thread safe, the phase ends now
+		void add(const char* name, Clock::time_point begin);
+		//every phase sorted by start, relative to the start of init
+		void log();
+	};
+	StartupTimeline _startupTimeline;
 };
@@ -0,0 +1,171 @@
+#include <vk_geometry.h>
+
+#include <algorithm>
+#include <iterator>
+
+namespace vkutil
+{
+    void GeometryArena::init(VmaAllocator allocator, VkBufferUsageFlags usage, uint32_t elementSize, uint32_t blockElements, uint32_t alignment, const std::vector<uint32_t>& queueFamilies)
+    {
+        _allocator = allocator;
+        //the ranges are copied into by the uploads and out of by the compaction
+        _usage = usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        _elementSize = elementSize;
+        _alignment = std::max(alignment, 1u);
+        _blockElements = aligned_count(std::max(blockElements, 1u));
+
+        //the same family twice would make the concurrent sharing invalid
+        _queueFamilies = queueFamilies;
+        std::sort(_queueFamilies.begin(), _queueFamilies.end());
+        _queueFamilies.erase(std::unique(_queueFamilies.begin(), _queueFamilies.end()), _queueFamilies.end());
+    }
+
+    void GeometryArena::cleanup()
+    {
+        for (Block& block : _blocks)
+        {
+            vmaDestroyBuffer(_allocator, block.buffer._buffer, block.buffer._allocation);
+        }
+        _blocks.clear();
+        _usedElements = 0;
+    }
+
+    bool GeometryArena::allocate(uint32_t count, GeometryRange& outRange)
+    {
+        const uint32_t size = aligned_count(std::max(count, 1u));
+
+        //first fit, the blocks are only a few and the meshes are loaded at startup
+        for (;;)
+        {
+            for (uint32_t blockIndex = 0; blockIndex < _blocks.size(); blockIndex++)
+            {
+                std::vector<FreeRange>& freeRanges = _blocks[blockIndex].freeRanges;
+                auto range = std::find_if(freeRanges.begin(), freeRanges.end(), [&](const FreeRange& free){ return free.count >= size; });
+                if (range == freeRanges.end())
+                {
+                    continue;
+                }
+
+                take_range(blockIndex, range, count, outRange);
+                return true;
+            }
+
+            if (!create_block(std::max(_blockElements, size)))
+            {
+                return false;
+            }
+        }
+    }
+
+    bool GeometryArena::relocate(const GeometryRange& range, GeometryRange& outRange)
+    {
+        const uint32_t size = aligned_count(std::max(range.count, 1u));
+
+        //the ranges only ever move down, so repeated passes end once every hole is filled or too small
+        //the free ranges never overlap a live one, the copy source and destination are disjoint even in the same block
+        for (uint32_t blockIndex = 0; blockIndex <= range.block && blockIndex < _blocks.size(); blockIndex++)
+        {
+            std::vector<FreeRange>& freeRanges = _blocks[blockIndex].freeRanges;
+            auto free = std::find_if(freeRanges.begin(), freeRanges.end(), [&](const FreeRange& free){
+                return free.count >= size && (blockIndex < range.block || free.offset < range.offset);
+            });
+            if (free != freeRanges.end())
+            {
+                take_range(blockIndex, free, range.count, outRange);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void GeometryArena::free(const GeometryRange& range)
+    {
+        std::vector<FreeRange>& freeRanges = _blocks[range.block].freeRanges;
+        const uint32_t size = aligned_count(std::max(range.count, 1u));
+        _usedElements -= size;
+
+        auto next = std::lower_bound(freeRanges.begin(), freeRanges.end(), range.offset, [](const FreeRange& free, uint32_t offset){ return free.offset < offset; });
+        const bool mergePrevious = next != freeRanges.begin() && std::prev(next)->offset + std::prev(next)->count == range.offset;
+        const bool mergeNext = next != freeRanges.end() && range.offset + size == next->offset;
+
+        if (mergePrevious && mergeNext)
+        {
+            std::prev(next)->count += size + next->count;
+            freeRanges.erase(next);
+        }
+        else if (mergePrevious)
+        {
+            std::prev(next)->count += size;
+        }
+        else if (mergeNext)
+        {
+            next->offset = range.offset;
+            next->count += size;
+        }
+        else
+        {
+            freeRanges.insert(next, {range.offset, size});
+        }
+
+        //the blocks are found by index, only the empty ones at the end can go
+        while (!_blocks.empty() && _blocks.back().freeRanges.size() == 1 && _blocks.back().freeRanges[0].count == _blocks.back().capacity)
+        {
+            vmaDestroyBuffer(_allocator, _blocks.back().buffer._buffer, _blocks.back().buffer._allocation);
+            _blocks.pop_back();
+        }
+    }
+
+    size_t GeometryArena::capacity_bytes() const
+    {
+        size_t bytes = 0;
+        for (const Block& block : _blocks)
+        {
+            bytes += static_cast<size_t>(block.capacity) * _elementSize;
+        }
+        return bytes;
+    }
+
+    void GeometryArena::take_range(uint32_t blockIndex, std::vector<FreeRange>::iterator free, uint32_t count, GeometryRange& outRange)
+    {
+        const uint32_t size = aligned_count(std::max(count, 1u));
+        outRange.block = blockIndex;
+        outRange.offset = free->offset;
+        outRange.count = count;
+
+        free->offset += size;
+        free->count -= size;
+        if (free->count == 0)
+        {
+            _blocks[blockIndex].freeRanges.erase(free);
+        }
+        _usedElements += size;
+    }
+
+    bool GeometryArena::create_block(uint32_t capacity)
+    {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.pNext = nullptr;
+        bufferInfo.size = static_cast<VkDeviceSize>(capacity) * _elementSize;
+        bufferInfo.usage = _usage;
+        if (_queueFamilies.size() > 1)
+        {
+            bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(_queueFamilies.size());
+            bufferInfo.pQueueFamilyIndices = _queueFamilies.data();
+        }
+
+        VmaAllocationCreateInfo vmaallocInfo{};
+        vmaallocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+        Block block;
+        if (vmaCreateBuffer(_allocator, &bufferInfo, &vmaallocInfo, &block.buffer._buffer, &block.buffer._allocation, nullptr) != VK_SUCCESS)
+        {
+            return false;
+        }
+        block.capacity = capacity;
+        block.freeRanges.push_back({0, capacity});
+        _blocks.push_back(std::move(block));
+        return true;
+    }
+} // namespace vkutil
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vk_types.h>
+#include <vector>
+
+namespace vkutil
+{
+    //part of an arena given to a mesh, in elements of the arena so the offsets go straight to firstIndex and vertexOffset
+    struct GeometryRange
+    {
+        uint32_t block{0};
+        uint32_t offset{0};
+        uint32_t count{0};
+    };
+
+    //sub-allocates the vertices or the indices of every mesh out of a few big device local buffers
+    //the draws bind a block once and only change firstIndex and vertexOffset between the meshes in it
+    //a block is created when the ones before are full, meshes bigger than a block get a block of their own size
+    //the engine compacts the blocks by moving live ranges down into the free ranges before them, the last blocks are destroyed once empty
+    class GeometryArena
+    {
+    public:
+        //elementSize is the stride of the vertices or the size of an index, the ranges start at multiples of alignment elements
+        //the blocks are shared by every queue family given, so uploads need no ownership transfer for the ranges of a block
+        void init(VmaAllocator allocator, VkBufferUsageFlags usage, uint32_t elementSize, uint32_t blockElements, uint32_t alignment, const std::vector<uint32_t>& queueFamilies);
+
+        //destroys the blocks, nothing can use them anymore
+        void cleanup();
+
+        //first free range of the blocks big enough for count elements, false when no block can be created for it
+        bool allocate(uint32_t count, GeometryRange& outRange);
+
+        //first free range before the given one big enough to hold it, in an earlier block or lower in its block
+        //false when there is none, no block is created for it
+        //both ranges are live after it, the caller copies the elements and frees the old range once nothing reads it
+        bool relocate(const GeometryRange& range, GeometryRange& outRange);
+
+        //gives the range back to its block, coalesced with the free ranges right before and after it
+        //the last blocks are destroyed when nothing is left in them
+        //the gpu has to be done with the range, the copies of later uploads can land there
+        void free(const GeometryRange& range);
+
+        VkBuffer buffer(uint32_t block) const { return _blocks[block].buffer._buffer; }
+        VkDeviceSize byte_offset(const GeometryRange& range) const { return static_cast<VkDeviceSize>(range.offset) * _elementSize; }
+        VkDeviceSize byte_size(const GeometryRange& range) const { return static_cast<VkDeviceSize>(range.count) * _elementSize; }
+
+        //bytes of the blocks given to ranges and bytes of the blocks created
+        size_t used_bytes() const { return static_cast<size_t>(_usedElements) * _elementSize; }
+        size_t capacity_bytes() const;
+        uint32_t block_count() const { return static_cast<uint32_t>(_blocks.size()); }
+
+    private:
+        struct FreeRange
+        {
+            uint32_t offset;
+            uint32_t count;
+        };
+
+        struct Block
+        {
+            AllocatedBuffer buffer;
+            uint32_t capacity;
+            //sorted by offset, two free ranges are never next to each other
+            std::vector<FreeRange> freeRanges;
+        };
+
+        bool create_block(uint32_t capacity);
+        //gives the start of a free range of a block to a range of count elements
+        void take_range(uint32_t blockIndex, std::vector<FreeRange>::iterator free, uint32_t count, GeometryRange& outRange);
+        uint32_t aligned_count(uint32_t count) const { return (count + _alignment - 1) / _alignment * _alignment; }
+
+        VmaAllocator _allocator;
+        VkBufferUsageFlags _usage;
+        uint32_t _elementSize;
+        uint32_t _blockElements;
+        uint32_t _alignment;
+        std::vector<uint32_t> _queueFamilies;
+
+        std::vector<Block> _blocks;
+        uint64_t _usedElements{0};
+    };
+} // namespace vkutil
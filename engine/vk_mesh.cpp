@@ -2,14 +2,42 @@
 #include <tiny_obj_loader.h>
 
 #include <vk_mesh.h>
+#include <vk_engine.h>
 #include <asset_loader.h>
 #include <mesh_asset.h>
+#include <mesh_optimizer.h>
 #include <logger.h>
 
-VertexInputDescription Vertex::get_vertex_description()
+#include <tracy/Tracy.hpp>
+
+#include <algorithm>
+
+VertexInputDescription Vertex::get_vertex_description(assets::VertexFormat format)
 {
     VertexInputDescription description;
 
+    if (format == assets::VertexFormat::PNV_Q16 || format == assets::VertexFormat::PNCV_Q16)
+    {
+        //both quantized layouts start the same way
+        static_assert(offsetof(assets::Vertex_PNV_Q16, uv) == offsetof(assets::Vertex_PNCV_Q16, uv));
+        const bool hasColor = format == assets::VertexFormat::PNCV_Q16;
+
+        VkVertexInputBindingDescription binding{};
+        binding.binding = 0;
+        binding.stride = static_cast<uint32_t>(assets::vertexFormatSize(format));
+        binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        description.bindings.push_back(binding);
+
+        //w is padding, the shader only reads xyz
+        description.attributes.push_back({0, 0, VK_FORMAT_R16G16B16A16_UNORM, static_cast<uint32_t>(offsetof(assets::Vertex_PNCV_Q16, position))});
+        description.attributes.push_back({1, 0, VK_FORMAT_R8G8_SNORM, static_cast<uint32_t>(offsetof(assets::Vertex_PNCV_Q16, normal))});
+        //without a color the shader uses the normal, the attribute points at the normal bytes only to keep the shader inputs complete
+        description.attributes.push_back({2, 0, hasColor ? VK_FORMAT_R8G8B8A8_SNORM : VK_FORMAT_R8G8_SNORM,
+            static_cast<uint32_t>(hasColor ? offsetof(assets::Vertex_PNCV_Q16, color) : offsetof(assets::Vertex_PNCV_Q16, normal))});
+        description.attributes.push_back({3, 0, VK_FORMAT_R16G16_SFLOAT, static_cast<uint32_t>(offsetof(assets::Vertex_PNCV_Q16, uv))});
+        return description;
+    }
+
     //we will have just 1 vertex buffer binding, with a per vertex rate
     VkVertexInputBindingDescription mainBinding{};
     mainBinding.binding = 0;
@@ -53,6 +81,98 @@ VertexInputDescription Vertex::get_vertex_description()
     return description;
 }
 
+//level chain, submeshes and bounding sphere of a mesh asset
+static void read_asset_lods(const assets::MeshInfo& meshInfo, Mesh& mesh)
+{
+    const uint32_t submeshCount = static_cast<uint32_t>(assets::submeshesPerLod(meshInfo));
+    mesh._lods.clear();
+    for (const assets::MeshLod& lod : meshInfo.lods)
+    {
+        const uint32_t level = static_cast<uint32_t>(mesh._lods.size());
+        mesh._lods.push_back({lod.indexOffset, lod.indexCount, lod.error, nullptr, level * submeshCount});
+    }
+
+    mesh._submeshes.clear();
+    for (const assets::MeshSubmesh& submesh : meshInfo.submeshes)
+    {
+        const assets::MeshBounds& bounds = submesh.bounds;
+        mesh._submeshes.push_back({submesh.indexOffset, submesh.indexCount, submesh.firstMeshlet, submesh.meshletCount,
+            glm::vec3(bounds.origin[0], bounds.origin[1], bounds.origin[2]), bounds.radius});
+    }
+    mesh._submeshMaterials.clear();
+    for (uint32_t i = 0; i < submeshCount; i++)
+    {
+        const uint32_t material = meshInfo.submeshes[i].material;
+        mesh._submeshMaterials.push_back(material < meshInfo.materials.size() ? meshInfo.materials[material] : std::string());
+    }
+
+    mesh._boundsCenter = glm::vec3(meshInfo.bounds.origin[0], meshInfo.bounds.origin[1], meshInfo.bounds.origin[2]);
+    mesh._boundsRadius = meshInfo.bounds.radius;
+}
+
+void Mesh::add_lod(uint32_t indexOffset, uint32_t indexCount, float error)
+{
+    MeshLod lod{indexOffset, indexCount, error, nullptr};
+    //levels with the same error keep their insertion order, so the full mesh stays first
+    auto position = std::upper_bound(_lods.begin(), _lods.end(), lod, [](const MeshLod& a, const MeshLod& b){
+        return a.error < b.error;
+    });
+    _lods.insert(position, lod);
+}
+
+bool Mesh::add_lod(const Mesh& source, float error)
+{
+    //the level is drawn with the pipeline of this mesh
+    //submeshes are drawn with the material of the same submesh of the full mesh
+    if (source._vertexFormat != _vertexFormat || source._lods.empty() || source._lods[0].source != nullptr || source.submesh_count() != submesh_count())
+    {
+        LOG_ERROR("Level of detail mesh does not match the vertex format, index layout or submeshes of its mesh");
+        return false;
+    }
+    MeshLod lod = source._lods[0];
+    lod.error = error;
+    lod.source = &source;
+    auto position = std::upper_bound(_lods.begin(), _lods.end(), lod, [](const MeshLod& a, const MeshLod& b){
+        return a.error < b.error;
+    });
+    _lods.insert(position, lod);
+    return true;
+}
+
+const Mesh& Mesh::lod_mesh(uint32_t lod) const
+{
+    if (lod < _lods.size() && _lods[lod].source != nullptr)
+    {
+        return *_lods[lod].source;
+    }
+    return *this;
+}
+
+const MeshSubmesh& Mesh::submesh(uint32_t index, uint32_t lod) const
+{
+    return lod_mesh(lod)._submeshes[_lods[lod].firstSubmesh + index];
+}
+
+void Mesh::draw_range(int32_t submesh, uint32_t lod, uint32_t& indexOffset, uint32_t& indexCount) const
+{
+    if (submesh < 0)
+    {
+        indexOffset = _lods[lod].indexOffset;
+        indexCount = _lods[lod].indexCount;
+        return;
+    }
+    const MeshSubmesh& range = this->submesh(static_cast<uint32_t>(submesh), lod);
+    indexOffset = range.indexOffset;
+    indexCount = range.indexCount;
+}
+
+void Mesh::release_cpu_geometry()
+{
+    //swapped with empty vectors, clear keeps the capacity
+    std::vector<Vertex>().swap(_vertices);
+    std::vector<uint32_t>().swap(_indices);
+}
+
 bool Mesh::load_from_obj(const std::string& filename)
 {
     //attrib will contain the vertex arrays of the file
@@ -131,12 +251,20 @@ bool Mesh::load_from_obj(const std::string& filename)
             index_offset += fv;
         }
     }
+
+    //one vertex per face corner so far, welding them gives a real index buffer
+    static_assert(sizeof(Vertex) == sizeof(assets::Vertex));
+    std::vector<assets::Vertex> welded;
+    assets::weldVertices(reinterpret_cast<const assets::Vertex*>(_vertices.data()), _vertices.size(), 0.f, welded, _indices);
+
+    _vertices.resize(welded.size());
+    memcpy(_vertices.data(), welded.data(), welded.size() * sizeof(Vertex));
     return true;
 }
 
 bool Mesh::loadFromAsset(const std::string& filename)
 {
-    assets::AssetFile file;
+    assets::AssetView file;
     bool loaded = assets::loadBinaryFile(filename, file);
 
     if (!loaded)
@@ -146,42 +274,253 @@ bool Mesh::loadFromAsset(const std::string& filename)
     }
     
     assets::MeshInfo meshInfo = assets::readMeshInfo(&file);
+    if (!assets::validateMeshInfo(&meshInfo, file.binaryBlob.size()))
+    {
+        LOG_ERROR("Corrupt layout in mesh {}", filename);
+        return false;
+    }
 
-    
-    std::vector<char> vertexBuffer;
-    std::vector<char> indexBuffer;
+    size_t vertexSize = assets::vertexFormatSize(meshInfo.vertexFormat);
+    if (vertexSize == 0)
+    {
+        LOG_ERROR("Unsupported vertex format in mesh {}", filename);
+        return false;
+    }
+
+    //both layouts are 11 tightly packed floats, so the asset can be unpacked directly in the vectors
+    static_assert(sizeof(Vertex) == sizeof(assets::Vertex));
+    size_t vertexCount = meshInfo.vertexBufferSize / vertexSize;
+    _vertices.resize(vertexCount);
+    _indices.resize(meshInfo.indexBufferSize / sizeof(uint32_t));
+    //the indices hold every level of detail one after the other
+    read_asset_lods(meshInfo, *this);
+
+    if (meshInfo.vertexFormat == assets::VertexFormat::PNCV_F32)
+    {
+        if (!assets::unpackMesh(&meshInfo,file.binaryBlob.data(),file.binaryBlob.size(),(char*)_vertices.data(),(char*)_indices.data()))
+        {
+            LOG_ERROR("Corrupt data in mesh {}", filename);
+            return false;
+        }
+    }
+    else
+    {
+        //the cpu side vertices are always full floats
+        std::vector<char> quantized(meshInfo.vertexBufferSize);
+        if (!assets::unpackMesh(&meshInfo,file.binaryBlob.data(),file.binaryBlob.size(),quantized.data(),(char*)_indices.data()))
+        {
+            LOG_ERROR("Corrupt data in mesh {}", filename);
+            return false;
+        }
+        assets::dequantizeVertices(quantized.data(), vertexCount, meshInfo.bounds, meshInfo.vertexFormat, (assets::Vertex*)_vertices.data());
+    }
 
-    vertexBuffer.resize(meshInfo.vertexBufferSize);
-    indexBuffer.resize(meshInfo.indexBufferSize);
+    return true;
 
-    assets::unpackMesh(&meshInfo,file.binaryBlob.data(),file.binaryBlob.size(),vertexBuffer.data(),indexBuffer.data());
+}
 
-    _vertices.clear();
-    _indices.clear();
+bool vkutil::load_mesh_from_asset(VulkanEngine& engine, const std::string& filename, Mesh& outMesh)
+{
+    assets::AssetView file;
+    bool loaded = assets::loadBinaryFile(filename, file);
 
-    uint32_t* unpackedIndices = reinterpret_cast<uint32_t*>(indexBuffer.data());
-    _indices.resize(indexBuffer.size() / sizeof(uint32_t));
-    _indices.insert(_indices.end(),unpackedIndices,unpackedIndices+indexBuffer.size() / sizeof(uint32_t));
+    if (!loaded)
+    {
+        LOG_ERROR("Error when loading mesh {}", filename);
+        return false;
+    }
 
-    _vertices.resize(vertexBuffer.size() / sizeof(assets::Vertex));
-    assets::Vertex* unpackedVertices = reinterpret_cast<assets::Vertex*>(vertexBuffer.data());
+    return load_mesh_from_asset(engine, file, filename, outMesh);
+}
 
-    for (size_t i = 0; i < _vertices.size(); i++)
+//checks the layout of an asset the renderer can draw, returns the size of its vertices or 0
+static size_t asset_vertex_size(const assets::MeshInfo& meshInfo, const std::string& filename)
+{
+    const size_t vertexSize = assets::vertexFormatSize(meshInfo.vertexFormat);
+    if (vertexSize == 0 || meshInfo.indexSize != sizeof(uint32_t))
     {
-        _vertices[i].position.x = unpackedVertices[i].position[0];
-        _vertices[i].position.y = unpackedVertices[i].position[1];
-        _vertices[i].position.z = unpackedVertices[i].position[2];
-        _vertices[i].normal.x = unpackedVertices[i].normal[0];
-        _vertices[i].normal.y = unpackedVertices[i].normal[1];
-        _vertices[i].normal.z = unpackedVertices[i].normal[2];
-        _vertices[i].uv.x = unpackedVertices[i].uv[0];
-        _vertices[i].uv.y = unpackedVertices[i].uv[1];
-        _vertices[i].color.x = unpackedVertices[i].color[0];
-        _vertices[i].color.y = unpackedVertices[i].color[1];
-        _vertices[i].color.z = unpackedVertices[i].color[2];
+        LOG_ERROR("Unsupported vertex format in mesh {}", filename);
+        return 0;
     }
-    
+    return vertexSize;
+}
 
+//decompresses the vertices then the indices then the meshlets of the asset, the layout of the gpu buffers
+//false when the blob doesn't hold the buffers its metadata describes
+static bool unpack_asset_buffers(assets::MeshInfo& meshInfo, const assets::AssetView& file, char* destination)
+{
+    {
+        ZoneScopedNC("Unpack mesh", tracy::Color::Magenta);
+        //the staging layout is vertices then indices, the same as the asset blob
+        if (!assets::unpackMesh(&meshInfo, file.binaryBlob.data(), file.binaryBlob.size(), destination))
+        {
+            return false;
+        }
+    }
+    //meshlets are stored uncompressed in the metadata and go after the indices
+    if (!meshInfo.meshlets.empty())
+    {
+        memcpy(destination + meshInfo.vertexBufferSize + meshInfo.indexBufferSize, meshInfo.meshlets.data(), meshInfo.meshlets.size() * sizeof(assets::Meshlet));
+    }
     return true;
+}
+
+//fills the mesh from the metadata of its asset, the cpu copy of the geometry is taken from the unpacked buffers when its residency keeps one
+static void read_asset_mesh(const assets::MeshInfo& meshInfo, size_t vertexSize, const char* buffers, Mesh& outMesh)
+{
+    const size_t verticesBufferSize = meshInfo.vertexBufferSize;
+    const size_t indicesBufferSize = meshInfo.indexBufferSize;
+
+    outMesh._vertexCount = static_cast<uint32_t>(verticesBufferSize / vertexSize);
+    outMesh._vertexFormat = meshInfo.vertexFormat;
+    if (meshInfo.vertexFormat != assets::VertexFormat::PNCV_F32)
+    {
+        //unorm positions cover the bounds box
+        const assets::MeshBounds& bounds = meshInfo.bounds;
+        outMesh._positionScale = glm::vec3(bounds.extents[0], bounds.extents[1], bounds.extents[2]) * 2.f;
+        outMesh._positionOffset = glm::vec3(bounds.origin[0] - bounds.extents[0], bounds.origin[1] - bounds.extents[1], bounds.origin[2] - bounds.extents[2]);
+    }
+    outMesh._indexCount = static_cast<uint32_t>(indicesBufferSize / sizeof(uint32_t));
+    outMesh._meshletCount = static_cast<uint32_t>(meshInfo.meshlets.size());
+    read_asset_lods(meshInfo, outMesh);
+
+    if (outMesh._residency == MeshResidency::GpuOnly)
+    {
+        outMesh.release_cpu_geometry();
+        return;
+    }
+
+    //the cpu copy is in full precision whatever the format of the gpu vertices
+    outMesh._vertices.resize(outMesh._vertexCount);
+    if (meshInfo.vertexFormat == assets::VertexFormat::PNCV_F32)
+    {
+        memcpy(outMesh._vertices.data(), buffers, verticesBufferSize);
+    }
+    else
+    {
+        assets::dequantizeVertices(buffers, outMesh._vertexCount, meshInfo.bounds, meshInfo.vertexFormat, reinterpret_cast<assets::Vertex*>(outMesh._vertices.data()));
+    }
+    outMesh._indices.resize(outMesh._indexCount);
+    memcpy(outMesh._indices.data(), buffers + verticesBufferSize, indicesBufferSize);
+}
+
+//uploads the buffers of the asset unpacked in the staging allocation
+static void upload_asset_buffers(VulkanEngine& engine, const assets::MeshInfo& meshInfo, const vkutil::StagingAllocation& staging, Mesh& outMesh)
+{
+    engine.upload_mesh(outMesh, staging, meshInfo.vertexBufferSize, meshInfo.indexBufferSize, meshInfo.meshlets.size() * sizeof(assets::Meshlet));
+}
+
+//bytes of the vertices, indices and meshlets, the staging size of the asset
+static size_t asset_buffers_size(const assets::MeshInfo& meshInfo)
+{
+    return meshInfo.vertexBufferSize + meshInfo.indexBufferSize + meshInfo.meshlets.size() * sizeof(assets::Meshlet);
+}
+
+//staging for buffers already unpacked in memory, the ones that fit go through the ring in one copy, the others are streamed through it
+static vkutil::StagingAllocation stage_buffers(VulkanEngine& engine, std::vector<char>&& buffers)
+{
+    vkutil::StagingAllocation staging;
+    if (buffers.size() <= engine._uploadQueue.staging_size())
+    {
+        staging = engine._uploadQueue.allocate_staging(buffers.size());
+        memcpy(staging.data, buffers.data(), buffers.size());
+    }
+    else
+    {
+        staging.overflow = std::move(buffers);
+        staging.data = staging.overflow.data();
+    }
+    return staging;
+}
+
+bool vkutil::load_mesh_from_asset(VulkanEngine& engine, const assets::AssetView& file, const std::string& filename, Mesh& outMesh)
+{
+    assets::MeshInfo meshInfo = assets::readMeshInfo(&file);
+    if (!assets::validateMeshInfo(&meshInfo, file.binaryBlob.size()))
+    {
+        LOG_ERROR("Corrupt layout in mesh {}", filename);
+        return false;
+    }
 
-}
\ No newline at end of file
+    const size_t vertexSize = asset_vertex_size(meshInfo, filename);
+    if (vertexSize == 0)
+    {
+        return false;
+    }
+
+    if (outMesh._residency == MeshResidency::GpuOnly)
+    {
+        //meshes bigger than the staging ring are unpacked in memory and copied through it in pieces
+        //on failure the staging space is just left unused, the ring reclaims it with the batch
+        vkutil::StagingAllocation staging = engine._uploadQueue.allocate_staging(asset_buffers_size(meshInfo));
+        if (!unpack_asset_buffers(meshInfo, file, staging.data))
+        {
+            LOG_ERROR("Corrupt data in mesh {}", filename);
+            return false;
+        }
+        read_asset_mesh(meshInfo, vertexSize, staging.data, outMesh);
+        upload_asset_buffers(engine, meshInfo, staging, outMesh);
+    }
+    else
+    {
+        //the cpu copy is read from the unpacked buffers, the staging ring can be uncached memory
+        std::vector<char> buffers(asset_buffers_size(meshInfo));
+        if (!unpack_asset_buffers(meshInfo, file, buffers.data()))
+        {
+            LOG_ERROR("Corrupt data in mesh {}", filename);
+            return false;
+        }
+        read_asset_mesh(meshInfo, vertexSize, buffers.data(), outMesh);
+        if (outMesh._residency == MeshResidency::CpuAndGpu)
+        {
+            upload_asset_buffers(engine, meshInfo, stage_buffers(engine, std::move(buffers)), outMesh);
+        }
+    }
+    LOG_SUCCESS("Mesh loaded successfully {}.", filename);
+    return true;
+}
+
+bool vkutil::unpack_mesh_asset(const char* data, size_t size, MeshAssetData& outData)
+{
+    assets::AssetView file;
+    if (!assets::parseBinaryFile(data, size, file))
+    {
+        return false;
+    }
+
+    outData.info = assets::readMeshInfo(&file);
+    if (!assets::validateMeshInfo(&outData.info, file.binaryBlob.size()) || assets::vertexFormatSize(outData.info.vertexFormat) == 0 || outData.info.indexSize != sizeof(uint32_t))
+    {
+        return false;
+    }
+
+    outData.buffers.resize(asset_buffers_size(outData.info));
+    if (!unpack_asset_buffers(outData.info, file, outData.buffers.data()))
+    {
+        outData.buffers = {};
+        return false;
+    }
+    outData.unpacked = true;
+    return true;
+}
+
+bool vkutil::upload_mesh_asset(VulkanEngine& engine, MeshAssetData& data, Mesh& outMesh)
+{
+    if (!data.unpacked)
+    {
+        LOG_ERROR("Error when loading mesh {}", data.filename);
+        return false;
+    }
+
+    const size_t vertexSize = asset_vertex_size(data.info, data.filename);
+    read_asset_mesh(data.info, vertexSize, data.buffers.data(), outMesh);
+    if (outMesh._residency != MeshResidency::CpuOnly)
+    {
+        upload_asset_buffers(engine, data.info, stage_buffers(engine, std::move(data.buffers)), outMesh);
+    }
+    LOG_SUCCESS("Mesh loaded successfully {}.", data.filename);
+
+    data.buffers = {};
+    data.unpacked = false;
+    return true;
+}
@@ -1,9 +1,13 @@
 #pragma once
 
 #include <vk_types.h>
+#include <string>
 #include <vector>
 #include <glm/vec3.hpp>
 #include <glm/vec2.hpp>
+#include <mesh_asset.h>
+#include <vk_upload.h>
+#include <vk_geometry.h>
 
 struct VertexInputDescription
 {
@@ -19,18 +23,144 @@ struct Vertex
     glm::vec3 normal;
     glm::vec3 color;
     glm::vec2 uv;
-    static VertexInputDescription get_vertex_description();
+    //quantized formats are read straight from the asset layouts and decoded in tri_mesh.vert
+    static VertexInputDescription get_vertex_description(assets::VertexFormat format = assets::VertexFormat::PNCV_F32);
+};
+
+struct Mesh;
+
+//one level of detail of a mesh, ordered from the most to the least detailed
+struct MeshLod
+{
+    uint32_t indexOffset{0};
+    uint32_t indexCount{0};
+    //distance of the level to the full detail surface, in model units
+    float error{0.f};
+    //levels registered from another asset draw from the buffers of that mesh, null for the ranges of the mesh itself
+    const Mesh* source{nullptr};
+    //first submesh of the level in the submeshes of the mesh it is drawn from
+    uint32_t firstSubmesh{0};
+};
+
+//triangles of one material, or of one spatial sector of it, in one level of detail, drawn and culled on their own
+struct MeshSubmesh
+{
+    uint32_t indexOffset{0};
+    uint32_t indexCount{0};
+    //meshlets of the range, only the full detail level has some
+    uint32_t firstMeshlet{0};
+    uint32_t meshletCount{0};
+    //bounding sphere of the submesh in every level, in model space
+    glm::vec3 boundsCenter{0.f};
+    float boundsRadius{0.f};
+};
+
+//where the geometry of a mesh lives once it is loaded, chosen per mesh before loading it
+enum class MeshResidency
+{
+    //only the gpu ranges, the cpu vectors are released once the copies are recorded
+    GpuOnly,
+    //the gpu ranges and the full precision vertices and indices on the cpu, for picking or physics
+    CpuAndGpu,
+    //only the cpu vectors, nothing is uploaded and the mesh is never drawn
+    CpuOnly
 };
 
 struct Mesh
 {
+    //cpu copy of the geometry, empty for GpuOnly meshes once they are uploaded
     std::vector<Vertex> _vertices;
     std::vector<uint32_t> _indices;
+    MeshResidency _residency{MeshResidency::GpuOnly};
+
+    //number of elements in the gpu buffers, the cpu side vectors can be empty once uploaded
+    uint32_t _vertexCount{0};
+    uint32_t _indexCount{0};
+
+    //layout of the gpu vertex buffer, quantized positions are mapped back with position * scale + offset
+    assets::VertexFormat _vertexFormat{assets::VertexFormat::PNCV_F32};
+    glm::vec3 _positionScale{1.f};
+    glm::vec3 _positionOffset{0.f};
+
+    //ranges of the geometry arenas of the engine, the vertices are in the arena of _vertexFormat
+    //the draws bind the blocks of the ranges and start at their offsets, the index range is empty for meshes without indices
+    //the compaction of the engine moves them down the arenas between frames, the draws read them when recorded
+    vkutil::GeometryRange _vertexRange;
+    vkutil::GeometryRange _indexRange;
+    //batch of the upload queue copying the buffers, the mesh is not drawn before it is done
+    vkutil::UploadTicket _uploadTicket{0};
+
+    //levels of detail sorted by error, the first one is the full mesh and the meshlets only cover it
+    //empty for meshes drawn without an index buffer
+    std::vector<MeshLod> _lods;
+
+    //bounding sphere in model space, the renderer projects it to pick the level of detail
+    glm::vec3 _boundsCenter{0.f};
+    float _boundsRadius{0.f};
+
+    //submeshes of every level one after the other, empty when the levels are only drawn whole
+    std::vector<MeshSubmesh> _submeshes;
+    //name of the material of each submesh of a level, the levels all have the same submeshes
+    std::vector<std::string> _submeshMaterials;
+
+    //meshlets of the asset, the index buffer is culled by meshlet on the gpu when there are some
+    uint32_t _meshletCount{0};
+    AllocatedBuffer _meshletBuffer{};
+    //meshlets and indices, read by the culling shader
+    VkDescriptorSet _meshletDescriptor{VK_NULL_HANDLE};
+
+    //adds a range of the index buffer of the mesh as a level of detail
+    void add_lod(uint32_t indexOffset, uint32_t indexCount, float error);
+    //adds the full detail of another uploaded mesh as a level of detail, both need the same vertex format
+    //the source mesh has to outlive this one
+    bool add_lod(const Mesh& source, float error);
+    //mesh whose buffers and position mapping are used to draw a level
+    const Mesh& lod_mesh(uint32_t lod) const;
+    //number of submeshes of every level, 0 when the mesh has none
+    uint32_t submesh_count() const { return static_cast<uint32_t>(_submeshMaterials.size()); }
+    //submesh of a level, in the buffers of lod_mesh(lod)
+    const MeshSubmesh& submesh(uint32_t index, uint32_t lod) const;
+    //index range a submesh of a level draws, the whole level for a negative submesh
+    void draw_range(int32_t submesh, uint32_t lod, uint32_t& indexOffset, uint32_t& indexCount) const;
+
+    //false for the CpuOnly meshes, they have no gpu ranges to draw
+    bool on_gpu() const { return _residency != MeshResidency::CpuOnly; }
+    //frees the memory of the cpu vectors, the counts and the gpu ranges are kept
+    void release_cpu_geometry();
+    //bytes held by the cpu vectors, reported in the stats
+    size_t cpu_geometry_bytes() const { return _vertices.capacity() * sizeof(Vertex) + _indices.capacity() * sizeof(uint32_t); }
 
-    AllocatedBuffer _vertexBuffer;
-    AllocatedBuffer _indexBuffer;
     bool load_from_obj(const std::string& filename);
     bool loadFromAsset(const std::string& filename);
 };
 
+class VulkanEngine;
+
+namespace vkutil
+{
+    //decompress the mesh asset and upload it following the residency of outMesh
+    //GpuOnly meshes are decompressed straight into a staging buffer, without any cpu side copy
+    bool load_mesh_from_asset(VulkanEngine& engine, const std::string& filename, Mesh& outMesh);
+
+    //same for an asset already in memory, filename is only used in the logs
+    bool load_mesh_from_asset(VulkanEngine& engine, const assets::AssetView& file, const std::string& filename, Mesh& outMesh);
+
+    //mesh asset decompressed in memory, for the loads started before the device exists
+    struct MeshAssetData
+    {
+        std::string filename;
+        assets::MeshInfo info;
+        //vertices, indices then meshlets, the layout of the gpu buffers
+        std::vector<char> buffers;
+        bool unpacked{false};
+    };
+
+    //parses and decompresses an asset file read in memory, touches no vulkan object so it can run on any thread
+    //logs nothing, a failed unpack is reported by upload_mesh_asset
+    bool unpack_mesh_asset(const char* data, size_t size, MeshAssetData& outData);
+
+    //uploads a mesh unpacked by unpack_mesh_asset following the residency of outMesh, the memory of its buffers is released
+    bool upload_mesh_asset(VulkanEngine& engine, MeshAssetData& data, Mesh& outMesh);
+} // namespace vkutil
+
 
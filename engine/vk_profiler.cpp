@@ -60,7 +60,7 @@ namespace vkutil
 
         for (size_t i = 0; i < QUERY_FRAME_OVERLAP; i++)
 		{
-            createInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT;
+            createInfo.pipelineStatistics = STAT_QUERY_FLAGS;
             vkCreateQueryPool(_device, &createInfo, nullptr, &_queryFrames[i]._statPool);
 			_queryFrames[i]._statLast = 0;
 		}
@@ -97,7 +97,7 @@ namespace vkutil
             );
 		}
 		std::vector<uint64_t> statResults;
-		statResults.resize(state._statLast);
+		statResults.resize(state._statLast * STAT_QUERY_COUNT);
 		if (state._statLast != 0)
 		{
             //copy results into a host visible buffer
@@ -108,7 +108,7 @@ namespace vkutil
 				state._statLast,
 				statResults.size() * sizeof(uint64_t),
 				statResults.data(),
-				sizeof(uint64_t),
+				STAT_QUERY_COUNT * sizeof(uint64_t),
                 VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT
             );
 		}
@@ -125,9 +125,12 @@ namespace vkutil
 
 		for (auto& st : state._statRecorders)
 		{
-			uint64_t result = statResults[st._query];
+			//results are written in the order of the statistic bits
+			uint64_t vertexInvocations = statResults[st._query * STAT_QUERY_COUNT + 0];
+			uint64_t clippingInvocations = statResults[st._query * STAT_QUERY_COUNT + 1];
 
-			_stats[st._name] = static_cast<int32_t>(result);
+			_stats[st._name] = static_cast<int32_t>(clippingInvocations);
+			_stats[st._name + " VS Invocations"] = static_cast<int32_t>(vertexInvocations);
 		}
 	}
 
@@ -86,6 +86,10 @@ namespace vkutil
 
 		static constexpr int QUERY_FRAME_OVERLAP = 3;
 
+		//vertex shader invocations show how well the post transform cache is used, clipping invocations count the primitives
+		static constexpr VkQueryPipelineStatisticFlags STAT_QUERY_FLAGS = VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT;
+		static constexpr uint32_t STAT_QUERY_COUNT = 2;
+
         int _currentFrame;
         float _period;
         std::array<QueryFrameState, QUERY_FRAME_OVERLAP> _queryFrames;
@@ -1,6 +1,7 @@
 #include <vk_textures.h>
 #include <vk_engine.h>
 
+#include <algorithm>
 #include <iostream>
 
 #include <vk_initializers.h>
@@ -12,6 +13,7 @@
 
 #include <asset_loader.h>
 #include <texture_asset.h>
+#include <texture_compression.h>
 #include <logger.h>
 
 bool vkutil::load_image_from_file(VulkanEngine& engine, const std::string& filename, AllocatedImage& outImage)
@@ -31,18 +33,11 @@ bool vkutil::load_image_from_file(VulkanEngine& engine, const std::string& filen
     //format r8g8b8a8 matches exactly with the pixels load from stb_image lib
     VkFormat imageFormat = VK_FORMAT_R8G8B8A8_SRGB;
 
-    //allocate temporary buffer for holding texture data to upload
-    AllocatedBuffer stagingBuffer = engine.create_buffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,VMA_MEMORY_USAGE_CPU_ONLY);
+    //copy data to the staging ring
+    vkutil::StagingAllocation staging = engine._uploadQueue.allocate_staging(static_cast<size_t>(imageSize));
+    memcpy(staging.data,pixel_ptr,static_cast<size_t>(imageSize));
 
-    //copy data to buffer
-    void* data;
-    vmaMapMemory(engine._allocator, stagingBuffer._allocation, &data);
-
-    memcpy(data,pixel_ptr,static_cast<size_t>(imageSize));
-
-    vmaUnmapMemory(engine._allocator, stagingBuffer._allocation);
-
-    //we no longer need the loaded data, so we can free the pixels as they are now in the staging buffer
+    //we no longer need the loaded data, so we can free the pixels as they are now in the staging memory
     stbi_image_free(pixels);
 
     VkExtent3D imageExtent;
@@ -53,6 +48,7 @@ bool vkutil::load_image_from_file(VulkanEngine& engine, const std::string& filen
     VkImageCreateInfo dimg_info = vkinit::image_create_info(imageFormat,VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, imageExtent);
 
     AllocatedImage newImage;
+    newImage._format = imageFormat;
 
     VmaAllocationCreateInfo dimg_allocinfo{};
     dimg_allocinfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
@@ -60,71 +56,122 @@ bool vkutil::load_image_from_file(VulkanEngine& engine, const std::string& filen
     //allocate and create the image
     vmaCreateImage(engine._allocator,&dimg_info,&dimg_allocinfo,&newImage._image,&newImage._allocation,nullptr);
 
-    engine.immediate_submit([&](VkCommandBuffer cmd){
-        VkImageSubresourceRange range;
-        range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        range.baseMipLevel = 0;
-        range.levelCount = 1;
-        range.baseArrayLayer = 0;
-        range.layerCount = 1;
-
-        VkImageMemoryBarrier imageBarrierToTransfer{};
-        imageBarrierToTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        imageBarrierToTransfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imageBarrierToTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        imageBarrierToTransfer.image = newImage._image;
-        imageBarrierToTransfer.subresourceRange = range;
-        imageBarrierToTransfer.srcAccessMask = 0;
-        imageBarrierToTransfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-        //barrier the image into the transfer receive layout
-        vkCmdPipelineBarrier(cmd,VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,VK_PIPELINE_STAGE_TRANSFER_BIT,0,0,nullptr,0,nullptr,1,&imageBarrierToTransfer);
-
-        VkBufferImageCopy copy{};
-        copy.bufferOffset = 0;
-        copy.bufferRowLength = 0;
-        copy.bufferImageHeight = 0;
-        copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        copy.imageSubresource.mipLevel = 0;
-        copy.imageSubresource.baseArrayLayer = 0;
-        copy.imageSubresource.layerCount = 1;
-        copy.imageExtent = imageExtent;
-
-        //copy buffer into image
-        vkCmdCopyBufferToImage(cmd,stagingBuffer._buffer,newImage._image,VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,1,&copy);
-    
-        VkImageMemoryBarrier imageBarrierToReadable = imageBarrierToTransfer;
-        imageBarrierToReadable.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        imageBarrierToReadable.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageBarrierToReadable.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        imageBarrierToReadable.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        //barrier the image into the shader readable layout
-        vkCmdPipelineBarrier(cmd,VK_PIPELINE_STAGE_TRANSFER_BIT,VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,0,0,nullptr,0,nullptr,1,&imageBarrierToReadable);
-    });
+    VkImageSubresourceRange range;
+    range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    range.baseMipLevel = 0;
+    range.levelCount = 1;
+    range.baseArrayLayer = 0;
+    range.layerCount = 1;
+
+    VkBufferImageCopy copy{};
+    copy.bufferOffset = 0;
+    copy.bufferRowLength = 0;
+    copy.bufferImageHeight = 0;
+    copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    copy.imageSubresource.mipLevel = 0;
+    copy.imageSubresource.baseArrayLayer = 0;
+    copy.imageSubresource.layerCount = 1;
+    copy.imageExtent = imageExtent;
+
+    //copy buffer into image, the upload queue moves it to the shader readable layout
+    vkutil::UploadTicket ticket;
+    if (!engine._uploadQueue.copy_image(staging,newImage,range,{copy},ticket))
+    {
+        LOG_ERROR("Texture file {} is too wide to upload", filename);
+        vmaDestroyImage(engine._allocator,newImage._image,newImage._allocation);
+        return false;
+    }
     VmaAllocator& allocator = engine._allocator;
     engine._mainDeletionQueue.push_function([=](){
         vmaDestroyImage(allocator,newImage._image,newImage._allocation);
     });
 
-    vmaDestroyBuffer(engine._allocator,stagingBuffer._buffer,stagingBuffer._allocation);
-
     LOG_SUCCESS("Texture loaded successfully {}.", filename);
 
     outImage=newImage;
     return true;
 }
 
-AllocatedImage uploadImage(int texWidth, int texHeight, VkFormat textureFormat, VulkanEngine& engine, AllocatedBuffer& stagingBuffer)
+//vulkan format of an asset format, the color formats are encoded from srgb pixels, bc4 and bc5 hold data channels
+static bool select_texture_format(assets::TextureFormat format, VkFormat& outFormat)
+{
+    switch (format)
+    {
+    case assets::TextureFormat::RGBA8:
+        outFormat = VK_FORMAT_R8G8B8A8_SRGB;
+        return true;
+    case assets::TextureFormat::BC1:
+        outFormat = VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+        return true;
+    case assets::TextureFormat::BC3:
+        outFormat = VK_FORMAT_BC3_SRGB_BLOCK;
+        return true;
+    case assets::TextureFormat::BC4:
+        outFormat = VK_FORMAT_BC4_UNORM_BLOCK;
+        return true;
+    case assets::TextureFormat::BC5:
+        outFormat = VK_FORMAT_BC5_UNORM_BLOCK;
+        return true;
+    case assets::TextureFormat::BC7:
+        outFormat = VK_FORMAT_BC7_SRGB_BLOCK;
+        return true;
+    default:
+        return false;
+    }
+}
+
+//reads the info and picks the format the image is created with
+//without block compression support the levels are decoded to rgba8, at 4 to 8 times the memory
+static bool prepare_texture(VulkanEngine& engine, const assets::AssetView& file, const std::string& filename, assets::TextureInfo& outInfo, VkFormat& outFormat, bool& outDecode)
+{
+    outInfo = assets::readTextureInfo(&file);
+    if (!assets::validateTextureInfo(&outInfo, file.binaryBlob.size()))
+    {
+        LOG_ERROR("Corrupt layout in image {}", filename);
+        return false;
+    }
+    if (!select_texture_format(outInfo.textureFormat, outFormat))
+    {
+        LOG_ERROR("Unsupported texture format in {}", filename);
+        return false;
+    }
+
+    //assets baked without mips hold only the full image
+    if (outInfo.mips.empty())
+    {
+        outInfo.mips.push_back({outInfo.pixelsize[0], outInfo.pixelsize[1], 0, static_cast<uint32_t>(outInfo.textureSize)});
+    }
+
+    outDecode = assets::blockSize(outInfo.textureFormat) > 0 && !engine._gpuFeatures.textureCompressionBC;
+    if (outDecode)
+    {
+        const bool color = outFormat != VK_FORMAT_BC4_UNORM_BLOCK && outFormat != VK_FORMAT_BC5_UNORM_BLOCK;
+        outFormat = color ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+        LOG_INFO("The GPU can't sample block compressed textures, decoding {}", filename);
+    }
+
+    //the levels bigger than the staging ring go through it in rows, the widest level has to fit them in a quarter of it
+    if (!engine._uploadQueue.fits_image_rows(outFormat, outInfo.mips[0].width))
+    {
+        LOG_ERROR("Image {} is too wide for the staging ring", filename);
+        return false;
+    }
+    return true;
+}
+
+AllocatedImage create_texture_image(const std::vector<assets::TextureMip>& mips, VkFormat textureFormat, VulkanEngine& engine)
 {
     VkExtent3D imageExtent;
-    imageExtent.width = static_cast<uint32_t>(texWidth);
-    imageExtent.height = static_cast<uint32_t>(texHeight);
+    imageExtent.width = mips[0].width;
+    imageExtent.height = mips[0].height;
     imageExtent.depth = 1;
 
     VkImageCreateInfo dimg_info = vkinit::image_create_info(textureFormat,VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, imageExtent);
+    dimg_info.mipLevels = static_cast<uint32_t>(mips.size());
 
     AllocatedImage newImage;
+    newImage._mipLevels = dimg_info.mipLevels;
+    newImage._format = textureFormat;
 
     VmaAllocationCreateInfo dimg_allocinfo{};
     dimg_allocinfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
@@ -132,48 +179,6 @@ AllocatedImage uploadImage(int texWidth, int texHeight, VkFormat textureFormat,
     //allocate and create the image
     vmaCreateImage(engine._allocator,&dimg_info,&dimg_allocinfo,&newImage._image,&newImage._allocation,nullptr);
 
-    engine.immediate_submit([&](VkCommandBuffer cmd){
-        VkImageSubresourceRange range;
-        range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        range.baseMipLevel = 0;
-        range.levelCount = 1;
-        range.baseArrayLayer = 0;
-        range.layerCount = 1;
-
-        VkImageMemoryBarrier imageBarrierToTransfer{};
-        imageBarrierToTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        imageBarrierToTransfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imageBarrierToTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        imageBarrierToTransfer.image = newImage._image;
-        imageBarrierToTransfer.subresourceRange = range;
-        imageBarrierToTransfer.srcAccessMask = 0;
-        imageBarrierToTransfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-        //barrier the image into the transfer receive layout
-        vkCmdPipelineBarrier(cmd,VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,VK_PIPELINE_STAGE_TRANSFER_BIT,0,0,nullptr,0,nullptr,1,&imageBarrierToTransfer);
-
-        VkBufferImageCopy copy{};
-        copy.bufferOffset = 0;
-        copy.bufferRowLength = 0;
-        copy.bufferImageHeight = 0;
-        copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        copy.imageSubresource.mipLevel = 0;
-        copy.imageSubresource.baseArrayLayer = 0;
-        copy.imageSubresource.layerCount = 1;
-        copy.imageExtent = imageExtent;
-
-        //copy buffer into image
-        vkCmdCopyBufferToImage(cmd,stagingBuffer._buffer,newImage._image,VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,1,&copy);
-    
-        VkImageMemoryBarrier imageBarrierToReadable = imageBarrierToTransfer;
-        imageBarrierToReadable.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        imageBarrierToReadable.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        imageBarrierToReadable.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        imageBarrierToReadable.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        //barrier the image into the shader readable layout
-        vkCmdPipelineBarrier(cmd,VK_PIPELINE_STAGE_TRANSFER_BIT,VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,0,0,nullptr,0,nullptr,1,&imageBarrierToReadable);
-    });
     VmaAllocator& allocator = engine._allocator;
     engine._mainDeletionQueue.push_function([=](){
         vmaDestroyImage(allocator,newImage._image,newImage._allocation);
@@ -181,9 +186,100 @@ AllocatedImage uploadImage(int texWidth, int texHeight, VkFormat textureFormat,
     return newImage;
 }
 
+//the staging allocation holds the levels [firstLevel, firstLevel + levelCount) at the offsets of the mips, all of them are copied at once
+//the levels were never in a view yet, so nothing reads them while they are written
+//false when the levels can't be copied through the staging ring, nothing is recorded then
+bool upload_levels(const std::vector<assets::TextureMip>& mips, uint32_t firstLevel, uint32_t levelCount, const AllocatedImage& image, VulkanEngine& engine, const vkutil::StagingAllocation& staging,
+    vkutil::UploadTicket& outTicket)
+{
+    VkImageSubresourceRange range;
+    range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    range.baseMipLevel = firstLevel;
+    range.levelCount = levelCount;
+    range.baseArrayLayer = 0;
+    range.layerCount = 1;
+
+    std::vector<VkBufferImageCopy> copies(levelCount);
+    for (uint32_t i = 0; i < levelCount; i++)
+    {
+        const assets::TextureMip& mip = mips[firstLevel + i];
+        VkBufferImageCopy& copy = copies[i];
+        copy.bufferOffset = mip.offset;
+        copy.bufferRowLength = 0;
+        copy.bufferImageHeight = 0;
+        copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        copy.imageSubresource.mipLevel = firstLevel + i;
+        copy.imageSubresource.baseArrayLayer = 0;
+        copy.imageSubresource.layerCount = 1;
+        copy.imageExtent = {mip.width, mip.height, 1};
+    }
+
+    //copy buffer into every level of the range
+    return engine._uploadQueue.copy_image(staging,image,range,copies,outTicket);
+}
+
+//uploads the levels [firstLevel, firstLevel + levelCount), which start at regionOffset in the unpacked texture buffer
+//unpack writes the regionSize bytes of the region, straight into the staging memory unless the blocks have to be decoded
+//nothing is copied when unpack returns false, the region of the asset is corrupt, or when the levels can't be copied through the staging ring
+static bool upload_texture_region(VulkanEngine& engine, const assets::TextureInfo& info, bool decodeBlocks, uint32_t firstLevel, uint32_t levelCount,
+    uint32_t regionOffset, uint32_t regionSize, const AllocatedImage& image, const std::function<bool(char*)>& unpack, vkutil::UploadTicket& outTicket)
+{
+    std::vector<assets::TextureMip> mips = info.mips;
+    size_t stagingSize = regionSize;
+    if (decodeBlocks)
+    {
+        stagingSize = 0;
+        for (uint32_t level = firstLevel; level < firstLevel + levelCount; level++)
+        {
+            stagingSize += assets::textureLevelSize(assets::TextureFormat::RGBA8, mips[level].width, mips[level].height);
+        }
+    }
+
+    //regions bigger than the staging ring are unpacked in memory and copied through it in pieces
+    vkutil::StagingAllocation staging = engine._uploadQueue.allocate_staging(stagingSize);
+    char* data = staging.data;
+
+    if (decodeBlocks)
+    {
+        std::vector<char> blocks(regionSize);
+        {
+            ZoneScopedNC("Unpack texture", tracy::Color::Magenta);
+            if (!unpack(blocks.data()))
+            {
+                return false;
+            }
+        }
+
+        ZoneScopedNC("Decode texture blocks", tracy::Color::Magenta);
+        uint32_t offset = 0;
+        for (uint32_t level = firstLevel; level < firstLevel + levelCount; level++)
+        {
+            assets::TextureMip& mip = mips[level];
+            assets::decompressBlocks((const uint8_t*)blocks.data() + mip.offset - regionOffset, mip.width, mip.height, info.textureFormat, (uint8_t*)data + offset);
+            mip.offset = offset;
+            mip.size = static_cast<uint32_t>(assets::textureLevelSize(assets::TextureFormat::RGBA8, mip.width, mip.height));
+            offset += mip.size;
+        }
+    }
+    else
+    {
+        ZoneScopedNC("Unpack texture", tracy::Color::Magenta);
+        if (!unpack(data))
+        {
+            return false;
+        }
+        for (uint32_t level = firstLevel; level < firstLevel + levelCount; level++)
+        {
+            mips[level].offset -= regionOffset;
+        }
+    }
+
+    return upload_levels(mips,firstLevel,levelCount,image,engine,staging,outTicket);
+}
+
 bool vkutil::load_image_from_asset(VulkanEngine& engine, const std::string& filename, AllocatedImage& outImage)
 {
-    assets::AssetFile file;
+    assets::AssetView file;
     bool loaded = assets::loadBinaryFile(filename, file);
 
     if (!loaded)
@@ -191,38 +287,161 @@ bool vkutil::load_image_from_asset(VulkanEngine& engine, const std::string& file
         LOG_ERROR("Error when loading image {}", filename);
         return false;
     }
-    
-    assets::TextureInfo textureInfo = assets::readTextureInfo(&file);
 
-    VkDeviceSize textureSize = textureInfo.textureSize;
+    return load_image_from_asset(engine, file, filename, outImage);
+}
+
+bool vkutil::load_image_from_asset(VulkanEngine& engine, const assets::AssetView& file, const std::string& filename, AllocatedImage& outImage)
+{
+    assets::TextureInfo textureInfo;
     VkFormat textureFormat;
-    switch (textureInfo.textureFormat)
+    bool decodeBlocks;
+    if (!prepare_texture(engine, file, filename, textureInfo, textureFormat, decodeBlocks))
     {
-    case assets::TextureFormat::RGBA8:
-        textureFormat = VK_FORMAT_R8G8B8A8_SRGB;
-        break;
-    
-    default:
         return false;
-        break;
     }
 
-    AllocatedBuffer stagingBuffer = engine.create_buffer(textureSize,VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_UNKNOWN, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+    outImage = create_texture_image(textureInfo.mips,textureFormat,engine);
+    vkutil::UploadTicket ticket;
+    if (!upload_texture_region(engine, textureInfo, decodeBlocks, 0, static_cast<uint32_t>(textureInfo.mips.size()), 0, static_cast<uint32_t>(textureInfo.textureSize), outImage,
+        [&](char* destination){
+            return assets::unpackTexture(&textureInfo,file.binaryBlob.data(),file.binaryBlob.size(),destination);
+        }, ticket))
+    {
+        LOG_ERROR("Corrupt data in image {}", filename);
+        return false;
+    }
 
-    void* data;
-    vmaMapMemory(engine._allocator,stagingBuffer._allocation,&data);
+    LOG_SUCCESS("Texture loaded successfully {}.", filename);
 
+    return true;
+}
+
+//false when the record is corrupt, its levels are then left out
+static bool upload_texture_record(VulkanEngine& engine, vkutil::TextureStream& stream, size_t record, const char* recordBlob)
+{
+    ZoneScopedNC("Upload texture record", tracy::Color::Magenta);
+    const assets::TextureRecord& textureRecord = stream.info.records[record];
+    if (!upload_texture_region(engine, stream.info, stream.decodeBlocks, textureRecord.firstMip, textureRecord.mipCount, textureRecord.unpackedOffset, textureRecord.unpackedSize, stream.image,
+        [&](char* destination){
+            return assets::unpackTextureRecord(&stream.info, record, recordBlob, destination);
+        }, stream.uploadTicket))
     {
-        ZoneScopedNC("Unpack texture", tracy::Color::Magenta);
-        assets::unpackTexture(&textureInfo,file.binaryBlob.data(),file.binaryBlob.size(),(char*) data);
+        return false;
     }
-    
-    vmaUnmapMemory(engine._allocator,stagingBuffer._allocation);
-    outImage = uploadImage(textureInfo.pixelsize[0],textureInfo.pixelsize[1],textureFormat,engine,stagingBuffer);
 
-    vmaDestroyBuffer(engine._allocator,stagingBuffer._buffer,stagingBuffer._allocation);
-    LOG_SUCCESS("Texture loaded successfully {}.", filename);
+    //the baker writes the records smallest first, so every record extends the uploaded levels down
+    stream.uploadedLevel = std::min(stream.uploadedLevel, textureRecord.firstMip);
+    return true;
+}
 
+//reads the next record from the file, the mapping is dropped once there is nothing left to read
+static void queue_next_record(VulkanEngine& engine, vkutil::TextureStream& stream)
+{
+    if (stream.nextRecord >= stream.info.records.size())
+    {
+        stream.file = {};
+        stream.recordData = {};
+        return;
+    }
+
+    const assets::TextureRecord& record = stream.info.records[stream.nextRecord];
+    const uint64_t blobOffset = stream.file.binaryBlob.data() - stream.file.mapping->data();
+    stream.recordData.resize(record.blobSize);
+    stream.pending = engine._assetIO.submit({{stream.filename, blobOffset + record.blobOffset, record.blobSize, stream.recordData.data()}});
+}
+
+bool vkutil::begin_texture_stream(VulkanEngine& engine, const std::string& filename, TextureStream& outStream)
+{
+    outStream.filename = filename;
+    //not sequential, the kernel would read ahead the big levels the stream reads later on its own
+    if (!assets::loadBinaryFile(filename, outStream.file, false))
+    {
+        LOG_ERROR("Error when loading image {}", filename);
+        return false;
+    }
+
+    VkFormat textureFormat;
+    if (!prepare_texture(engine, outStream.file, filename, outStream.info, textureFormat, outStream.decodeBlocks))
+    {
+        return false;
+    }
+
+    outStream.image = create_texture_image(outStream.info.mips,textureFormat,engine);
+    outStream.residentLevel = outStream.image._mipLevels;
+    outStream.uploadedLevel = outStream.image._mipLevels;
+
+    if (outStream.info.records.empty())
+    {
+        if (!upload_texture_region(engine, outStream.info, outStream.decodeBlocks, 0, outStream.image._mipLevels, 0, static_cast<uint32_t>(outStream.info.textureSize), outStream.image,
+            [&](char* destination){
+                return assets::unpackTexture(&outStream.info,outStream.file.binaryBlob.data(),outStream.file.binaryBlob.size(),destination);
+            }, outStream.uploadTicket))
+        {
+            LOG_ERROR("Corrupt data in image {}", filename);
+            return false;
+        }
+        outStream.residentLevel = 0;
+        outStream.uploadedLevel = 0;
+        outStream.file = {};
+        LOG_SUCCESS("Texture loaded successfully {}.", filename);
+        return true;
+    }
+
+    //the first record holds the mip tail, it is small enough to wait for so the texture can be drawn right away
+    const assets::TextureRecord& tail = outStream.info.records[0];
+    if (!upload_texture_record(engine, outStream, 0, outStream.file.binaryBlob.data() + tail.blobOffset))
+    {
+        LOG_ERROR("Corrupt data in image {}", filename);
+        return false;
+    }
+    //the copy is flushed before the first frame that can use the view, so the tail is resident right away
+    outStream.residentLevel = outStream.uploadedLevel;
+    outStream.nextRecord = 1;
+    queue_next_record(engine, outStream);
+
+    LOG_SUCCESS("Texture streaming {} from level {}.", filename, outStream.residentLevel);
     return true;
 }
 
+bool vkutil::update_texture_stream(VulkanEngine& engine, TextureStream& stream)
+{
+    //the views only move to the copied levels once the copy is done, so the frames never wait for it
+    bool changed = false;
+    if (stream.residentLevel != stream.uploadedLevel && engine._uploadQueue.is_ready(stream.uploadTicket))
+    {
+        stream.residentLevel = stream.uploadedLevel;
+        changed = true;
+    }
+
+    if (!stream.pending || !stream.pending->done())
+    {
+        return changed;
+    }
+
+    const bool read = stream.pending->wait();
+    stream.pending.reset();
+    if (!read)
+    {
+        LOG_ERROR("Error when reading level {} of {}", stream.info.records[stream.nextRecord].firstMip, stream.filename);
+        stream.nextRecord = stream.info.records.size();
+        queue_next_record(engine, stream);
+        return changed;
+    }
+
+    if (!upload_texture_record(engine, stream, stream.nextRecord, stream.recordData.data()))
+    {
+        //the levels already resident stay, the corrupt one and the ones below are never streamed
+        LOG_ERROR("Corrupt data in level {} of {}", stream.info.records[stream.nextRecord].firstMip, stream.filename);
+        stream.nextRecord = stream.info.records.size();
+        queue_next_record(engine, stream);
+        return changed;
+    }
+    stream.nextRecord++;
+    queue_next_record(engine, stream);
+    if (!stream.pending)
+    {
+        LOG_SUCCESS("Texture loaded successfully {}.", stream.filename);
+    }
+    return changed;
+}
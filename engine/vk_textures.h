@@ -1,13 +1,46 @@
 #pragma once
 
 #include <vk_types.h>
+#include <texture_asset.h>
+#include <asset_io.h>
+#include <vk_upload.h>
 
 class VulkanEngine;
 
 namespace vkutil
 {
+    //texture uploaded one record at a time, the smallest levels first, so it can be drawn before the big ones are read
+    struct TextureStream
+    {
+        std::string filename;
+        //mapped for random access, only the metadata and the first record are touched through it
+        assets::AssetView file;
+        assets::TextureInfo info;
+        AllocatedImage image;
+        //levels are decoded to rgba8 when the device can't sample the block format
+        bool decodeBlocks{false};
+        //finest level uploaded, the views of the texture start there
+        uint32_t residentLevel{0};
+        //finest level copied, it becomes resident once the batch of uploadTicket is done
+        uint32_t uploadedLevel{0};
+        UploadTicket uploadTicket{0};
+        size_t nextRecord{0};
+        //read of nextRecord into recordData, null when nothing is in flight
+        assets::IOHandle pending;
+        std::vector<char> recordData;
+    };
+
     bool load_image_from_file(VulkanEngine& engine, const std::string& filename, AllocatedImage& outImage);
     bool load_image_from_asset(VulkanEngine& engine, const std::string& filename, AllocatedImage& outImage);
+    //same for an asset already in memory, filename is only used in the logs
+    bool load_image_from_asset(VulkanEngine& engine, const assets::AssetView& file, const std::string& filename, AllocatedImage& outImage);
+
+    //creates the image with all of its levels, uploads the first record and queues the read of the next one
+    //assets without records are uploaded whole
+    bool begin_texture_stream(VulkanEngine& engine, const std::string& filename, TextureStream& outStream);
+    //uploads the record once its read is done and queues the next one, returns true when residentLevel changed
+    //the levels of a record become resident a few frames after it is read, when their copy is done
+    bool update_texture_stream(VulkanEngine& engine, TextureStream& stream);
 } // namespace vkutil
 
 struct Texture
@@ -33,6 +33,9 @@ struct AllocatedImage
 {
     VkImage _image;
     VmaAllocation _allocation;
+    //views of the image have to cover every level to sample the mips
+    uint32_t _mipLevels{1};
+    VkFormat _format{VK_FORMAT_UNDEFINED};
 };
 
 struct VulkanInstance
@@ -49,6 +52,10 @@ struct VulkanPhysicalDevice
     VkSampleCountFlagBits _msaaSamples;
     uint32_t _graphicsQueueFamily;
     uint32_t _presentQueueFamily;
+    //family with transfers and nothing else, the graphics family when the device has none
+    uint32_t _transferQueueFamily;
+    //minImageTransferGranularity of the transfer family, in texel blocks for the block compressed formats
+    VkExtent3D _transferGranularity;
     VkPhysicalDeviceProperties _properties;
     VkPhysicalDeviceFeatures _features;
     std::vector<const char *> _extensions;
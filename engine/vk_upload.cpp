@@ -0,0 +1,526 @@
+#include <vk_upload.h>
+#include <vk_initializers.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <tracy/Tracy.hpp>
+
+//what the uploaded buffers are used for: vertices, indices, and storage buffers of the culling pass
+constexpr VkPipelineStageFlags BUFFER_READ_STAGES = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+constexpr VkAccessFlags BUFFER_READ_ACCESS = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+//the images are only sampled by the fragment shaders
+constexpr VkPipelineStageFlags IMAGE_READ_STAGES = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+constexpr VkAccessFlags IMAGE_READ_ACCESS = VK_ACCESS_SHADER_READ_BIT;
+
+//size in texels and bytes of the blocks of the formats the textures are created with
+static void texel_block(VkFormat format, uint32_t& outExtent, uint32_t& outBytes)
+{
+    switch (format)
+    {
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+        outExtent = 4;
+        outBytes = 8;
+        return;
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        outExtent = 4;
+        outBytes = 16;
+        return;
+    default:
+        outExtent = 1;
+        outBytes = 4;
+        return;
+    }
+}
+
+namespace vkutil
+{
+    void UploadQueue::init(VkDevice device, VmaAllocator allocator, VkQueue graphicsQueue, uint32_t graphicsFamily, VkQueue transferQueue, uint32_t transferFamily,
+        VkExtent3D transferGranularity, size_t stagingSize, VkDeviceSize stagingAlignment)
+    {
+        _device = device;
+        _allocator = allocator;
+        _graphicsQueue = graphicsQueue;
+        _graphicsFamily = graphicsFamily;
+        _transferQueue = transferQueue;
+        _transferFamily = transferFamily;
+        _transferGranularity = transferGranularity;
+
+        VkFenceCreateInfo fenceCreateInfo = vkinit::fence_create_info();
+        VkSemaphoreCreateInfo semaphoreCreateInfo = vkinit::semaphore_create_info();
+        for (Batch& batch : _batches)
+        {
+            //the pools are reset whole when their batch retires
+            VkCommandPoolCreateInfo transferPoolInfo = vkinit::command_pool_create_finfo(_transferFamily);
+            VK_CHECK(vkCreateCommandPool(_device, &transferPoolInfo, nullptr, &batch._transferPool));
+            VkCommandBufferAllocateInfo transferAllocInfo = vkinit::command_buffer_allocate_info(batch._transferPool, 1);
+            VK_CHECK(vkAllocateCommandBuffers(_device, &transferAllocInfo, &batch._transferCommands));
+            VK_CHECK(vkCreateFence(_device, &fenceCreateInfo, nullptr, &batch._fence));
+
+            if (dedicated_transfer())
+            {
+                VkCommandPoolCreateInfo graphicsPoolInfo = vkinit::command_pool_create_finfo(_graphicsFamily);
+                VK_CHECK(vkCreateCommandPool(_device, &graphicsPoolInfo, nullptr, &batch._graphicsPool));
+                VkCommandBufferAllocateInfo graphicsAllocInfo = vkinit::command_buffer_allocate_info(batch._graphicsPool, 1);
+                VK_CHECK(vkAllocateCommandBuffers(_device, &graphicsAllocInfo, &batch._graphicsCommands));
+                VK_CHECK(vkCreateSemaphore(_device, &semaphoreCreateInfo, nullptr, &batch._transferDone));
+            }
+        }
+
+        //every allocation is a multiple of the alignment, so the ring is too
+        _stagingAlignment = std::max<VkDeviceSize>(stagingAlignment, 16);
+        _stagingSize = std::max<VkDeviceSize>(stagingSize / _stagingAlignment * _stagingAlignment, _stagingAlignment);
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.pNext = nullptr;
+        bufferInfo.size = _stagingSize;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+        VmaAllocationCreateInfo vmaallocInfo{};
+        vmaallocInfo.usage = VMA_MEMORY_USAGE_UNKNOWN;
+        vmaallocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+        vmaallocInfo.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        //lz4 reads back what it already wrote, that is very slow in uncached memory
+        vmaallocInfo.preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+        VmaAllocationInfo allocationInfo;
+        VK_CHECK(vmaCreateBuffer(_allocator, &bufferInfo, &vmaallocInfo, &_stagingBuffer._buffer, &_stagingBuffer._allocation, &allocationInfo));
+        _stagingData = static_cast<char*>(allocationInfo.pMappedData);
+    }
+
+    void UploadQueue::cleanup()
+    {
+        while (_completedTicket < _submittedTicket)
+        {
+            wait_oldest();
+        }
+        vmaDestroyBuffer(_allocator, _stagingBuffer._buffer, _stagingBuffer._allocation);
+
+        for (Batch& batch : _batches)
+        {
+            vkDestroyCommandPool(_device, batch._transferPool, nullptr);
+            vkDestroyFence(_device, batch._fence, nullptr);
+            if (batch._graphicsPool != VK_NULL_HANDLE)
+            {
+                vkDestroyCommandPool(_device, batch._graphicsPool, nullptr);
+                vkDestroySemaphore(_device, batch._transferDone, nullptr);
+            }
+        }
+    }
+
+    UploadQueue::Batch& UploadQueue::begin_batch()
+    {
+        const UploadTicket ticket = _submittedTicket + 1;
+        Batch& batch = _batches[ticket % BATCH_COUNT];
+        if (batch._recording)
+        {
+            return batch;
+        }
+
+        //the slot is still used by a batch in flight when the ring is full, only then the cpu waits
+        while (ticket > _completedTicket + BATCH_COUNT)
+        {
+            ZoneScopedNC("Wait Upload Batch", tracy::Color::Red);
+            wait_oldest();
+        }
+
+        VkCommandBufferBeginInfo beginInfo = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        VK_CHECK(vkBeginCommandBuffer(batch._transferCommands, &beginInfo));
+        batch._recording = true;
+        return batch;
+    }
+
+    void UploadQueue::wait_oldest()
+    {
+        Batch& oldest = _batches[(_completedTicket + 1) % BATCH_COUNT];
+        VK_CHECK(vkWaitForFences(_device, 1, &oldest._fence, true, UINT64_MAX));
+        update();
+    }
+
+    bool UploadQueue::reserve_staging(VkDeviceSize size, VkDeviceSize& outOffset, VkDeviceSize& outBytes)
+    {
+        if (_stagingUsed == 0)
+        {
+            //nothing is in use, the allocations start from the beginning again
+            _stagingHead = 0;
+            _stagingTail = 0;
+        }
+        else if (_stagingHead == _stagingTail)
+        {
+            return false;
+        }
+
+        if (_stagingHead >= _stagingTail)
+        {
+            //free from the head to the end, then from the start to the tail
+            if (_stagingHead + size <= _stagingSize)
+            {
+                outOffset = _stagingHead;
+                outBytes = size;
+                return true;
+            }
+            if (size <= _stagingTail)
+            {
+                //the end of the ring is skipped, it is given back with the allocation
+                outOffset = 0;
+                outBytes = _stagingSize - _stagingHead + size;
+                return true;
+            }
+            return false;
+        }
+
+        if (_stagingHead + size <= _stagingTail)
+        {
+            outOffset = _stagingHead;
+            outBytes = size;
+            return true;
+        }
+        return false;
+    }
+
+    StagingAllocation UploadQueue::allocate_staging(size_t size)
+    {
+        StagingAllocation allocation;
+
+        const VkDeviceSize alignedSize = (static_cast<VkDeviceSize>(size) + _stagingAlignment - 1) / _stagingAlignment * _stagingAlignment;
+        if (alignedSize > _stagingSize)
+        {
+            allocation.overflow.resize(size);
+            allocation.data = allocation.overflow.data();
+            return allocation;
+        }
+
+        VkDeviceSize offset;
+        VkDeviceSize bytes;
+        for (;;)
+        {
+            Batch& batch = begin_batch();
+            if (reserve_staging(alignedSize, offset, bytes))
+            {
+                break;
+            }
+            //the space is held by copies already recorded, they have to be done before it comes back
+            ZoneScopedNC("Wait Staging Space", tracy::Color::Red);
+            if (batch._stagingBytes > 0)
+            {
+                flush();
+            }
+            wait_oldest();
+        }
+
+        Batch& batch = begin_batch();
+        _stagingHead = offset + alignedSize;
+        _stagingUsed += bytes;
+        batch._stagingBytes += bytes;
+        batch._stagingEnd = _stagingHead;
+        if (!batch._stagingRanges.empty() && batch._stagingRanges.back().first + batch._stagingRanges.back().second == offset)
+        {
+            batch._stagingRanges.back().second += alignedSize;
+        }
+        else
+        {
+            batch._stagingRanges.push_back({offset, alignedSize});
+        }
+
+        allocation.buffer = _stagingBuffer._buffer;
+        allocation.offset = offset;
+        allocation.data = _stagingData + offset;
+        return allocation;
+    }
+
+    UploadTicket UploadQueue::copy_buffer(const StagingAllocation& staging, VkBuffer destination, const VkBufferCopy& copy, bool concurrent)
+    {
+        if (staging.buffer == VK_NULL_HANDLE)
+        {
+            const VkDeviceSize pieceSize = piece_size();
+            UploadTicket ticket = 0;
+            for (VkDeviceSize done = 0; done < copy.size; done += pieceSize)
+            {
+                const VkDeviceSize size = std::min(pieceSize, copy.size - done);
+                StagingAllocation piece = allocate_staging(static_cast<size_t>(size));
+                memcpy(piece.data, staging.data + copy.srcOffset + done, static_cast<size_t>(size));
+
+                VkBufferCopy pieceCopy;
+                pieceCopy.srcOffset = 0;
+                pieceCopy.dstOffset = copy.dstOffset + done;
+                pieceCopy.size = size;
+                ticket = copy_buffer(piece, destination, pieceCopy, concurrent);
+            }
+            return ticket;
+        }
+
+        Batch& batch = begin_batch();
+        VkBufferCopy ringCopy = copy;
+        ringCopy.srcOffset += staging.offset;
+        vkCmdCopyBuffer(batch._transferCommands, staging.buffer, destination, 1, &ringCopy);
+
+        //the access masks are filled on flush, they depend on the queue the barrier is recorded on
+        //buffers shared by both families only need the copies made visible, the semaphore orders the queues
+        const bool transferOwnership = dedicated_transfer() && !concurrent;
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = transferOwnership ? _transferFamily : VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = transferOwnership ? _graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = destination;
+        barrier.offset = copy.dstOffset;
+        barrier.size = copy.size;
+        batch._bufferAcquires.push_back(barrier);
+        return _submittedTicket + 1;
+    }
+
+    UploadTicket UploadQueue::copy_buffer(VkBuffer source, VkBuffer destination, const VkBufferCopy& copy)
+    {
+        Batch& batch = begin_batch();
+
+        //the source was written by copies of the earlier batches on this queue, they are made visible to this one
+        VkMemoryBarrier writesDone{};
+        writesDone.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        writesDone.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        writesDone.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(batch._transferCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &writesDone, 0, nullptr, 0, nullptr);
+        vkCmdCopyBuffer(batch._transferCommands, source, destination, 1, &copy);
+
+        //both buffers are concurrent, the barrier of the flush only makes the copy visible
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = destination;
+        barrier.offset = copy.dstOffset;
+        barrier.size = copy.size;
+        batch._bufferAcquires.push_back(barrier);
+        return _submittedTicket + 1;
+    }
+
+    void UploadQueue::begin_image_copies(VkImage destination, const VkImageSubresourceRange& range)
+    {
+        VkImageMemoryBarrier imageBarrierToTransfer{};
+        imageBarrierToTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageBarrierToTransfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageBarrierToTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imageBarrierToTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrierToTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrierToTransfer.image = destination;
+        imageBarrierToTransfer.subresourceRange = range;
+        imageBarrierToTransfer.srcAccessMask = 0;
+        imageBarrierToTransfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        //barrier the levels into the transfer receive layout
+        vkCmdPipelineBarrier(begin_batch()._transferCommands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrierToTransfer);
+    }
+
+    void UploadQueue::end_image_copies(VkImage destination, const VkImageSubresourceRange& range)
+    {
+        //the move to the shader readable layout is done by the barriers of the flush, with the ownership transfer
+        //they come after the copies of the earlier batches too, on the same queue
+        VkImageMemoryBarrier imageBarrierToReadable{};
+        imageBarrierToReadable.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageBarrierToReadable.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imageBarrierToReadable.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageBarrierToReadable.srcQueueFamilyIndex = dedicated_transfer() ? _transferFamily : VK_QUEUE_FAMILY_IGNORED;
+        imageBarrierToReadable.dstQueueFamilyIndex = dedicated_transfer() ? _graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+        imageBarrierToReadable.image = destination;
+        imageBarrierToReadable.subresourceRange = range;
+        begin_batch()._imageAcquires.push_back(imageBarrierToReadable);
+    }
+
+    bool UploadQueue::fits_image_rows(VkFormat format, uint32_t width) const
+    {
+        uint32_t blockExtent;
+        uint32_t blockBytes;
+        texel_block(format, blockExtent, blockBytes);
+        const VkDeviceSize rowBytes = static_cast<VkDeviceSize>((width + blockExtent - 1) / blockExtent) * blockBytes;
+        return rowBytes * std::max(_transferGranularity.height, 1u) <= piece_size();
+    }
+
+    bool UploadQueue::copy_image(const StagingAllocation& staging, const AllocatedImage& destination, const VkImageSubresourceRange& range, const std::vector<VkBufferImageCopy>& copies,
+        UploadTicket& outTicket)
+    {
+        //checked before the layout changes are recorded, so a level that can't be copied leaves nothing half written behind
+        if (staging.buffer == VK_NULL_HANDLE)
+        {
+            for (const VkBufferImageCopy& copy : copies)
+            {
+                if (!fits_image_rows(destination._format, copy.imageExtent.width))
+                {
+                    LOG_ERROR("The rows of level {} are bigger than a piece of the staging ring", copy.imageSubresource.mipLevel);
+                    return false;
+                }
+            }
+        }
+
+        begin_image_copies(destination._image, range);
+
+        if (staging.buffer != VK_NULL_HANDLE)
+        {
+            std::vector<VkBufferImageCopy> ringCopies = copies;
+            for (VkBufferImageCopy& copy : ringCopies)
+            {
+                copy.bufferOffset += staging.offset;
+            }
+            vkCmdCopyBufferToImage(begin_batch()._transferCommands, staging.buffer, destination._image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(ringCopies.size()), ringCopies.data());
+        }
+        else
+        {
+            uint32_t blockExtent;
+            uint32_t blockBytes;
+            texel_block(destination._format, blockExtent, blockBytes);
+            const VkDeviceSize pieceSize = piece_size();
+            for (const VkBufferImageCopy& copy : copies)
+            {
+                //the levels are tightly packed, every piece holds whole rows of blocks
+                const uint32_t blocksWide = (copy.imageExtent.width + blockExtent - 1) / blockExtent;
+                const uint32_t blocksHigh = (copy.imageExtent.height + blockExtent - 1) / blockExtent;
+                const VkDeviceSize rowBytes = static_cast<VkDeviceSize>(blocksWide) * blockBytes;
+                //the pieces cover the whole width, their offset and height have to be multiples of the granularity of the queue except for the last one
+                //the granularity counts blocks like the rows, granularity rows fit a piece as checked above
+                const uint32_t granularity = std::max(_transferGranularity.height, 1u);
+                const uint32_t rowsPerPiece = std::max(static_cast<uint32_t>(pieceSize / rowBytes) / granularity, 1u) * granularity;
+                for (uint32_t row = 0; row < blocksHigh; row += rowsPerPiece)
+                {
+                    const uint32_t rows = std::min(rowsPerPiece, blocksHigh - row);
+                    StagingAllocation piece = allocate_staging(static_cast<size_t>(rows * rowBytes));
+                    memcpy(piece.data, staging.data + copy.bufferOffset + row * rowBytes, static_cast<size_t>(rows * rowBytes));
+
+                    VkBufferImageCopy pieceCopy = copy;
+                    pieceCopy.bufferOffset = piece.offset;
+                    pieceCopy.bufferRowLength = 0;
+                    pieceCopy.bufferImageHeight = 0;
+                    pieceCopy.imageOffset.y = copy.imageOffset.y + static_cast<int32_t>(row * blockExtent);
+                    pieceCopy.imageExtent.height = std::min(rows * blockExtent, copy.imageExtent.height - row * blockExtent);
+                    vkCmdCopyBufferToImage(begin_batch()._transferCommands, piece.buffer, destination._image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &pieceCopy);
+                }
+            }
+        }
+
+        end_image_copies(destination._image, range);
+        outTicket = _submittedTicket + 1;
+        return true;
+    }
+
+    void UploadQueue::flush()
+    {
+        const UploadTicket ticket = _submittedTicket + 1;
+        Batch& batch = _batches[ticket % BATCH_COUNT];
+        if (!batch._recording)
+        {
+            return;
+        }
+
+        ZoneScopedNC("Flush Uploads", tracy::Color::White);
+        const bool dedicated = dedicated_transfer();
+        const uint32_t bufferBarrierCount = static_cast<uint32_t>(batch._bufferAcquires.size());
+        const uint32_t imageBarrierCount = static_cast<uint32_t>(batch._imageAcquires.size());
+
+        //on the transfer queue the barriers release the resources, the same ones acquire them on the graphics queue
+        //without a transfer queue they make the copies visible to the stages that read them
+        for (VkBufferMemoryBarrier& barrier : batch._bufferAcquires)
+        {
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = dedicated ? 0 : BUFFER_READ_ACCESS;
+        }
+        for (VkImageMemoryBarrier& barrier : batch._imageAcquires)
+        {
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = dedicated ? 0 : IMAGE_READ_ACCESS;
+        }
+        const VkPipelineStageFlags readStages = (bufferBarrierCount > 0 ? BUFFER_READ_STAGES : 0) | (imageBarrierCount > 0 ? IMAGE_READ_STAGES : 0);
+        //a batch can hold only staging buffers to free
+        const bool hasBarriers = bufferBarrierCount + imageBarrierCount > 0;
+        if (hasBarriers)
+        {
+            vkCmdPipelineBarrier(batch._transferCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, dedicated ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : readStages, 0,
+                0, nullptr, bufferBarrierCount, batch._bufferAcquires.data(), imageBarrierCount, batch._imageAcquires.data());
+        }
+        VK_CHECK(vkEndCommandBuffer(batch._transferCommands));
+
+        //the ring memory can be non coherent, the writes of the batch are made visible before it runs
+        for (const auto& [offset, size] : batch._stagingRanges)
+        {
+            VK_CHECK(vmaFlushAllocation(_allocator, _stagingBuffer._allocation, offset, size));
+        }
+
+        VkSubmitInfo transferSubmit = vkinit::submit_info(&batch._transferCommands);
+        if (!dedicated)
+        {
+            VK_CHECK(vkQueueSubmit(_graphicsQueue, 1, &transferSubmit, batch._fence));
+        }
+        else
+        {
+            transferSubmit.signalSemaphoreCount = 1;
+            transferSubmit.pSignalSemaphores = &batch._transferDone;
+            VK_CHECK(vkQueueSubmit(_transferQueue, 1, &transferSubmit, VK_NULL_HANDLE));
+
+            for (VkBufferMemoryBarrier& barrier : batch._bufferAcquires)
+            {
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = BUFFER_READ_ACCESS;
+            }
+            for (VkImageMemoryBarrier& barrier : batch._imageAcquires)
+            {
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = IMAGE_READ_ACCESS;
+            }
+
+            VkCommandBufferBeginInfo beginInfo = vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+            VK_CHECK(vkBeginCommandBuffer(batch._graphicsCommands, &beginInfo));
+            //the semaphore wait is at the transfer stage, the barriers start from it so the frames submitted after wait for the copies
+            if (hasBarriers)
+            {
+                vkCmdPipelineBarrier(batch._graphicsCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, readStages, 0,
+                    0, nullptr, bufferBarrierCount, batch._bufferAcquires.data(), imageBarrierCount, batch._imageAcquires.data());
+            }
+            VK_CHECK(vkEndCommandBuffer(batch._graphicsCommands));
+
+            const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+            VkSubmitInfo graphicsSubmit = vkinit::submit_info(&batch._graphicsCommands);
+            graphicsSubmit.waitSemaphoreCount = 1;
+            graphicsSubmit.pWaitSemaphores = &batch._transferDone;
+            graphicsSubmit.pWaitDstStageMask = &waitStage;
+            VK_CHECK(vkQueueSubmit(_graphicsQueue, 1, &graphicsSubmit, batch._fence));
+        }
+
+        batch._recording = false;
+        batch._bufferAcquires.clear();
+        batch._imageAcquires.clear();
+        batch._stagingRanges.clear();
+        _submittedTicket = ticket;
+    }
+
+    void UploadQueue::update()
+    {
+        //batches are retired in order, so a ticket is ready once every batch up to its own is
+        while (_completedTicket < _submittedTicket)
+        {
+            Batch& batch = _batches[(_completedTicket + 1) % BATCH_COUNT];
+            if (vkGetFenceStatus(_device, batch._fence) != VK_SUCCESS)
+            {
+                break;
+            }
+            retire(batch);
+            _completedTicket++;
+        }
+    }
+
+    void UploadQueue::retire(Batch& batch)
+    {
+        //batches retire in order, so the tail only moves forward
+        if (batch._stagingBytes > 0)
+        {
+            _stagingUsed -= batch._stagingBytes;
+            _stagingTail = batch._stagingEnd;
+            batch._stagingBytes = 0;
+        }
+
+        VK_CHECK(vkResetFences(_device, 1, &batch._fence));
+        VK_CHECK(vkResetCommandPool(_device, batch._transferPool, 0));
+        if (batch._graphicsPool != VK_NULL_HANDLE)
+        {
+            VK_CHECK(vkResetCommandPool(_device, batch._graphicsPool, 0));
+        }
+    }
+} // namespace vkutil
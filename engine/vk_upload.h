@@ -0,0 +1,144 @@
+#pragma once
+
+#include <vk_types.h>
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <vector>
+
+namespace vkutil
+{
+    //batch of the upload queue a copy was recorded in, 0 for resources that never needed one
+    using UploadTicket = uint64_t;
+
+    //memory the caller writes the data of an upload to, before recording the copies that read it
+    struct StagingAllocation
+    {
+        //the staging ring, null when the data is bigger than the ring and is held in overflow instead
+        VkBuffer buffer{VK_NULL_HANDLE};
+        VkDeviceSize offset{0};
+        char* data{nullptr};
+        //copied through the ring in pieces, the last ones wait for the first ones to be done
+        std::vector<char> overflow;
+    };
+
+    //copies from the staging ring are recorded in a batch that is submitted once on flush, instead of waiting on every asset
+    //the batch goes to the dedicated transfer queue when the device has one, the resources are then handed to the graphics queue
+    //every batch has its own fence, they are only polled so the cpu never waits unless the ring of batches or the staging ring is full
+    class UploadQueue
+    {
+    public:
+        //transferQueue can be the graphics queue, the ownership transfers are skipped then
+        //transferGranularity is the minImageTransferGranularity of its family, the rows the big levels are split in start at multiples of it
+        //the staging ring is stagingSize bytes of persistently mapped memory, its allocations are aligned to stagingAlignment
+        void init(VkDevice device, VmaAllocator allocator, VkQueue graphicsQueue, uint32_t graphicsFamily, VkQueue transferQueue, uint32_t transferFamily,
+            VkExtent3D transferGranularity, size_t stagingSize, VkDeviceSize stagingAlignment);
+
+        //waits for the batches in flight and frees the ring
+        void cleanup();
+
+        //space for size bytes in the staging ring, the batch is submitted and the oldest ones waited for when the ring is full
+        //the copies reading an allocation have to be recorded before the next one is made, the space goes back to the ring with their batch
+        StagingAllocation allocate_staging(size_t size);
+
+        //copies a region of the staging allocation into a buffer, srcOffset is relative to the allocation
+        //the buffer can be read by any stage once the batch is done
+        //concurrent buffers are shared by the graphics and the transfer families, their ranges are copied without ownership transfer
+        UploadTicket copy_buffer(const StagingAllocation& staging, VkBuffer destination, const VkBufferCopy& copy, bool concurrent = false);
+
+        //copies between two ranges of buffers shared by the graphics and the transfer families, they can be in the same buffer but can't overlap
+        //the source has to be written by the batches before this one, the frames can keep reading it during the copy
+        UploadTicket copy_buffer(VkBuffer source, VkBuffer destination, const VkBufferCopy& copy);
+
+        //copies into levels of an image nothing reads yet, the bufferOffset of the copies are relative to the allocation
+        //the levels are left in the shader read layout, the ones too big for the ring are copied in rows of texel blocks
+        //false when a level of the overflow is too wide for its rows to fit a piece of the ring, nothing is recorded then
+        bool copy_image(const StagingAllocation& staging, const AllocatedImage& destination, const VkImageSubresourceRange& range, const std::vector<VkBufferImageCopy>& copies,
+            UploadTicket& outTicket);
+
+        //true when the rows of texel blocks of a level that wide fit a piece of the ring, with the granularity of the transfer queue
+        //images wider than that can't be copied once they overflow the ring
+        bool fits_image_rows(VkFormat format, uint32_t width) const;
+
+        //submits the batch recorded so far, nothing happens when it is empty
+        void flush();
+
+        //retires the batches whose fence is signaled, in submission order
+        void update();
+
+        //true once the batch of the ticket completed on the gpu
+        bool is_ready(UploadTicket ticket) const { return ticket <= _completedTicket; }
+
+        //batches submitted and not retired yet
+        uint32_t batches_in_flight() const { return static_cast<uint32_t>(_submittedTicket - _completedTicket); }
+
+        //bytes of the staging ring held by batches not retired yet
+        size_t staging_used() const { return static_cast<size_t>(_stagingUsed); }
+        size_t staging_size() const { return static_cast<size_t>(_stagingSize); }
+
+        bool dedicated_transfer() const { return _transferFamily != _graphicsFamily; }
+
+    private:
+        struct Batch
+        {
+            VkCommandPool _transferPool;
+            VkCommandBuffer _transferCommands;
+            //acquires the resources on the graphics queue, only used with a dedicated transfer queue
+            VkCommandPool _graphicsPool{VK_NULL_HANDLE};
+            VkCommandBuffer _graphicsCommands{VK_NULL_HANDLE};
+            VkSemaphore _transferDone{VK_NULL_HANDLE};
+            VkFence _fence;
+            std::vector<VkBufferMemoryBarrier> _bufferAcquires;
+            std::vector<VkImageMemoryBarrier> _imageAcquires;
+            //ranges of the ring written for the batch, flushed when it is submitted as the memory can be non coherent
+            std::vector<std::pair<VkDeviceSize, VkDeviceSize>> _stagingRanges;
+            //bytes of the ring the batch holds, with the end of the ring skipped when an allocation wrapped
+            VkDeviceSize _stagingBytes{0};
+            //head of the ring after the last allocation of the batch, the tail moves there when it retires
+            VkDeviceSize _stagingEnd{0};
+            bool _recording{false};
+        };
+
+        //batches that can be in flight at once, a flush waits for the oldest one past that
+        static constexpr size_t BATCH_COUNT = 4;
+
+        //batch recording the next copies, its commands are begun on first use
+        Batch& begin_batch();
+        void retire(Batch& batch);
+        //blocks until the oldest batch in flight is done, and retires it
+        void wait_oldest();
+
+        //bytes of the ring the allocations too big for it are copied through at a time
+        //a quarter of the ring, so the next pieces are written while the first ones are copied
+        VkDeviceSize piece_size() const { return std::max(_stagingSize / 4 / _stagingAlignment * _stagingAlignment, _stagingAlignment); }
+
+        //finds size contiguous bytes after the head of the ring, wrapping to its start when the end is too short
+        bool reserve_staging(VkDeviceSize size, VkDeviceSize& outOffset, VkDeviceSize& outBytes);
+
+        //layout changes around the copies into an image, recorded in the batch of the first and the last copies
+        void begin_image_copies(VkImage destination, const VkImageSubresourceRange& range);
+        void end_image_copies(VkImage destination, const VkImageSubresourceRange& range);
+
+        VkDevice _device;
+        VmaAllocator _allocator;
+        VkQueue _graphicsQueue;
+        uint32_t _graphicsFamily;
+        VkQueue _transferQueue;
+        uint32_t _transferFamily;
+        VkExtent3D _transferGranularity;
+
+        std::array<Batch, BATCH_COUNT> _batches;
+        //the batch of ticket t is _batches[t % BATCH_COUNT], the one recording has ticket _submittedTicket + 1
+        UploadTicket _submittedTicket{0};
+        UploadTicket _completedTicket{0};
+
+        AllocatedBuffer _stagingBuffer;
+        char* _stagingData{nullptr};
+        VkDeviceSize _stagingSize{0};
+        VkDeviceSize _stagingAlignment{16};
+        //allocations are made at the head and given back at the tail, in the order of the batches
+        VkDeviceSize _stagingHead{0};
+        VkDeviceSize _stagingTail{0};
+        VkDeviceSize _stagingUsed{0};
+    };
+} // namespace vkutil
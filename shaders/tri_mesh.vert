@@ -1,5 +1,10 @@
 #version 460
 
+//unorm positions inside the mesh bounds, octahedral normals and half float uvs
+layout (constant_id = 0) const bool QUANTIZED = false;
+//quantized meshes without a color use the normal instead
+layout (constant_id = 1) const bool HAS_COLOR = true;
+
 layout (location = 0) in vec3 vPosition;
 layout (location = 1) in vec3 vNormal;
 layout (location = 2) in vec3 vColor;
@@ -16,6 +21,9 @@ layout (set=0, binding = 0) uniform CameraBuffer{
 
 struct ObjectData{
     mat4 model;
+    //maps quantized positions back to model space, xyz used
+    vec4 positionScale;
+    vec4 positionOffset;
 };
 
 //all object matrices
@@ -35,12 +43,32 @@ layout(set = 1, binding = 1) readonly buffer InstanceBuffer{
 //     mat4 model;
 // } PushConstants;
 
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
 void main()
 {
     int index = instanceBuffer.IDs[gl_InstanceIndex];
-    mat4 modelMatrix = objectBuffer.objects[index].model;
-    mat4 transformMatrix = cameraData.viewproj * modelMatrix;
-    outColor = vColor;
+    ObjectData objectData = objectBuffer.objects[index];
+    mat4 transformMatrix = cameraData.viewproj * objectData.model;
+
+    vec3 position = vPosition;
+    vec3 normal = vNormal;
+    vec3 color = vColor;
+    if (QUANTIZED)
+    {
+        position = vPosition * objectData.positionScale.xyz + objectData.positionOffset.xyz;
+        normal = decodeOctahedral(vNormal.xy);
+        color = HAS_COLOR ? vColor : normal;
+    }
+
+    outColor = color;
     texCoord = vTexCoord;
-    gl_Position = transformMatrix * vec4(vPosition,1.0f);
-}
\ No newline at end of file
+    gl_Position = transformMatrix * vec4(position,1.0f);
+}